@@ -15,6 +15,10 @@ int n_ray_aabb_intersects = 0;
 int n_ray_triangle_intersects = 0;
 int n_vertical_cylinder_aabb_intersects = 0;
 int n_vertical_cylinder_triangle_intersects = 0;
+static int collision_stats_enabled = 1;
+
+// The counters are plain ints, so they're only touched while a single thread does collision
+#define COLLISION_COUNT(counter) do { if (collision_stats_enabled) ++(counter); } while (0)
 
 void handle_node_intersection_ray(level_collision_t* self, const bvh_node_t* current_node, const ray_t ray, rayhit_t* hit, const int rec_depth) {
     // Intersect current node
@@ -161,7 +165,7 @@ int ray_aabb_intersect_fancy(const aabb_t* aabb, ray_t ray, rayhit_t* hit) {
     if (!hit) return 0;
 #endif
 
-    n_ray_aabb_intersects++;
+    COLLISION_COUNT(n_ray_aabb_intersects);
     // If the ray starts inside the box, always intersect
     if (point_aabb_intersect(aabb, ray.position)) {
         hit->distance = 0;
@@ -203,7 +207,7 @@ int ray_aabb_intersect(const aabb_t* aabb, ray_t ray) {
     if (!aabb) return 0;
 #endif
 
-    n_ray_aabb_intersects++;
+    COLLISION_COUNT(n_ray_aabb_intersects);
     const scalar_t tx1 = scalar_mul(aabb->min.x - ray.position.x, ray.inv_direction.x);
     const scalar_t tx2 = scalar_mul(aabb->max.x - ray.position.x, ray.inv_direction.x);
 
@@ -231,7 +235,7 @@ int ray_triangle_intersect(collision_triangle_3d_t* triangle, ray_t ray, rayhit_
     if (!hit) return 0;
 #endif
 
-    n_ray_triangle_intersects++;
+    COLLISION_COUNT(n_ray_triangle_intersects);
 #define SHIFT_COUNT 5
     const vec3_t vtx0 = vec3_shift_right(triangle->v0, SHIFT_COUNT);
     const vec3_t vtx1 = vec3_shift_right(triangle->v1, SHIFT_COUNT);
@@ -285,7 +289,7 @@ int vertical_cylinder_aabb_intersect(const aabb_t* aabb, const vertical_cylinder
     if (!aabb) return 0;
 #endif
 
-    n_vertical_cylinder_aabb_intersects++;
+    COLLISION_COUNT(n_vertical_cylinder_aabb_intersects);
 
     // Check the Y axis first. If this does not overlap, there can not be a collision.
     if ((vertical_cylinder.bottom.y + vertical_cylinder.height) < aabb->min.y) return 0; // If top of cylinder is below the AABB, no intersect
@@ -546,7 +550,7 @@ int vertical_cylinder_triangle_intersect(collision_triangle_3d_t* triangle, vert
     if (!hit) return 0;
 #endif
 
-    n_vertical_cylinder_triangle_intersects++;
+    COLLISION_COUNT(n_vertical_cylinder_triangle_intersects);
 
     if (vertical_cylinder.is_wall_check) {
         if (triangle->normal.y > 0) {
@@ -671,6 +675,10 @@ void collision_clear_stats(void) {
     n_vertical_cylinder_triangle_intersects = 0;
 }
 
+void collision_set_stats_enabled(const int enabled) {
+    collision_stats_enabled = enabled;
+}
+
 vec3_t closest_point_on_line_segment(const vec3_t a, const vec3_t b, const vec3_t point) {
     const vec3_t ab = vec3_sub(b, a);
     const vec3_t ap = vec3_sub(point, a);
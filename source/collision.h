@@ -29,5 +29,6 @@ int vertical_cylinder_triangle_intersect(collision_triangle_3d_t* triangle, vert
 
 // Statistics
 void collision_clear_stats(void);
+void collision_set_stats_enabled(int enabled); // Turn counting off while collision queries run on more than one thread
 
 #endif // COLLISION_H
@@ -11,6 +11,9 @@
 #endif
 
 // #define BENCHMARK_MODE
+#ifndef BENCHMARK_LEVEL
+#define BENCHMARK_LEVEL "levels/level1.lvl" // Headless benchmark runs skip the menus and load this level
+#endif
 #define FPS_COUNTER
 
 #define ALWAYS_INLINE __attribute__((always_inline)) inline
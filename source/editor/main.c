@@ -3,6 +3,7 @@
 #include "camera.h"
 #include "../pc/debug_layer.h"
 #include "../pc/psx.h"
+#include "../pc/jobs.h"
 #include "../renderer.h"
 #include "../entity.h"
 #include "../player.h"
@@ -34,6 +35,7 @@ int main(int argc, char** argv) {
     mem_init();
     renderer_init();
     input_init();
+    job_system_init();
 	entity_init();
     input_set_stick_deadzone(36);
     
@@ -75,8 +77,10 @@ int main(int argc, char** argv) {
         
         renderer_begin_frame(&camera.transform);
         {
+            renderer_set_phase(RENDERER_PHASE_ENTITIES);
             entity_update_all(&player, 0);
             
+            renderer_set_phase(RENDERER_PHASE_UI);
             debug_layer_begin();
             debug_layer_manipulate_entity(&camera.transform, &selected_entity, &mouse_over_viewport, &level, &player);
             debug_layer_end();
@@ -84,5 +88,6 @@ int main(int argc, char** argv) {
         renderer_end_frame();
     }
 
+    job_system_close();
     return 0;
 }
@@ -22,7 +22,7 @@ entity_chaser_t* entity_chaser_new(void) {
 	entity->entity_header.position = (vec3_t){ 0, 0, 0 };
 	entity->entity_header.rotation = (vec3_t){ 0, 0, 0 };
 	entity->entity_header.scale = (vec3_t){ ONE, ONE, ONE };
-	entity->entity_header.mesh = model_find_mesh(entity_get_models(), "19_enemy_chaser_idle");
+	entity->entity_header.mesh = entity_get_mesh(ENTITY_MESH_CHASER_IDLE);
 	entity->curr_navmesh_node = -1;
 	entity->target_navmesh_node = -1;
 	entity->state = CHASER_WAIT;
@@ -32,9 +32,18 @@ entity_chaser_t* entity_chaser_new(void) {
 	return entity;
 }
 
-void decide_action(entity_chaser_t* chaser, const vec3_t player_pos) {
+typedef struct {
+	vec3_t last_known_player_pos;
+	uint8_t did_raycast;
+	uint8_t player_visible;
+} chaser_sight_t;
+
+static chaser_sight_t think_results[ENTITY_THINK_RESULT_COUNT];
+
+// Only reads shared state, so this can run in the think phase. The collision counters are off while it does
+chaser_sight_t check_sight(const entity_chaser_t* chaser, const vec3_t player_pos) {
 	const vec3_t chaser_pos = chaser->entity_header.position;
-	int player_visible = 0;
+	chaser_sight_t sight = {0};
 
 	// Find distance to player
 	const vec3_t chaser_to_player = vec3_sub(player_pos, chaser_pos);
@@ -51,18 +60,30 @@ void decide_action(entity_chaser_t* chaser, const vec3_t player_pos) {
 
 		rayhit_t hit = {0};
 		bvh_intersect_ray(&state.in_game.level.collision_bvh, ray, &hit);
-		chaser->last_known_player_pos = hit.position;
+		sight.did_raycast = 1;
+		sight.last_known_player_pos = hit.position;
 
 		// If the ray didn't hit anything, the player is visible
 		if (is_infinity(hit.distance)) 
-			player_visible = 1;
+			sight.player_visible = 1;
 
 		// If the ray hit something that's further away from the enemy than the player is, the player is visible
 		else if (scalar_mul(hit.distance, hit.distance) > dist_chaser_to_player_squared)
-			player_visible = 1;
+			sight.player_visible = 1;
 	}
 
-	if (player_visible) {
+	return sight;
+}
+
+void decide_action(entity_chaser_t* chaser, const vec3_t player_pos, const chaser_sight_t* sight) {
+	const vec3_t chaser_pos = chaser->entity_header.position;
+	const scalar_t dist_chaser_to_player_squared = vec3_magnitude_squared(vec3_sub(player_pos, chaser_pos));
+
+	if (sight->did_raycast) {
+		chaser->last_known_player_pos = sight->last_known_player_pos;
+	}
+
+	if (sight->player_visible) {
 
 		if (dist_chaser_to_player_squared < CHASER_FLEE_DISTANCE_SQUARED) {
 			chaser->state = CHASER_FLEE;
@@ -132,8 +153,34 @@ void find_target_node(entity_chaser_t* chaser, vec3_t target_position, find_targ
 	}
 }
 
+void entity_chaser_think(int slot, const player_t* player, int dt) {
+	(void)dt;
+	entity_chaser_t* chaser = (entity_chaser_t*)entity_get_header(slot);
+	const vec3_t chaser_pos = chaser->entity_header.position;
+
+	// If the enemy doesn't know where it is, figure that out
+	if (chaser->curr_navmesh_node < 0 || chaser->curr_navmesh_node >= n_nav_graph_nodes) {
+		scalar_t curr_min_distance = INT32_MAX;
+
+		for (int i = 0; i < n_nav_graph_nodes; ++i) {
+			const vec3_t node_position = vec3_from_svec3(nav_graph_nodes[i].position);
+			const scalar_t distance_squared = vec3_magnitude_squared(vec3_sub(node_position, chaser_pos));
+			if (distance_squared >= 0 && distance_squared < curr_min_distance) {
+				curr_min_distance = distance_squared;
+				chaser->curr_navmesh_node = i;
+			}
+		}
+	}
+
+	// The sight raycast is the expensive part of deciding what to do next, so get it out of the way here
+	if (chaser->behavior_timer <= 0) {
+		think_results[ENTITY_THINK_RESULT_INDEX(slot)] = check_sight(chaser, player->position);
+	}
+}
+
 void entity_chaser_update(int slot, player_t* player, int dt) {
 	entity_chaser_t* chaser = (entity_chaser_t*)entity_get_header(slot);
+	const chaser_sight_t* sight = &think_results[ENTITY_THINK_RESULT_INDEX(slot)];
 	const vec3_t chaser_pos = chaser->entity_header.position;
 
 #ifdef _LEVEL_EDITOR
@@ -146,7 +193,7 @@ void entity_chaser_update(int slot, player_t* player, int dt) {
 		.radius = 50 * ONE,
 	});
 
-	// Register hitboxes
+	// Update hitboxes, these only get marked dirty when the enemy actually moved
 	const aabb_t bounds_body = (aabb_t){
 		.min = (vec3_t){ 
 			chaser_pos.x - (69 * COL_SCALE), 
@@ -183,51 +230,37 @@ void entity_chaser_update(int slot, player_t* player, int dt) {
 		.is_solid = 0,
 		.is_trigger = 0,
 	};
-	entity_register_collision_box(&box_body);
-	entity_register_collision_box(&box_head);
-
-	// If the enemy doesn't know where it is, figure that out
-	if (chaser->curr_navmesh_node < 0 || chaser->curr_navmesh_node >= n_nav_graph_nodes) {
-		scalar_t curr_min_distance = INT32_MAX;
-
-		for (int i = 0; i < n_nav_graph_nodes; ++i) {
-			const vec3_t node_position = vec3_from_svec3(nav_graph_nodes[i].position);
-			const scalar_t distance_squared = vec3_magnitude_squared(vec3_sub(node_position, chaser_pos));
-			if (distance_squared >= 0 && distance_squared < curr_min_distance) {
-				curr_min_distance = distance_squared;
-				chaser->curr_navmesh_node = i;
-			}
-		}
-	}
+	entity_update_collision_box(slot, 0, &box_body);
+	entity_update_collision_box(slot, 1, &box_head);
 
 	if (chaser->behavior_timer > 0) chaser->behavior_timer -= dt;
 	else {
 		chaser->behavior_timer = random_range(CHASER_REACTION_TIME_MIN, CHASER_REACTION_TIME_MAX);
 		switch (chaser->state) {
 			case CHASER_WAIT: 			
-				decide_action(chaser, player->position);				
+				decide_action(chaser, player->position, sight);				
 				break;
 			case CHASER_RETURN_HOME: 	
 				if (vec3_magnitude_squared(vec3_sub(chaser_pos, chaser->home_position)) > CHASER_NODE_REACH_DISTANCE_SQUARED) {
 					find_target_node(chaser, chaser->home_position, CLOSEST);
 				}
-				decide_action(chaser, player->position);		
+				decide_action(chaser, player->position, sight);		
 				break;
 			case CHASER_CHASE: 			
 				find_target_node(chaser, player->position, CLOSEST);
-				decide_action(chaser, player->position);		
+				decide_action(chaser, player->position, sight);		
 				break;
 			case CHASER_FLEE: 			
 				find_target_node(chaser, player->position, FURTHEST);
-				decide_action(chaser, player->position);		
+				decide_action(chaser, player->position, sight);		
 				break;
 			case CHASER_STRAFE:
 				find_target_node(chaser, player->position, STRAFE);
-				decide_action(chaser, player->position);		
+				decide_action(chaser, player->position, sight);		
 				break;
 			case CHASER_SHOOT: 			
 				// TODO
-				decide_action(chaser, player->position);				
+				decide_action(chaser, player->position, sight);				
 				break;
 			default: 					
 				chaser->state = CHASER_WAIT; /* Failsafe */	
@@ -286,8 +319,9 @@ void entity_chaser_update(int slot, player_t* player, int dt) {
 	renderer_set_drawing_entity_id(slot);
 #endif
 	if (chaser->entity_header.mesh == NULL) {
-		chaser->entity_header.mesh = model_find_mesh(entity_get_models(), "19_enemy_chaser_idle");
+		chaser->entity_header.mesh = entity_get_mesh(ENTITY_MESH_CHASER_IDLE);
 	}
+	if (!entity_in_visible_section(slot, chaser->entity_header.mesh, &render_transform, 1)) return;
 	renderer_draw_mesh_shaded(chaser->entity_header.mesh, &render_transform, 0, 1, tex_entity_start);
 }
 
@@ -8,37 +8,40 @@ entity_crate_t* entity_crate_new(void) {
 	entity->entity_header.position = (vec3_t){0, 0, 0};
 	entity->entity_header.rotation = (vec3_t){0, 0, 0};
 	entity->entity_header.scale = (vec3_t){ONE, ONE, ONE};
-	entity->entity_header.mesh = model_find_mesh(entity_get_models(), "28_crate");
+	entity->entity_header.mesh = entity_get_mesh(ENTITY_MESH_CRATE);
     entity->pickup_to_spawn = PICKUP_TYPE_NONE;
 	return entity;
 }
 
 void entity_crate_update(int slot, player_t* player, int dt) {
-	PANIC_IF("entity_models is null!", entity_get_models() == NULL);
-	PANIC_IF("entity_models->meshes is null!", entity_get_models()->meshes == NULL);
-	PANIC_IF("entity_models does not contain enough meshes!", entity_get_models()->n_meshes < N_ENTITY_MESH_IDS);
+	PANIC_IF("Crate entity could not find mesh!", entity_get_mesh(ENTITY_MESH_CRATE) == NULL);
 
 	(void)dt;
 	(void)player;
 	entity_crate_t* crate = (entity_crate_t*)entity_get_header(slot);
 	const vec3_t crate_pos = crate->entity_header.position;
 
-	// Register collision
-	aabb_t bounds = entity_get_models()->meshes[ENTITY_MESH_CRATE].bounds;
-	bounds.min.x *= COL_SCALE; bounds.min.y *= COL_SCALE; bounds.min.z *= COL_SCALE; 
-	bounds.max.x *= COL_SCALE; bounds.max.y *= COL_SCALE; bounds.max.z *= COL_SCALE; 
-	const aabb_t collision_box = {
-		.min = vec3_sub(crate_pos, bounds.max),
-		.max = vec3_sub(crate_pos, bounds.min)
-	};
-	const entity_collision_box_t box = {
-		.aabb = collision_box,
-		.box_index = 0,
-		.entity_index = slot,
-		.is_solid = 1,
-		.is_trigger = 0,
-	};
-	entity_register_collision_box(&box);
+	// Crates don't move, so the collision box only needs to be made once
+#ifndef _LEVEL_EDITOR
+	if (crate->entity_header.collision_boxes[0] == ENTITY_COLLISION_BOX_NONE)
+#endif
+	{
+		aabb_t bounds = entity_get_mesh(ENTITY_MESH_CRATE)->bounds;
+		bounds.min.x *= COL_SCALE; bounds.min.y *= COL_SCALE; bounds.min.z *= COL_SCALE; 
+		bounds.max.x *= COL_SCALE; bounds.max.y *= COL_SCALE; bounds.max.z *= COL_SCALE; 
+		const aabb_t collision_box = {
+			.min = vec3_sub(crate_pos, bounds.max),
+			.max = vec3_sub(crate_pos, bounds.min)
+		};
+		const entity_collision_box_t box = {
+			.aabb = collision_box,
+			.box_index = 0,
+			.entity_index = slot,
+			.is_solid = 1,
+			.is_trigger = 0,
+		};
+		entity_update_collision_box(slot, 0, &box);
+	}
 
 	// Render
 	transform_t render_transform;
@@ -51,13 +54,10 @@ void entity_crate_update(int slot, player_t* player, int dt) {
 	render_transform.scale.x = crate->entity_header.scale.x;
 	render_transform.scale.y = crate->entity_header.scale.x;
 	render_transform.scale.z = crate->entity_header.scale.x;
-#ifdef _LEVEL_EDITOR
-	renderer_set_drawing_entity_id(slot);
-#endif
 	if (crate->entity_header.mesh == NULL) {
-		crate->entity_header.mesh = model_find_mesh(entity_get_models(), "28_crate");
+		crate->entity_header.mesh = entity_get_mesh(ENTITY_MESH_CRATE);
 	}
-	renderer_draw_mesh_shaded(crate->entity_header.mesh, &render_transform, 0, 0, tex_entity_start);
+	entity_draw_mesh(slot, crate->entity_header.mesh, &render_transform);
 }
 
 void entity_crate_on_hit(int slot, int hitbox_index) {
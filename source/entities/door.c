@@ -22,44 +22,13 @@ entity_door_t* entity_door_new(void) {
 	return entity;
 }
 
-mesh_t* update_mesh(entity_door_t* door) {	
-	mesh_t* mesh;
-	if (door->is_rotated) {
-		if (door->is_big_door) {
-			if (door->is_locked) {
-				mesh = model_find_mesh(entity_get_models(), "05_door_big_locked_rotated");
-			}
-			else {
-				mesh = model_find_mesh(entity_get_models(), "07_door_big_unlocked_rotated");
-			}
-		}
-		else {
-			if (door->is_locked) {
-				mesh = model_find_mesh(entity_get_models(), "01_door_small_locked_rotated");
-			}
-			else {
-				mesh = model_find_mesh(entity_get_models(), "03_door_small_unlocked_rotated");
-			}
-		}
-	}
-	else {
-		if (door->is_big_door) {
-			if (door->is_locked) {
-				mesh = model_find_mesh(entity_get_models(), "04_door_big_locked");
-			}
-			else {
-				mesh = model_find_mesh(entity_get_models(), "06_door_big_unlocked");
-			}
-		}
-		else {
-			if (door->is_locked) {
-				mesh = model_find_mesh(entity_get_models(), "00_door_small_locked");
-			}
-			else {
-				mesh = model_find_mesh(entity_get_models(), "02_door_small_unlocked");
-			}
-		}
-	}
+mesh_t* update_mesh(entity_door_t* door) {
+	// The door meshes are ordered small/big, then locked/unlocked, then normal/rotated
+	int id = ENTITY_MESH_DOOR_SMALL_LOCKED;
+	if (door->is_big_door) id += 4;
+	if (!door->is_locked) id += 2;
+	if (door->is_rotated) id += 1;
+	mesh_t* mesh = entity_get_mesh((entity_mesh_id_t)id);
 	
 	PANIC_IF("Door entity could not find mesh!", mesh == NULL);
 	return mesh;
@@ -110,8 +79,16 @@ void entity_door_update(int slot, player_t* player, int dt) {
 	if (door->state_changed) door->entity_header.mesh = update_mesh(door);
 	if (!door->entity_header.mesh) door->entity_header.mesh = update_mesh(door);
 
-	// Add collision for the door
-	if (door->is_locked) {
+	// Locked doors are solid. Doors don't move, so the collision box only needs to be made once. In the level editor they do move, so it's remade every frame
+#ifndef _LEVEL_EDITOR
+	const int needs_box = door->entity_header.collision_boxes[0] == ENTITY_COLLISION_BOX_NONE;
+#else
+	const int needs_box = 1;
+#endif
+	if (!door->is_locked) {
+		entity_remove_collision_box(slot, 0);
+	}
+	else if (needs_box) {
 		aabb_t bounds = door->entity_header.mesh->bounds;
 		bounds.min.x *= COL_SCALE; bounds.min.y *= COL_SCALE; bounds.min.z *= COL_SCALE; 
 		bounds.max.x *= COL_SCALE; bounds.max.y *= COL_SCALE; bounds.max.z *= COL_SCALE; 
@@ -126,7 +103,7 @@ void entity_door_update(int slot, player_t* player, int dt) {
 			.is_solid = 1,
 			.is_trigger = 0,
 		};
-		entity_register_collision_box(&box);
+		entity_update_collision_box(slot, 0, &box);
 	}
 
 	door->state_changed = 0;
@@ -144,10 +121,7 @@ void entity_door_update(int slot, player_t* player, int dt) {
 	render_transform.scale.x = door->entity_header.scale.x;
 	render_transform.scale.y = door->entity_header.scale.x;
 	render_transform.scale.z = door->entity_header.scale.x;
-#ifdef _LEVEL_EDITOR
-	renderer_set_drawing_entity_id(slot);
-#endif
-	renderer_draw_mesh_shaded(door->entity_header.mesh, &render_transform, 0, 0, tex_entity_start);
+	entity_draw_mesh(slot, door->entity_header.mesh, &render_transform);
 }
 
 void entity_door_on_hit(int slot, int hitbox_index) {
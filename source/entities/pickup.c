@@ -1,5 +1,6 @@
 #include "pickup.h"
 
+#include "particle_systems.h"
 #include "music.h"
 
 entity_pickup_t* entity_pickup_new(void) {
@@ -13,34 +14,51 @@ entity_pickup_t* entity_pickup_new(void) {
     return entity;
 }
 
-void entity_pickup_update(int slot, player_t* player, int dt) {
+typedef struct {
+    vec3_t home_in_offset;
+    uint8_t close_enough_to_collect;
+} pickup_think_t;
+
+static pickup_think_t think_results[ENTITY_THINK_RESULT_COUNT];
+
+void entity_pickup_think(int slot, const player_t* player, int dt) {
 	entity_pickup_t* pickup = (entity_pickup_t*)entity_get_header(slot);
+	pickup_think_t* think = &think_results[ENTITY_THINK_RESULT_INDEX(slot)];
 	const vec3_t pickup_pos = pickup->entity_header.position;
 	const vec3_t player_pos = vec3_sub(player->position, (vec3_t){0, 200 * COL_SCALE, 0});
     vec3_t pickup_to_player = vec3_sub(player_pos, pickup_pos);
     const scalar_t distance_from_pickup_to_player_squared = vec3_magnitude_squared(pickup_to_player);
 	const int close_enough_to_home_in = (distance_from_pickup_to_player_squared < 2000 * ONE) && (distance_from_pickup_to_player_squared > 0);
-	const int close_enough_to_collect = (distance_from_pickup_to_player_squared < 200 * ONE) && (distance_from_pickup_to_player_squared > 0);
+	think->close_enough_to_collect = (distance_from_pickup_to_player_squared < 200 * ONE) && (distance_from_pickup_to_player_squared > 0);
 
     // Rendering
     if (pickup->entity_header.mesh == NULL) {
-        switch (pickup->type) {
-            case PICKUP_TYPE_AMMO_SMALL:   pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "08_pickup_ammo_small");   break;
-            case PICKUP_TYPE_AMMO_BIG:     pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "09_pickup_ammo_big");     break;
-            case PICKUP_TYPE_ARMOR_SMALL:  pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "10_pickup_armor_small");  break;
-            case PICKUP_TYPE_ARMOR_BIG:    pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "11_pickup_armor_big");    break;
-            case PICKUP_TYPE_HEALTH_SMALL: pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "12_pickup_health_small"); break;
-            case PICKUP_TYPE_HEALTH_BIG:   pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "13_pickup_health_big");   break;
-            case PICKUP_TYPE_KEY_BLUE:     pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "14_pickup_key_blue");     break;
-            case PICKUP_TYPE_KEY_YELLOW:   pickup->entity_header.mesh = model_find_mesh(entity_get_models(), "15_pickup_key_yellow");   break;
+        // The pickup meshes are in the same order as the pickup types
+        if (pickup->type > PICKUP_TYPE_NONE && pickup->type <= PICKUP_TYPE_INVINCIBILITY) {
+            pickup->entity_header.mesh = entity_get_mesh((entity_mesh_id_t)(ENTITY_MESH_PICKUP_AMMO_SMALL + pickup->type - PICKUP_TYPE_AMMO_SMALL));
         }
 
-    PANIC_IF("Pickup entity could not find mesh!", pickup->entity_header.mesh == NULL);
+        PANIC_IF("Pickup entity could not find mesh!", pickup->entity_header.mesh == NULL);
     }
 
     // Rotate
     pickup->entity_header.rotation.y += dt * 50;
 
+    // Homing in gets applied after rendering, in the update
+    think->home_in_offset = (vec3_t){0, 0, 0};
+    if (close_enough_to_home_in) {
+        pickup_to_player = vec3_normalize(pickup_to_player);
+        const scalar_t home_in_speed = 3 * ONE;
+        think->home_in_offset = vec3_muls(pickup_to_player, home_in_speed);
+    }
+}
+
+void entity_pickup_update(int slot, player_t* player, int dt) {
+    (void)dt;
+	entity_pickup_t* pickup = (entity_pickup_t*)entity_get_header(slot);
+	const pickup_think_t* think = &think_results[ENTITY_THINK_RESULT_INDEX(slot)];
+	const vec3_t pickup_pos = pickup->entity_header.position;
+
 	transform_t render_transform;
     render_transform.position.x = -pickup_pos.x / COL_SCALE;
     render_transform.position.y = -pickup_pos.y / COL_SCALE;
@@ -51,18 +69,11 @@ void entity_pickup_update(int slot, player_t* player, int dt) {
 	render_transform.scale.x = pickup->entity_header.scale.x;
 	render_transform.scale.y = pickup->entity_header.scale.x;
 	render_transform.scale.z = pickup->entity_header.scale.x;
-#ifdef _LEVEL_EDITOR
-	renderer_set_drawing_entity_id(slot);
-#endif
-	renderer_draw_mesh_shaded(pickup->entity_header.mesh, &render_transform, 0, 0, tex_entity_start);
+	entity_draw_mesh(slot, pickup->entity_header.mesh, &render_transform);
 
-    if (close_enough_to_home_in) {
-        pickup_to_player = vec3_normalize(pickup_to_player);
-        const scalar_t home_in_speed = 3 * ONE;
-        pickup->entity_header.position = vec3_add(pickup_pos, vec3_muls(pickup_to_player, home_in_speed));
-    }
+    pickup->entity_header.position = vec3_add(pickup_pos, think->home_in_offset);
 
-    if (close_enough_to_collect) {
+    if (think->close_enough_to_collect) {
         int sfx_to_play = sfx_generic;
         switch (pickup->type) {
             case PICKUP_TYPE_AMMO_SMALL:    sfx_to_play = sfx_ammo; player->ammo += 5; break;          
@@ -75,6 +86,7 @@ void entity_pickup_update(int slot, player_t* player, int dt) {
             case PICKUP_TYPE_KEY_YELLOW:    sfx_to_play = sfx_key; player->has_key_yellow = 1; break; 
         }
         audio_play_sound(sfx_to_play, 0, 0, (vec3_t){}, 1); 
+        particle_manager_spawn(&particle_system_pickup_collect, pickup->entity_header.position, PARTICLE_PRIORITY_LOW);
         entity_kill(slot);
     }
 }
@@ -6,7 +6,7 @@ entity_platform_t* entity_platform_new(void) {
 	entity->entity_header.position = (vec3_t){0, 0, 0};
 	entity->entity_header.rotation = (vec3_t){0, 0, 0};
 	entity->entity_header.scale = (vec3_t){ONE, ONE, ONE};
-	entity->entity_header.mesh = model_find_mesh(entity_get_models(), "29_platform_test_horizontal");
+	entity->entity_header.mesh = entity_get_mesh(ENTITY_MESH_PLATFORM_TEST_HORIZONTAL);
     entity->position_start = (vec3_t){0, 0, 0};;
     entity->position_end = (vec3_t){0, 0, 0};;
     entity->velocity = 512;
@@ -21,12 +21,14 @@ entity_platform_t* entity_platform_new(void) {
 	return entity;
 }
 
-void entity_platform_update(int slot, player_t* player, int dt) {
+// Collision and rendering use the position from before the movement
+static vec3_t think_start_positions[ENTITY_THINK_RESULT_COUNT];
+
+void entity_platform_think(int slot, const player_t* player, int dt) {
 	(void)player;
-	(void)dt;
 
 	entity_platform_t* platform = (entity_platform_t*)entity_get_header(slot);
-	const vec3_t platform_pos = platform->entity_header.position;
+	think_start_positions[ENTITY_THINK_RESULT_INDEX(slot)] = platform->entity_header.position;
 
 	// Move if signal is triggered
 	if (platform->listen_to_signal && platform->curr_timer_value <= 0) {
@@ -55,11 +57,19 @@ void entity_platform_update(int slot, player_t* player, int dt) {
 		}
 	}
 
-	// Make this platform solid based on the mesh bounding box
 	if (platform->entity_header.mesh == NULL) {
-		platform->entity_header.mesh = model_find_mesh(entity_get_models(), "29_platform_test_horizontal");
+		platform->entity_header.mesh = entity_get_mesh(ENTITY_MESH_PLATFORM_TEST_HORIZONTAL);
 	}
+}
+
+void entity_platform_update(int slot, player_t* player, int dt) {
+	(void)player;
+	(void)dt;
 
+	entity_platform_t* platform = (entity_platform_t*)entity_get_header(slot);
+	const vec3_t platform_pos = think_start_positions[ENTITY_THINK_RESULT_INDEX(slot)];
+
+	// Make this platform solid based on the mesh bounding box
 	const aabb_t mesh_bounds_translated = {
 		.min = {
 			platform_pos.x - (platform->entity_header.mesh->bounds.max.x * COL_SCALE),
@@ -80,7 +90,7 @@ void entity_platform_update(int slot, player_t* player, int dt) {
 		.is_solid = 1,
 		.is_trigger = 0,
 	};
-	entity_register_collision_box(&box);
+	entity_update_collision_box(slot, 0, &box);
 
 	// Render
 	transform_t render_transform;
@@ -93,10 +103,7 @@ void entity_platform_update(int slot, player_t* player, int dt) {
 	render_transform.scale.x = platform->entity_header.scale.x;
 	render_transform.scale.y = platform->entity_header.scale.x;
 	render_transform.scale.z = platform->entity_header.scale.x;
-#ifdef _LEVEL_EDITOR
-	renderer_set_drawing_entity_id(slot);
-#endif
-	renderer_draw_mesh_shaded(platform->entity_header.mesh, &render_transform, 0, 0, tex_entity_start);
+	entity_draw_mesh(slot, platform->entity_header.mesh, &render_transform);
 }
 
 void entity_platform_on_hit(int slot, int hitbox_index) {
@@ -21,21 +21,32 @@ void entity_trigger_update(int slot, player_t* player, int dt) {
     (void)player;
     entity_trigger_t* trigger = (entity_trigger_t*)entity_get_header(slot);
 
+    // Busy triggers can't be intersected
+    if (trigger->is_busy) {
+        entity_remove_collision_box(slot, 0);
+    }
+
     if (!trigger->is_busy) {
-        const vec3_t trigger_pos = trigger->entity_header.position;
-        const vec3_t trigger_scale_half = vec3_muls(trigger->entity_header.scale, ONE/2);
-
-        const entity_collision_box_t box = {
-            .aabb = {
-                .min = vec3_sub(trigger_pos, trigger_scale_half),
-                .max = vec3_add(trigger_pos, trigger_scale_half),
-            },
-            .box_index = 0,
-            .entity_index = slot,
-            .is_solid = 0,
-            .is_trigger = 1,
-        };
-        entity_register_collision_box(&box);
+        // Triggers don't move, so the collision box only needs to be made once
+#ifndef _LEVEL_EDITOR
+        if (trigger->entity_header.collision_boxes[0] == ENTITY_COLLISION_BOX_NONE)
+#endif
+        {
+            const vec3_t trigger_pos = trigger->entity_header.position;
+            const vec3_t trigger_scale_half = vec3_muls(trigger->entity_header.scale, ONE/2);
+
+            const entity_collision_box_t box = {
+                .aabb = {
+                    .min = vec3_sub(trigger_pos, trigger_scale_half),
+                    .max = vec3_add(trigger_pos, trigger_scale_half),
+                },
+                .box_index = 0,
+                .entity_index = slot,
+                .is_solid = 0,
+                .is_trigger = 1,
+            };
+            entity_update_collision_box(slot, 0, &box);
+        }
 
         if (trigger->intersecting_curr && !trigger->intersecting_prev) {
             trigger->is_busy = 1;
@@ -6,27 +6,251 @@
 #include "entities/chaser.h"
 #include "entities/crate.h"
 #include "entities/door.h"
+#include "renderer.h"
+#include "frustum.h"
 #include "mesh.h"
 #include "main.h"
 
+#ifdef _PC
+#include "pc/jobs.h"
+#endif
+
+#include <stdlib.h>
 #include <string.h>
 extern state_vars_t state;
 
-entity_collision_box_t entity_aabb_queue[ENTITY_AABB_QUEUE_LENGTH];
+entity_collision_box_t entity_aabb_queue[ENTITY_AABB_QUEUE_LENGTH]; // Live boxes, packed
+int16_t entity_aabb_handle_to_index[ENTITY_AABB_QUEUE_LENGTH];
+int16_t entity_aabb_index_to_handle[ENTITY_AABB_QUEUE_LENGTH];
+int16_t entity_aabb_free_handles[ENTITY_AABB_QUEUE_LENGTH];
+size_t entity_n_free_aabb_handles = 0;
+int16_t entity_aabb_dirty_handles[ENTITY_AABB_QUEUE_LENGTH];
+size_t entity_n_dirty_aabb = 0;
 uint8_t entity_types[ENTITY_LIST_LENGTH];
 uint8_t* entity_pool = NULL;
 size_t entity_pool_stride = 0;
 size_t entity_n_active_aabb = 0;
 model_t* entity_models = NULL;
+static mesh_t* entity_meshes[N_ENTITY_MESH_IDS];
+
+// The level section each entity is in, found again whenever the mesh or transform it's drawn with changes
+static uint16_t entity_sections[ENTITY_LIST_LENGTH];
+static transform_t entity_section_transforms[ENTITY_LIST_LENGTH];
+static const mesh_t* entity_section_meshes[ENTITY_LIST_LENGTH];
+static uint8_t entity_section_facing_camera[ENTITY_LIST_LENGTH];
+static const model_t* entity_level_model = NULL;
+static transform_t entity_level_transform;
+
+#ifdef _DEBUG
+static const char* entity_mesh_names[N_ENTITY_MESH_IDS] = {
+	"00_door_small_locked",
+	"01_door_small_locked_rotated",
+	"02_door_small_unlocked",
+	"03_door_small_unlocked_rotated",
+	"04_door_big_locked",
+	"05_door_big_locked_rotated",
+	"06_door_big_unlocked",
+	"07_door_big_unlocked_rotated",
+	"08_pickup_ammo_small",
+	"09_pickup_ammo_big",
+	"10_pickup_armor_small",
+	"11_pickup_armor_big",
+	"12_pickup_health_small",
+	"13_pickup_health_big",
+	"14_pickup_key_blue",
+	"15_pickup_key_yellow",
+	"16_pickup_damage",
+	"17_pickup_fire_rate",
+	"18_pickup_invincibility",
+	"19_enemy_chaser_idle",
+	"20_enemy_chaser_aim",
+	"21_enemy_chaser_head_broken",
+	"22_enemy_chaser_head_normal",
+	"23_enemy_chaser_body",
+	"24_enemy_chaser_arm",
+	"25_enemy_chaser_bottom1",
+	"26_enemy_chaser_bottom2",
+	"27_enemy_chaser_gun",
+	"28_crate",
+	"29_platform_test_horizontal",
+};
+#endif
 int n_entity_textures = 0;
 int entity_signals[ENTITY_SIGNAL_COUNT];
+uint8_t entity_has_thought[ENTITY_LIST_LENGTH];
+
+void entity_think(int slot, const player_t* player, int dt) {
+	switch (entity_types[slot]) {
+		case ENTITY_PICKUP: entity_pickup_think(slot, player, dt); break;
+		case ENTITY_CHASER: entity_chaser_think(slot, player, dt); break;
+		case ENTITY_PLATFORM: entity_platform_think(slot, player, dt); break;
+	}
+}
+
+#ifdef _PC
+#define ENTITY_SLOTS_PER_JOB 16
+
+typedef struct {
+	const player_t* player;
+	int dt;
+} entity_think_job_t;
+
+static void entity_think_job(int job_index, void* user_data) {
+	const entity_think_job_t* job = (const entity_think_job_t*)user_data;
+	const int first = job_index * ENTITY_SLOTS_PER_JOB;
+
+	for (int i = first; i < first + ENTITY_SLOTS_PER_JOB; ++i) {
+		// Platforms listening to a signal have to see what triggers in earlier slots send this frame, so they think during the update loop
+		if (entity_types[i] == ENTITY_PLATFORM && ((entity_platform_t*)entity_get_header(i))->listen_to_signal) continue;
+
+		entity_think(i, job->player, job->dt);
+		entity_has_thought[i] = 1;
+	}
+}
+#endif
+
+#if defined(_PC) && !defined(_LEVEL_EDITOR)
+// Entity meshes get queued during the update loop, then every copy of the same mesh is drawn with one instanced draw
+typedef struct {
+	const mesh_t* mesh;
+	transform_t transform;
+} entity_mesh_draw_t;
+static entity_mesh_draw_t entity_mesh_draws[ENTITY_LIST_LENGTH];
+static transform_t entity_mesh_draw_transforms[ENTITY_LIST_LENGTH];
+static int entity_n_mesh_draws = 0;
+
+static int entity_compare_mesh_draws(const void* a, const void* b) {
+	const uintptr_t mesh_a = (uintptr_t)((const entity_mesh_draw_t*)a)->mesh;
+	const uintptr_t mesh_b = (uintptr_t)((const entity_mesh_draw_t*)b)->mesh;
+	return (mesh_a > mesh_b) - (mesh_a < mesh_b);
+}
+
+static void entity_draw_queued_meshes(void) {
+	qsort(entity_mesh_draws, entity_n_mesh_draws, sizeof(entity_mesh_draw_t), entity_compare_mesh_draws);
+
+	int start = 0;
+	while (start < entity_n_mesh_draws) {
+		const mesh_t* mesh = entity_mesh_draws[start].mesh;
+		int end = start;
+		while (end < entity_n_mesh_draws && entity_mesh_draws[end].mesh == mesh) {
+			entity_mesh_draw_transforms[end - start] = entity_mesh_draws[end].transform;
+			++end;
+		}
+		renderer_draw_mesh_instanced(mesh, entity_mesh_draw_transforms, end - start, tex_entity_start);
+		start = end;
+	}
+	entity_n_mesh_draws = 0;
+}
+#endif
+
+// World space box around the mesh. Rotated and camera facing meshes get a box that fits them in every orientation
+static void entity_get_world_box(const aabb_t* bounds, const transform_t* transform, const int facing_camera, int64_t* box_min, int64_t* box_max) {
+	const int rotated = facing_camera || transform->rotation.x != 0 || transform->rotation.y != 0 || transform->rotation.z != 0;
+	if (!rotated) {
+		frustum_world_box(bounds, transform, box_min, box_max);
+		return;
+	}
+
+	const int64_t radius = frustum_bounding_radius(bounds, &transform->scale);
+	const scalar_t positions[3] = { transform->position.x, transform->position.y, transform->position.z };
+	for (int axis = 0; axis < 3; ++axis) {
+		box_min[axis] = positions[axis] - radius;
+		box_max[axis] = positions[axis] + radius;
+	}
+}
+
+// Returns the size of the section if the box fits inside it completely, or -1 if it doesn't
+static int64_t entity_fits_in_section(const int64_t* box_min, const int64_t* box_max, const uint16_t section) {
+	int64_t section_min[3];
+	int64_t section_max[3];
+	entity_get_world_box(&entity_level_model->meshes[section].bounds, &entity_level_transform, 0, section_min, section_max);
+	int64_t size = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (box_min[axis] < section_min[axis] || box_max[axis] > section_max[axis]) return -1;
+		size += section_max[axis] - section_min[axis];
+	}
+	return size;
+}
+
+void entity_set_level_sections(const model_t* level_model, const transform_t* level_transform) {
+	entity_level_model = level_model;
+	if (level_transform) entity_level_transform = *level_transform;
+	for (int i = 0; i < ENTITY_LIST_LENGTH; ++i) entity_sections[i] = ENTITY_SECTION_UNKNOWN;
+}
+
+uint16_t entity_get_section(int slot) {
+	return entity_sections[slot];
+}
+
+int entity_in_visible_section(int slot, const mesh_t* mesh, const transform_t* transform, const int facing_camera) {
+	if (entity_level_model == NULL || mesh == NULL) return 1;
+
+	// Rotation and scale change the world box too, and so does drawing a different mesh from the same slot
+	uint16_t* section = &entity_sections[slot];
+	const int changed = *section == ENTITY_SECTION_UNKNOWN || entity_section_meshes[slot] != mesh || entity_section_facing_camera[slot] != (facing_camera != 0) || memcmp(&entity_section_transforms[slot], transform, sizeof(transform_t)) != 0;
+	if (changed) {
+		int64_t box_min[3];
+		int64_t box_max[3];
+		entity_get_world_box(&mesh->bounds, transform, facing_camera, box_min, box_max);
+
+		// Most of the time it's still in the same section. If not, the smallest section it fits in is the most specific one
+		if (*section >= entity_level_model->n_meshes || entity_fits_in_section(box_min, box_max, *section) < 0) {
+			*section = ENTITY_NOT_SECTION_BOUND;
+			int64_t best_size = -1;
+			const uint16_t n_sections = (entity_level_model->n_meshes < VISLIST_MAX_SECTIONS) ? (uint16_t)entity_level_model->n_meshes : VISLIST_MAX_SECTIONS;
+			for (uint16_t i = 0; i < n_sections; ++i) {
+				const int64_t size = entity_fits_in_section(box_min, box_max, i);
+				if (size >= 0 && (best_size < 0 || size < best_size)) {
+					best_size = size;
+					*section = i;
+				}
+			}
+		}
+		entity_section_transforms[slot] = *transform;
+		entity_section_meshes[slot] = mesh;
+		entity_section_facing_camera[slot] = (uint8_t)(facing_camera != 0);
+	}
+
+	if (*section == ENTITY_NOT_SECTION_BOUND || renderer_section_visible(*section)) return 1;
+	++renderer_stats.n_entity_meshes_hidden;
+	return 0;
+}
+
+void entity_draw_mesh(int slot, const mesh_t* mesh, const transform_t* transform) {
+	if (!entity_in_visible_section(slot, mesh, transform, 0)) return;
+
+#if defined(_PC) && !defined(_LEVEL_EDITOR)
+	if (entity_n_mesh_draws < ENTITY_LIST_LENGTH) {
+		entity_mesh_draws[entity_n_mesh_draws].mesh = mesh;
+		entity_mesh_draws[entity_n_mesh_draws].transform = *transform;
+		++entity_n_mesh_draws;
+		return;
+	}
+#elif defined(_LEVEL_EDITOR)
+	// The level editor picks entities by their stencil value, so each one needs its own draw
+	renderer_set_drawing_entity_id(slot);
+#endif
+	renderer_draw_mesh_shaded(mesh, transform, 0, 0, tex_entity_start);
+}
 
 void entity_update_all(player_t* player, int dt) {
 	// Reset counters
-	entity_n_active_aabb = 0;
+	entity_n_dirty_aabb = 0;
+
+#ifdef _PC
+	// Thinking only touches the entity itself, so it can run on all cores. Anything that writes shared state 
+	// (the player, collision boxes, signals, rendering, audio) stays in the update loop below, which still runs in slot order
+	const entity_think_job_t think_job = { .player = player, .dt = dt };
+	collision_set_stats_enabled(0);
+	job_system_run(entity_think_job, (void*)&think_job, ENTITY_LIST_LENGTH / ENTITY_SLOTS_PER_JOB);
+	collision_set_stats_enabled(1);
+#endif
 
 	// Update all entities
 	for (int i = 0; i < ENTITY_LIST_LENGTH; ++i) {
+		if (!entity_has_thought[i]) entity_think(i, player, dt);
+		entity_has_thought[i] = 0;
+
 		switch (entity_types[i]) {
 			case ENTITY_NONE: break;
 			case ENTITY_DOOR: entity_door_update(i, player, dt); break;
@@ -37,6 +261,10 @@ void entity_update_all(player_t* player, int dt) {
 			case ENTITY_TRIGGER: entity_trigger_update(i, player, dt); break;
 		}
 	}
+
+#if defined(_PC) && !defined(_LEVEL_EDITOR)
+	entity_draw_queued_meshes();
+#endif
 }
 
 int entity_alloc(uint8_t entity_type) {
@@ -45,6 +273,9 @@ int entity_alloc(uint8_t entity_type) {
 		if (entity_types[i] == ENTITY_NONE) {
 			// Register the entity
 			entity_types[i] = entity_type;
+			entity_sections[i] = ENTITY_SECTION_UNKNOWN;
+			entity_header_t* header = entity_get_header(i);
+			for (int box = 0; box < ENTITY_MAX_COLLISION_BOXES; ++box) header->collision_boxes[box] = ENTITY_COLLISION_BOX_NONE;
 			return i;
 		}
 	}
@@ -64,15 +295,50 @@ typedef struct {
 	};
 } entity_union;
 
+// Mesh names start with their entity_mesh_id_t, so the table can be filled in without comparing names.
+// The order of the meshes in the file doesn't matter
+static void entity_resolve_meshes(void) {
+	memset(entity_meshes, 0, sizeof(entity_meshes));
+	for (size_t i = 0; i < entity_models->n_meshes; ++i) {
+		mesh_t* mesh = &entity_models->meshes[i];
+		const char* name = mesh->name;
+		if (name[0] < '0' || name[0] > '9' || name[1] < '0' || name[1] > '9') continue;
+		const int id = (name[0] - '0') * 10 + (name[1] - '0');
+		if (id >= N_ENTITY_MESH_IDS) continue;
+		entity_meshes[id] = mesh;
+	}
+
+	for (int id = 0; id < N_ENTITY_MESH_IDS; ++id) {
+		if (entity_meshes[id] == NULL) {
+			printf("[ERROR] Entity mesh %02i is missing from models/entity.msh!\n", id);
+		}
+#ifdef _DEBUG
+		else if (strcmp(entity_meshes[id]->name, entity_mesh_names[id]) != 0) {
+			printf("[ERROR] Entity mesh %02i is called '%s', expected '%s'!\n", id, entity_meshes[id]->name, entity_mesh_names[id]);
+			entity_meshes[id] = NULL;
+		}
+#endif
+	}
+}
+
 void entity_init(void) {
 	// Zero initialize the entity list
 	for (int i = 0; i < ENTITY_LIST_LENGTH; ++i) entity_types[i] = ENTITY_NONE;
+	entity_set_level_sections(NULL, NULL);
 
+	// All collision box handles are free
 	entity_n_active_aabb = 0;
+	entity_n_dirty_aabb = 0;
+	entity_n_free_aabb_handles = ENTITY_AABB_QUEUE_LENGTH;
+	for (int i = 0; i < ENTITY_AABB_QUEUE_LENGTH; ++i) {
+		entity_aabb_free_handles[i] = ENTITY_AABB_QUEUE_LENGTH - 1 - i;
+		entity_aabb_handle_to_index[i] = -1;
+	}
 
 	// Allocate entity pool
 	entity_pool_stride = sizeof(entity_union);
 	entity_pool = mem_stack_alloc(ENTITY_LIST_LENGTH * sizeof(entity_union), STACK_ENTITY);
+	entity_sanitize();
 
     // Load entity textures
 	texture_cpu_t *entity_textures;
@@ -85,21 +351,93 @@ void entity_init(void) {
 	mem_stack_release(STACK_TEMP);
 
 	// Load model collection
-#ifdef _LEVEL_EDITOR
-	if (entity_models) {
-		for (uint32_t i = 0; i < entity_models->n_meshes; ++i) {
-			mem_free(entity_models->meshes[i].vertices);
-		}
-	}
-#endif
 	entity_models = model_load("models/entity.msh", 1, STACK_ENTITY, tex_entity_start, 0);
 	mem_stack_release(STACK_TEMP);
+	entity_resolve_meshes();
 
 	memset(entity_signals, 0, sizeof(entity_signals));
 }
 
-void entity_register_collision_box(const entity_collision_box_t* box) {
-	memcpy(&entity_aabb_queue[entity_n_active_aabb++], box, sizeof(entity_collision_box_t));
+static void mark_collision_box_dirty(int handle) {
+	for (size_t i = 0; i < entity_n_dirty_aabb; ++i) {
+		if (entity_aabb_dirty_handles[i] == handle) return;
+	}
+	entity_aabb_dirty_handles[entity_n_dirty_aabb++] = (int16_t)handle;
+}
+
+int entity_collision_box_create(const entity_collision_box_t* box) {
+	if (entity_n_free_aabb_handles == 0) {
+		WARN_IF("out of entity collision boxes", 1);
+		return ENTITY_COLLISION_BOX_NONE;
+	}
+
+	const int handle = entity_aabb_free_handles[--entity_n_free_aabb_handles];
+	const int index = (int)entity_n_active_aabb++;
+	memcpy(&entity_aabb_queue[index], box, sizeof(entity_collision_box_t));
+	entity_aabb_handle_to_index[handle] = (int16_t)index;
+	entity_aabb_index_to_handle[index] = (int16_t)handle;
+	mark_collision_box_dirty(handle);
+	return handle;
+}
+
+void entity_collision_box_move(int handle, const aabb_t* aabb) {
+#ifdef _DEBUG
+	PANIC_IF("handle out of bounds", handle < 0 || handle >= ENTITY_AABB_QUEUE_LENGTH);
+	PANIC_IF("collision box was already destroyed", entity_aabb_handle_to_index[handle] < 0);
+#endif
+	entity_collision_box_t* box = &entity_aabb_queue[entity_aabb_handle_to_index[handle]];
+	if (memcmp(&box->aabb, aabb, sizeof(aabb_t)) == 0) return;
+	box->aabb = *aabb;
+	mark_collision_box_dirty(handle);
+}
+
+void entity_collision_box_destroy(int handle) {
+	if (handle == ENTITY_COLLISION_BOX_NONE) return;
+#ifdef _DEBUG
+	PANIC_IF("handle out of bounds", handle < 0 || handle >= ENTITY_AABB_QUEUE_LENGTH);
+	PANIC_IF("collision box was already destroyed", entity_aabb_handle_to_index[handle] < 0);
+#endif
+
+	// Keep the live boxes packed by moving the last one into the gap
+	const int index = entity_aabb_handle_to_index[handle];
+	const int last = (int)--entity_n_active_aabb;
+	if (index != last) {
+		entity_aabb_queue[index] = entity_aabb_queue[last];
+		entity_aabb_index_to_handle[index] = entity_aabb_index_to_handle[last];
+		entity_aabb_handle_to_index[entity_aabb_index_to_handle[index]] = (int16_t)index;
+	}
+	entity_aabb_handle_to_index[handle] = -1;
+	entity_aabb_free_handles[entity_n_free_aabb_handles++] = (int16_t)handle;
+
+	// A destroyed box can't be dirty
+	for (size_t i = 0; i < entity_n_dirty_aabb; ++i) {
+		if (entity_aabb_dirty_handles[i] == handle) {
+			entity_aabb_dirty_handles[i] = entity_aabb_dirty_handles[--entity_n_dirty_aabb];
+			break;
+		}
+	}
+}
+
+void entity_update_collision_box(int slot, int box_index, const entity_collision_box_t* box) {
+	entity_header_t* header = entity_get_header(slot);
+	if (header->collision_boxes[box_index] == ENTITY_COLLISION_BOX_NONE) {
+		header->collision_boxes[box_index] = (int16_t)entity_collision_box_create(box);
+	}
+	else {
+		entity_collision_box_move(header->collision_boxes[box_index], &box->aabb);
+	}
+}
+
+void entity_remove_collision_box(int slot, int box_index) {
+	entity_header_t* header = entity_get_header(slot);
+	entity_collision_box_destroy(header->collision_boxes[box_index]);
+	header->collision_boxes[box_index] = ENTITY_COLLISION_BOX_NONE;
+}
+
+static void destroy_collision_boxes(int slot) {
+	for (int i = 0; i < ENTITY_MAX_COLLISION_BOXES; ++i) {
+		entity_remove_collision_box(slot, i);
+	}
 }
 
 void entity_defragment(void) {
@@ -123,7 +461,16 @@ void entity_defragment(void) {
 			pool[start] = pool[end];
 			pool[end] = temp;
 		}
+
+		// The collision boxes moved along with the entity
+		const entity_header_t* header = entity_get_header(start);
+		for (int i = 0; i < ENTITY_MAX_COLLISION_BOXES; ++i) {
+			if (header->collision_boxes[i] == ENTITY_COLLISION_BOX_NONE) continue;
+			entity_get_collision_box(header->collision_boxes[i])->entity_index = (uint8_t)start;
+		}
 	}
+
+	for (int i = 0; i < ENTITY_LIST_LENGTH; ++i) entity_sections[i] = ENTITY_SECTION_UNKNOWN;
 }
 
 // Sets the mesh pointer, which is only valid for the runtime of this program, to null. 
@@ -131,12 +478,15 @@ void entity_defragment(void) {
 void entity_sanitize(void) {
 	entity_union* pool = (entity_union*)entity_pool;
 	for (int i = 0; i < ENTITY_LIST_LENGTH; ++i) {
+		entity_sections[i] = ENTITY_SECTION_UNKNOWN;
 		pool[i].header.mesh = NULL;
+		for (int box = 0; box < ENTITY_MAX_COLLISION_BOXES; ++box) pool[i].header.collision_boxes[box] = ENTITY_COLLISION_BOX_NONE;
 	}
 }
 
 void entity_kill(int slot) {
 	// todo: maybe support destructors?
+	destroy_collision_boxes(slot);
 	entity_types[slot] = ENTITY_NONE;
 }
 
@@ -167,10 +517,16 @@ model_t* entity_get_models(void) {
 	return entity_models;
 }
 
+mesh_t* entity_get_mesh(entity_mesh_id_t id) {
+	return entity_meshes[id];
+}
+
 void entity_set_type(int index, uint8_t type) {
 #ifdef _DEBUG
 	PANIC_IF("index out of bounds", index < 0 || index >= ENTITY_LIST_LENGTH);
 #endif
+	// The boxes belong to the old type
+	if (entity_types[index] != ENTITY_NONE) destroy_collision_boxes(index);
 	entity_types[index] = type;
 }
 
@@ -200,6 +556,7 @@ void entity_deserialize_and_write_slot(int slot, const entity_header_serialized_
 	dst_entity_header->rotation = header->rotation;
 	dst_entity_header->scale = header->scale;
 	dst_entity_header->mesh = NULL;
+	for (int i = 0; i < ENTITY_MAX_COLLISION_BOXES; ++i) dst_entity_header->collision_boxes[i] = ENTITY_COLLISION_BOX_NONE;
 
 	// Copy entity data - we just need to copy everything after the header, so subtract the header size
 	memcpy(dst_entity_data, src_entity_data, entity_pool_stride - sizeof(entity_header_t));
@@ -220,6 +577,25 @@ entity_collision_box_t* entity_get_aabb_queue_entry(int index) {
 	return &entity_aabb_queue[index];
 }
 
+size_t entity_get_n_dirty_aabb(void) {
+	return entity_n_dirty_aabb;
+}
+
+int entity_get_dirty_aabb_handle(int index) {
+#ifdef _DEBUG
+	PANIC_IF("index out of bounds", index < 0 || index >= (int)entity_n_dirty_aabb);
+#endif
+	return entity_aabb_dirty_handles[index];
+}
+
+entity_collision_box_t* entity_get_collision_box(int handle) {
+#ifdef _DEBUG
+	PANIC_IF("handle out of bounds", handle < 0 || handle >= ENTITY_AABB_QUEUE_LENGTH);
+	PANIC_IF("collision box was already destroyed", entity_aabb_handle_to_index[handle] < 0);
+#endif
+	return &entity_aabb_queue[entity_aabb_handle_to_index[handle]];
+}
+
 int entity_get_signal(int index) {
 #ifdef _DEBUG
 	PANIC_IF("index out of bounds", index < 0 || index >= ENTITY_SIGNAL_COUNT);
@@ -10,10 +10,23 @@
 extern "C" {
 #endif
 
-#define ENTITY_NOT_SECTION_BOUND 255
+#define ENTITY_NOT_SECTION_BOUND 0xFFFF // Not completely inside any level section, so always drawn
+#define ENTITY_SECTION_UNKNOWN 0xFFFE
 #define ENTITY_AABB_QUEUE_LENGTH 256
 #define ENTITY_LIST_LENGTH 256
 #define ENTITY_SIGNAL_COUNT 64
+#define ENTITY_MAX_COLLISION_BOXES 2
+#define ENTITY_COLLISION_BOX_NONE -1
+
+// On PC, entities think in parallel ahead of the update loop, so every slot needs its own think result.
+// Everywhere else an entity thinks right before it updates, so one shared result is enough
+#ifdef _PC
+#define ENTITY_THINK_RESULT_COUNT ENTITY_LIST_LENGTH
+#define ENTITY_THINK_RESULT_INDEX(slot) (slot)
+#else
+#define ENTITY_THINK_RESULT_COUNT 1
+#define ENTITY_THINK_RESULT_INDEX(slot) 0
+#endif
 
 typedef enum {
 	ENTITY_NONE,
@@ -65,6 +78,7 @@ typedef struct {
 	vec3_t rotation;
 	vec3_t scale;
 	mesh_t* mesh;
+	int16_t collision_boxes[ENTITY_MAX_COLLISION_BOXES]; // Handles, owned by the entity. Not serialized
 } entity_header_t;
 
 typedef struct {
@@ -86,18 +100,31 @@ void entity_init(void);
 int entity_alloc(uint8_t entity_type);
 void entity_set_type(int index, uint8_t type);
 void entity_deserialize_and_write_slot(int slot, const entity_header_serialized_t* header);
-void entity_register_collision_box(const entity_collision_box_t* box); // (*box) gets copied, can safely be freed after calling this function
+int entity_collision_box_create(const entity_collision_box_t* box); // (*box) gets copied. Returns a handle, or ENTITY_COLLISION_BOX_NONE if there's no room
+void entity_collision_box_move(int handle, const aabb_t* aabb); // Only marks the box dirty if the bounds actually changed
+void entity_collision_box_destroy(int handle);
+void entity_update_collision_box(int slot, int box_index, const entity_collision_box_t* box); // Creates the entity's box on first use, moves it after that
+void entity_remove_collision_box(int slot, int box_index);
 void entity_defragment(void);
 void entity_sanitize(void);
-void entity_update_all(player_t* player, int dt);
+void entity_update_all(player_t* player, int dt); // Think phase (parallel on PC), followed by the update of every entity in slot order
+void entity_think(int slot, const player_t* player, int dt); // Only reads shared state and only writes to the entity itself
+void entity_draw_mesh(int slot, const mesh_t* mesh, const transform_t* transform); // On PC the draw happens at the end of entity_update_all(), together with every other entity using the same mesh. Skipped if the entity's level section wasn't drawn this frame
+void entity_set_level_sections(const model_t* level_model, const transform_t* level_transform); // Entities are sorted into the sections of this model. NULL means every entity is always drawn
+int entity_in_visible_section(int slot, const mesh_t* mesh, const transform_t* transform, int facing_camera); // Pass the same facing_camera as the draw call. Finds the entity's section again if its mesh, transform or facing_camera changed. Returns 0 if that section wasn't drawn this frame
+uint16_t entity_get_section(int slot); // ENTITY_NOT_SECTION_BOUND or ENTITY_SECTION_UNKNOWN if it doesn't have one
 void entity_kill(int slot);
 void entity_send_player_intersect(int slot, player_t* player);
 uint8_t entity_get_type(int index);
 entity_header_t* entity_get_header(int index);
 model_t* entity_get_models(void);
+mesh_t* entity_get_mesh(entity_mesh_id_t id); // Resolved once when the entity models are loaded, NULL if the mesh is missing
 size_t entity_get_pool_stride(void);
 size_t entity_get_n_active_aabb(void);
-entity_collision_box_t* entity_get_aabb_queue_entry(int index);
+entity_collision_box_t* entity_get_aabb_queue_entry(int index); // Live boxes are packed, so indices change when boxes get destroyed. Use handles to hold on to a box
+size_t entity_get_n_dirty_aabb(void); // Boxes created or moved since the start of the last entity_update_all()
+int entity_get_dirty_aabb_handle(int index);
+entity_collision_box_t* entity_get_collision_box(int handle);
 int entity_get_signal(int index);
 void entity_set_signal(int index, int value);
 
@@ -0,0 +1,203 @@
+#include "frustum.h"
+
+#ifdef _PSX
+#include <psxgte.h>
+#endif
+
+#ifdef _PC
+#include "pc/psx.h"
+#endif
+
+#ifdef _NDS
+#include "nds/psx.h"
+#endif
+
+static void frustum_add_plane(frustum_t* frustum, const vec3_t normal, const scalar_t normal_length, const int32_t offset) {
+    frustum->normal[frustum->n_planes] = normal;
+    frustum->normal_length[frustum->n_planes] = normal_length;
+    frustum->offset[frustum->n_planes] = offset;
+    ++frustum->n_planes;
+}
+
+static vec3_t frustum_side_normal(const vec3_t axis, const vec3_t forward, const scalar_t tan_half_fov) {
+    return (vec3_t){
+        axis.x + scalar_mul(forward.x, tan_half_fov),
+        axis.y + scalar_mul(forward.y, tan_half_fov),
+        axis.z + scalar_mul(forward.z, tan_half_fov),
+    };
+}
+
+static int64_t frustum_extent(const int64_t min, const int64_t max) {
+    const int64_t abs_min = (min < 0) ? -min : min;
+    const int64_t abs_max = (max < 0) ? -max : max;
+    return (abs_min > abs_max) ? abs_min : abs_max;
+}
+
+frustum_t frustum_from_camera(const transform_t* camera_transform, const scalar_t tan_half_fov_x, const scalar_t tan_half_fov_y, const int32_t far_distance) {
+    frustum_t frustum;
+    frustum.n_planes = 0;
+    frustum.position.x = camera_transform->position.x >> 12;
+    frustum.position.y = camera_transform->position.y >> 12;
+    frustum.position.z = camera_transform->position.z >> 12;
+
+    // Build the camera rotation the same way the PC renderer builds its view matrix: X, then 180 - Y, then Z + 180
+    const scalar_t cos_x = hicos(camera_transform->rotation.x);
+    const scalar_t sin_x = hisin(camera_transform->rotation.x);
+    const scalar_t cos_y = -hicos(camera_transform->rotation.y);
+    const scalar_t sin_y = hisin(camera_transform->rotation.y);
+    const scalar_t cos_z = -hicos(camera_transform->rotation.z);
+    const scalar_t sin_z = -hisin(camera_transform->rotation.z);
+    const vec3_t xy_row_0 = { cos_y, 0, sin_y };
+    const vec3_t xy_row_1 = { scalar_mul(sin_x, sin_y), cos_x, -scalar_mul(sin_x, cos_y) };
+    const vec3_t xy_row_2 = { -scalar_mul(cos_x, sin_y), sin_x, scalar_mul(cos_x, cos_y) };
+
+    // The rows of the rotation matrix are the camera axes in world space. The camera looks down the negative Z axis
+    const vec3_t right = { scalar_mul(xy_row_0.x, cos_z) + scalar_mul(xy_row_0.y, sin_z), scalar_mul(xy_row_0.y, cos_z) - scalar_mul(xy_row_0.x, sin_z), xy_row_0.z };
+    const vec3_t up = { scalar_mul(xy_row_1.x, cos_z) + scalar_mul(xy_row_1.y, sin_z), scalar_mul(xy_row_1.y, cos_z) - scalar_mul(xy_row_1.x, sin_z), xy_row_1.z };
+    const vec3_t back = { scalar_mul(xy_row_2.x, cos_z) + scalar_mul(xy_row_2.y, sin_z), scalar_mul(xy_row_2.y, cos_z) - scalar_mul(xy_row_2.x, sin_z), xy_row_2.z };
+    const vec3_t forward = { -back.x, -back.y, -back.z };
+    const vec3_t left = { -right.x, -right.y, -right.z };
+    const vec3_t down = { -up.x, -up.y, -up.z };
+
+    // Side planes go through the camera position, so their normals don't need to be normalized
+    const scalar_t side_length_x = scalar_sqrt(ONE + scalar_mul(tan_half_fov_x, tan_half_fov_x));
+    const scalar_t side_length_y = scalar_sqrt(ONE + scalar_mul(tan_half_fov_y, tan_half_fov_y));
+    frustum_add_plane(&frustum, frustum_side_normal(right, forward, tan_half_fov_x), side_length_x, 0);
+    frustum_add_plane(&frustum, frustum_side_normal(left, forward, tan_half_fov_x), side_length_x, 0);
+    frustum_add_plane(&frustum, frustum_side_normal(up, forward, tan_half_fov_y), side_length_y, 0);
+    frustum_add_plane(&frustum, frustum_side_normal(down, forward, tan_half_fov_y), side_length_y, 0);
+    frustum_add_plane(&frustum, forward, ONE, 0);
+    if (far_distance > 0) {
+        frustum_add_plane(&frustum, back, ONE, -far_distance);
+    }
+
+    return frustum;
+}
+
+void frustum_world_box(const aabb_t* bounds, const transform_t* model_transform, int64_t* box_min, int64_t* box_max) {
+    const scalar_t bounds_min[3] = { bounds->min.x, bounds->min.y, bounds->min.z };
+    const scalar_t bounds_max[3] = { bounds->max.x, bounds->max.y, bounds->max.z };
+    const scalar_t scales[3] = { model_transform->scale.x, model_transform->scale.y, model_transform->scale.z };
+    const scalar_t positions[3] = { model_transform->position.x, model_transform->position.y, model_transform->position.z };
+    for (int axis = 0; axis < 3; ++axis) {
+        const int64_t a = (((int64_t)bounds_min[axis] * scales[axis]) >> 12) + positions[axis];
+        const int64_t b = (((int64_t)bounds_max[axis] * scales[axis]) >> 12) + positions[axis];
+        box_min[axis] = (a < b) ? a : b;
+        box_max[axis] = (a < b) ? b : a;
+    }
+}
+
+int64_t frustum_bounding_radius(const aabb_t* bounds, const vec3_t* scale) {
+    // The largest component times 7/4 is always at least the length of the corner
+    const int64_t extent_x = frustum_extent(bounds->min.x, bounds->max.x);
+    const int64_t extent_y = frustum_extent(bounds->min.y, bounds->max.y);
+    const int64_t extent_z = frustum_extent(bounds->min.z, bounds->max.z);
+    int64_t extent_max = extent_x;
+    if (extent_y > extent_max) extent_max = extent_y;
+    if (extent_z > extent_max) extent_max = extent_z;
+    int64_t radius = extent_x + extent_y + extent_z;
+    if ((extent_max * 7) / 4 < radius) radius = (extent_max * 7) / 4;
+    const int64_t scale_max = (int64_t)scalar_max(scalar_abs(scale->x), scalar_max(scalar_abs(scale->y), scalar_abs(scale->z)));
+    return (radius * scale_max) >> 12;
+}
+
+int frustum_cull_aabb(const frustum_t* frustum, const aabb_t* bounds, const transform_t* model_transform, const int facing_camera) {
+    const vec3_t* position = &model_transform->position;
+    const int rotated = facing_camera || model_transform->rotation.x != 0 || model_transform->rotation.y != 0 || model_transform->rotation.z != 0;
+
+    // Everything is 64-bit here, mesh bounds can be as large as INT32_MIN to INT32_MAX
+    if (rotated) {
+        // Sphere around the model origin
+        const int64_t radius = frustum_bounding_radius(bounds, &model_transform->scale);
+        for (int i = 0; i < frustum->n_planes; ++i) {
+            const vec3_t* normal = &frustum->normal[i];
+            const int64_t distance = (int64_t)normal->x * ((int64_t)position->x - frustum->position.x)
+                                   + (int64_t)normal->y * ((int64_t)position->y - frustum->position.y)
+                                   + (int64_t)normal->z * ((int64_t)position->z - frustum->position.z);
+            if (distance < ((int64_t)frustum->offset[i] * ONE) - (radius * frustum->normal_length[i])) return 1;
+        }
+        return 0;
+    }
+
+    int64_t box_min[3];
+    int64_t box_max[3];
+    frustum_world_box(bounds, model_transform, box_min, box_max);
+
+    // If the corner furthest along a plane's normal is outside that plane, the whole box is
+    for (int i = 0; i < frustum->n_planes; ++i) {
+        const vec3_t* normal = &frustum->normal[i];
+        const int64_t corner_x = (normal->x >= 0) ? box_max[0] : box_min[0];
+        const int64_t corner_y = (normal->y >= 0) ? box_max[1] : box_min[1];
+        const int64_t corner_z = (normal->z >= 0) ? box_max[2] : box_min[2];
+        const int64_t distance = (int64_t)normal->x * (corner_x - frustum->position.x)
+                               + (int64_t)normal->y * (corner_y - frustum->position.y)
+                               + (int64_t)normal->z * (corner_z - frustum->position.z);
+        if (distance < (int64_t)frustum->offset[i] * ONE) return 1;
+    }
+    return 0;
+}
+
+int frustum_cull_points(const frustum_t* frustum, const vec3_t* points, const int n_points) {
+    for (int i = 0; i < frustum->n_planes; ++i) {
+        const vec3_t* normal = &frustum->normal[i];
+        int all_outside = 1;
+        for (int j = 0; j < n_points && all_outside; ++j) {
+            const int64_t distance = (int64_t)normal->x * ((int64_t)points[j].x - frustum->position.x)
+                                   + (int64_t)normal->y * ((int64_t)points[j].y - frustum->position.y)
+                                   + (int64_t)normal->z * ((int64_t)points[j].z - frustum->position.z);
+            if (distance >= (int64_t)frustum->offset[i] * ONE) all_outside = 0;
+        }
+        if (all_outside) return 1;
+    }
+    return 0;
+}
+
+frustum_t frustum_through_portal(const frustum_t* frustum, const int n_kept_planes, const vec3_t* corners, const int n_corners) {
+    frustum_t result = *frustum;
+    if (n_corners < 3 || n_kept_planes + n_corners > FRUSTUM_MAX_PLANES) return result;
+
+    // One plane through the camera and each edge. Only the direction matters, so the cross product gets scaled until
+    // its largest component is between 2^13 and 2^14, which keeps the length calculation below from overflowing
+    vec3_t normals[FRUSTUM_MAX_PLANES];
+    scalar_t lengths[FRUSTUM_MAX_PLANES];
+    for (int i = 0; i < n_corners; ++i) {
+        const vec3_t* a = &corners[i];
+        const vec3_t* b = &corners[(i + 1) % n_corners];
+        const vec3_t* opposite = &corners[(i + 2) % n_corners];
+        const int64_t ax = (int64_t)a->x - frustum->position.x;
+        const int64_t ay = (int64_t)a->y - frustum->position.y;
+        const int64_t az = (int64_t)a->z - frustum->position.z;
+        const int64_t bx = (int64_t)b->x - frustum->position.x;
+        const int64_t by = (int64_t)b->y - frustum->position.y;
+        const int64_t bz = (int64_t)b->z - frustum->position.z;
+        int64_t nx = (ay * bz) - (az * by);
+        int64_t ny = (az * bx) - (ax * bz);
+        int64_t nz = (ax * by) - (ay * bx);
+        const int64_t largest = frustum_extent(frustum_extent(nx, ny), nz);
+        if (largest == 0) return result;
+
+        const int shift = (64 - __builtin_clzll((uint64_t)largest)) - 14;
+        if (shift > 0) { nx >>= shift; ny >>= shift; nz >>= shift; }
+        else if (shift < 0) { nx *= (int64_t)1 << -shift; ny *= (int64_t)1 << -shift; nz *= (int64_t)1 << -shift; }
+
+        // Point the plane inwards. If the camera lines up with the portal, looking through it doesn't narrow anything down
+        const int64_t side = nx * ((int64_t)opposite->x - frustum->position.x)
+                           + ny * ((int64_t)opposite->y - frustum->position.y)
+                           + nz * ((int64_t)opposite->z - frustum->position.z);
+        if (side == 0) return result;
+        if (side < 0) { nx = -nx; ny = -ny; nz = -nz; }
+
+        normals[i] = (vec3_t){ (scalar_t)nx, (scalar_t)ny, (scalar_t)nz };
+        lengths[i] = scalar_sqrt((scalar_t)((nx * nx + ny * ny + nz * nz) >> 12));
+    }
+
+    // The kept planes first, then the new edges, then as many of the previous portal's planes as still fit
+    result.n_planes = n_kept_planes;
+    for (int i = 0; i < n_corners; ++i) {
+        frustum_add_plane(&result, normals[i], lengths[i], 0);
+    }
+    for (int i = n_kept_planes; i < frustum->n_planes && result.n_planes < FRUSTUM_MAX_PLANES; ++i) {
+        frustum_add_plane(&result, frustum->normal[i], frustum->normal_length[i], frustum->offset[i]);
+    }
+    return result;
+}
@@ -0,0 +1,36 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+#include "structs.h"
+
+#define FRUSTUM_MAX_PLANES 14 // The camera's 6, plus the edges of the last 2 portals it looks through
+
+// View frustum in graphics space. A point p is inside a plane if dot(normal, p - position) >= offset * ONE
+typedef struct {
+    vec3_t position;                          // Camera position in graphics units
+    vec3_t normal[FRUSTUM_MAX_PLANES];        // Pointing inwards, not normalized. 4096 = 1.0
+    scalar_t normal_length[FRUSTUM_MAX_PLANES]; // Used for testing spheres against the planes
+    int32_t offset[FRUSTUM_MAX_PLANES];       // In graphics units
+    int n_planes;
+} frustum_t;
+
+// tan_half_fov_x and tan_half_fov_y describe the visible area at a distance of 1, in 20.12 fixed point. A far_distance of 0 means no far plane
+frustum_t frustum_from_camera(const transform_t* camera_transform, scalar_t tan_half_fov_x, scalar_t tan_half_fov_y, int32_t far_distance);
+
+// Scales and moves mesh bounds into world space, ignoring the rotation. 64-bit, because mesh bounds can be as large as INT32_MIN to INT32_MAX
+void frustum_world_box(const aabb_t* bounds, const transform_t* model_transform, int64_t* box_min, int64_t* box_max);
+
+// Radius of a sphere around the model origin that fits the scaled bounds in every orientation
+int64_t frustum_bounding_radius(const aabb_t* bounds, const vec3_t* scale);
+
+// Returns 1 if the mesh bounds, placed with model_transform, are completely outside the frustum. Rotated and camera facing
+// meshes are tested with a sphere around the model origin that fits the bounds in every orientation
+int frustum_cull_aabb(const frustum_t* frustum, const aabb_t* bounds, const transform_t* model_transform, int facing_camera);
+
+// Returns 1 if all the points, in graphics space, are outside the same plane of the frustum
+int frustum_cull_points(const frustum_t* frustum, const vec3_t* points, int n_points);
+
+// Narrows the frustum down to what can be seen through a convex portal, given as its corners in graphics space in order
+// around the edge. The first n_kept_planes planes are always kept, older portal edges make room for the new ones
+frustum_t frustum_through_portal(const frustum_t* frustum, int n_kept_planes, const vec3_t* corners, int n_corners);
+
+#endif
@@ -28,6 +28,10 @@
 #include "pc/debug_layer.h"
 #endif
 
+#if defined(BENCHMARK_MODE) && defined(_HEADLESS)
+#include "pc/golden.h"
+#endif
+
 #ifdef _NDS
 #include "nds/psx.h"
 #include <nds.h>
@@ -37,6 +41,7 @@
 void update_screen_shake_intensity(int dt);
 void load_weapon_textures(void);
 void benchmark_mode(void);
+void benchmark_end_frame(int dt);
 void fps_counter(int dt);
 void draw_hud(void);
 void draw_debug_info(int dt, const int n_sections);
@@ -72,6 +77,10 @@ void state_enter_in_game(void) {
 	// Load weapon models
 	state.in_game.m_weapons = model_load("models/weapons.msh", 1, STACK_LEVEL, tex_weapon_start, 1);
 
+#ifdef BENCHMARK_MODE
+	particle_benchmark();
+#endif
+
 	#if defined(_DEBUG) && defined(_PSX)
 		FntLoad(320,256);
 		FntOpen(32, 32, 256, 192, 0, 512);
@@ -105,6 +114,8 @@ void state_update_in_game(int dt) {
 #ifdef BENCHMARK_MODE
     benchmark_mode();
 #endif
+
+    renderer_set_phase(RENDERER_PHASE_UI);
 #ifdef FPS_COUNTER
     fps_counter(dt);
 #endif
@@ -112,6 +123,7 @@ void state_update_in_game(int dt) {
     draw_hud();
 
     // Set depth bias to render level geometry in front of UI and weapon models
+	renderer_set_phase(RENDERER_PHASE_LEVEL);
 	renderer_set_depth_bias(DEPTH_BIAS_LEVEL);
 	
 	// Figure out where the player is so we can use the right vislist
@@ -128,10 +140,12 @@ void state_update_in_game(int dt) {
 	else {
 #endif
 		(void)n_sections;
+		renderer_set_phase(RENDERER_PHASE_OTHER);
 		input_update();
+		renderer_set_phase(RENDERER_PHASE_LEVEL);
 #if defined(_PSX) && defined(FPS_COUNTER)
 		const uint32_t timer_value_before = TIMER_VALUE(1) & 0xFFFF; // Get start time
-		renderer_draw_model_shaded(state.in_game.level.graphics, &state.in_game.level.transform, state.in_game.level.vislist.vislists, 0);
+		renderer_draw_model_shaded(state.in_game.level.graphics, state.in_game.level.graphics_lod, &state.in_game.level.transform, &state.in_game.level.vislist, 0);
 		uint32_t timer_value_after = TIMER_VALUE(1) & 0xFFFF; // Get end time
 
 		// Correct for int16_t overflow
@@ -142,10 +156,14 @@ void state_update_in_game(int dt) {
 		renderer_set_depth_bias(0);
 		renderer_draw_text((vec2_t){32 * ONE, 64 * ONE}, debug_text_buffer, 0, 0, (fps >= 30) ? green : red);	
 #else
-		renderer_draw_model_shaded(state.in_game.level.graphics, &state.in_game.level.transform, state.in_game.level.vislist.vislists, 0);
+		renderer_draw_model_shaded(state.in_game.level.graphics, state.in_game.level.graphics_lod, &state.in_game.level.transform, &state.in_game.level.vislist, 0);
 #endif
 
+		renderer_set_phase(RENDERER_PHASE_ENTITIES);
 		entity_update_all(&state.in_game.player, dt);
+		particle_manager_update(state.in_game.player.position, dt);
+		particle_manager_draw();
+		renderer_set_phase(RENDERER_PHASE_OTHER);
 #ifdef BENCHMARK_MODE
 		// In benchmark mode the world should be paused, so dt = 0
 		player_update(&state.in_game.player, &state.in_game.level.collision_bvh, 0, state.global.time_counter);
@@ -177,10 +195,17 @@ void state_update_in_game(int dt) {
 			for (size_t i = 0; i < n_active_aabb; ++i) {
 				renderer_debug_draw_aabb(&entity_get_aabb_queue_entry(i)->aabb, pink, &id_transform);
 			}
+
+			// Highlight the boxes that moved this frame
+			const size_t n_dirty_aabb = entity_get_n_dirty_aabb();
+			for (size_t i = 0; i < n_dirty_aabb; ++i) {
+				renderer_debug_draw_aabb(&entity_get_collision_box(entity_get_dirty_aabb_handle(i))->aabb, white, &id_transform);
+			}
 		}
 	}
 
 	// We render the player's weapons last, because we need the view matrices to be reset
+	renderer_set_phase(RENDERER_PHASE_ENTITIES);
 	PANIC_IF("trying to render non-existent weapon meshes!", (state.in_game.m_weapons == NULL) || (state.in_game.m_weapons->meshes == NULL ) || (state.in_game.m_weapons->n_meshes < 2));
 	renderer_set_depth_bias(DEPTH_BIAS_VIEWMODELS);
 
@@ -227,6 +252,10 @@ void state_update_in_game(int dt) {
 
 	renderer_end_frame();
 
+#ifdef BENCHMARK_MODE
+	benchmark_end_frame(dt);
+#endif
+
 	// free temporary allocations
 	mem_stack_release(STACK_TEMP);
 }
@@ -235,14 +264,24 @@ void draw_debug_info(int dt, const int n_sections) {
 #if defined(_DEBUG) && defined(_PSX)
     // Run the game logic within PROFILE calls, which prints the time (in hblanks) a function took to complete
     PROFILE("input", input_update(), 1);
-    PROFILE("lvl_gfx", renderer_draw_model_shaded(state.in_game.level.graphics, &state.in_game.level.transform, state.in_game.level.vislist.vislists, 0), 1);
+    PROFILE("lvl_gfx", renderer_draw_model_shaded(state.in_game.level.graphics, state.in_game.level.graphics_lod, &state.in_game.level.transform, &state.in_game.level.vislist, 0), 1);
     PROFILE("entity", entity_update_all(&state.in_game.player, dt), 1);
+    PROFILE("particles", particle_manager_update(state.in_game.player.position, dt), 1);
+    particle_manager_draw();
     PROFILE("player", player_update(&state.in_game.player, &state.in_game.level.collision_bvh, dt, state.global.time_counter), 1);
 
     // Print some useful debug info to the screen
     FntPrint(-1, "\n");
     FntPrint(-1, "dt: %i\n", dt);
-    FntPrint(-1, "meshes drawn: %i\n", renderer_n_meshes_drawn());
+    const renderer_stats_t* stats = renderer_get_stats();
+    FntPrint(-1, "meshes drawn: %i, culled: %i\n", stats->n_meshes_submitted - stats->n_meshes_culled, stats->n_meshes_culled);
+    FntPrint(-1, "prims: %i tris, %i quads, subdiv %i/%i/%i\n",
+             stats->n_triangles, stats->n_quads,
+             stats->n_subdivided[0], stats->n_subdivided[1], stats->n_subdivided[2]);
+    FntPrint(-1, "lod: %i sections, %i switches\n", stats->n_meshes_lod, stats->n_lod_switches);
+    FntPrint(-1, "vis: %i traversals, %i nodes\n", stats->n_vis_traversals, stats->n_vis_nodes_tested);
+    FntPrint(-1, "portals: %i tested, %i culled\n", stats->n_portals_tested, stats->n_sections_portal_culled);
+    FntPrint(-1, "entities hidden: %i\n", stats->n_entity_meshes_hidden);
     FntPrint(-1, "frame: %i\n", state.global.frame_counter);
     FntPrint(-1, "time: %i.%03i\n", state.global.time_counter / 1000, state.global.time_counter % 1000);
     FntPrint(-1, "player pos: %i, %i, %i\n",
@@ -262,6 +301,10 @@ void draw_debug_info(int dt, const int n_sections) {
              state.debug.shoot_hit_position.y / 4096,
              state.debug.shoot_hit_position.z / 4096);
     FntPrint(-1, "gun anim timer: %i\n", state.in_game.gun_animation_timer);
+    const particle_manager_stats_t particle_stats = particle_manager_get_stats();
+    FntPrint(-1, "particles: %i / %i, emitters: %i (%i culled, %i throttled)\n",
+             particle_stats.n_particles_alive, PARTICLE_BUDGET,
+             particle_stats.n_emitters_active, particle_stats.n_emitters_culled, particle_stats.n_emitters_throttled);
     for (int i = 0; i < N_STACK_TYPES; ++i) {
         FntPrint(-1, "%s: %i / %i KiB (%i%%)\n",
                  mem_stack_get_name(i),
@@ -321,25 +364,66 @@ void fps_counter(int dt) {
     renderer_draw_text((vec2_t){32 * ONE, 32 * ONE}, debug_text_buffer, 0, 0, (fps >= 30) ? green : red);
 }
 
+#define BENCHMARK_TIME_PER_POSITION 5000 // in milliseconds
+#define N_BENCHMARK_POSITIONS (sizeof(benchmark_positions) / sizeof(benchmark_positions[0]))
+static const transform_t benchmark_positions[] = {
+    {.position = {5849088, 5363200, 1052672}, .rotation = {0, 65536, 0}},     // starting area
+    {.position = {2695122, 4257280, 7820815}, .rotation = {1272, 43970, 0}},  // near pillar bottom
+    {.position = {2798083, 4777824, 7800474}, .rotation = {-1134, 40496, 0}}, // near pillar top
+    {.position = {161404, 4247552, 6456851}, .rotation = {4492, 76632, 0}},   // final section lower area
+};
+
 void benchmark_mode(void) {
     // Hack together some benchmark positions and fixed graphics settings
     widescreen = 1;
     vsync_enable = 0;
-    const transform_t benchmark_positions[] = {
-        (transform_t){.position = (vec3_t){5849088, 5363200, 1052672}, .rotation = (vec3_t){0, 65536, 0}},     // starting area
-        (transform_t){.position = (vec3_t){2695122, 4257280, 7820815}, .rotation = (vec3_t){1272, 43970, 0}},  // near pillar bottom
-        (transform_t){.position = (vec3_t){2798083, 4777824, 7800474}, .rotation = (vec3_t){-1134, 40496, 0}}, // near pillar top
-        (transform_t){.position = (vec3_t){161404, 4247552, 6456851}, .rotation = (vec3_t){4492, 76632, 0}},   // final section lower area
-    };
 
     // Teleport to each position for 5 sec
-    const int teleport_index = state.global.time_counter / (1000 * 5);
-    if (teleport_index < 4) {
+    const int teleport_index = state.global.time_counter / BENCHMARK_TIME_PER_POSITION;
+    if (teleport_index < (int)N_BENCHMARK_POSITIONS) {
         state.in_game.player.position = benchmark_positions[teleport_index].position;
         state.in_game.player.rotation = benchmark_positions[teleport_index].rotation;
     }
 }
 
+void benchmark_end_frame(int dt) {
+    // Dump the renderer stats of every frame as CSV. The consoles can't write files, so those print it to the TTY instead
+    char csv_line[256];
+    renderer_stats_to_csv(csv_line, sizeof(csv_line), renderer_get_stats());
+#ifdef _PC
+    static FILE* csv_file = NULL;
+    if (!csv_file) {
+        csv_file = fopen("renderer_stats.csv", "w");
+        if (!csv_file) printf("[ERROR] Failed to open 'renderer_stats.csv' for writing\n");
+        else fputs(RENDERER_STATS_CSV_HEADER, csv_file);
+    }
+    if (csv_file) fputs(csv_line, csv_file);
+#else
+    static int printed_header = 0;
+    if (!printed_header) printf(RENDERER_STATS_CSV_HEADER);
+    printed_header = 1;
+    printf("%s", csv_line);
+#endif
+
+#if defined(BENCHMARK_MODE) && defined(_HEADLESS)
+    golden_record_frame_time(renderer_get_cpu_frame_time_us());
+
+    // Compare the last frame at each position, by then the fade-in is done and the camera has caught up
+    const int teleport_index = state.global.time_counter / BENCHMARK_TIME_PER_POSITION;
+    const int next_teleport_index = (state.global.time_counter + dt) / BENCHMARK_TIME_PER_POSITION;
+    if (teleport_index < (int)N_BENCHMARK_POSITIONS && next_teleport_index != teleport_index) {
+        golden_capture(teleport_index);
+    }
+
+    // Went through all of them, the exit code tells a script whether anything changed
+    if (next_teleport_index >= (int)N_BENCHMARK_POSITIONS) {
+        exit(golden_finish() > 0 ? 1 : 0);
+    }
+#else
+    (void)dt;
+#endif
+}
+
 void update_screen_shake_intensity(int dt) {
     if (state.in_game.screen_shake_intensity_position > 0) {
         state.in_game.screen_shake_intensity_position -= state.in_game.screen_shake_dampening_position * dt;
@@ -18,6 +18,7 @@ level_t level_load(const char* level_path) {
     mem_stack_release(STACK_LEVEL);
     mem_stack_release(STACK_ENTITY);
     entity_init();
+    particle_manager_init();
 
     // Read the file 
     uint32_t* file_data = NULL;
@@ -75,6 +76,23 @@ level_t level_load(const char* level_path) {
     level.graphics = model_load(path_graphics, 1, STACK_LEVEL, tex_level_start, 1);
     mem_stack_reset_to_marker(STACK_TEMP, marker);
 
+    // The LOD model is optional, and has to have a mesh for every section of the full one
+    level.graphics_lod = NULL;
+    if (level_header->path_model_lod_offset != 0) {
+        const char* path_graphics_lod = (const char*)((binary_section + level_header->path_model_lod_offset));
+        if (path_graphics_lod[0] != 0) {
+            level.graphics_lod = model_load(path_graphics_lod, 1, STACK_LEVEL, tex_level_start, 1);
+            mem_stack_reset_to_marker(STACK_TEMP, marker);
+            if (level.graphics && level.graphics_lod && level.graphics_lod->n_meshes != level.graphics->n_meshes) {
+                printf("[ERROR] LOD model '%s' has %i meshes, but the level model has %i. Not using LODs\n", path_graphics_lod, (int)level.graphics_lod->n_meshes, (int)level.graphics->n_meshes);
+                level.graphics_lod = NULL;
+            }
+        }
+    }
+
+    // Entities get sorted into the level's sections, so the ones in sections that aren't drawn can be skipped
+    entity_set_level_sections(level.graphics, &level.transform);
+
     // Load entities
     const intptr_t level_entity_pool_stride = entity_get_pool_stride() - sizeof(entity_header_t) + sizeof(entity_header_serialized_t);
     
@@ -33,6 +33,7 @@ typedef struct {
 
 typedef struct {
     model_t* graphics;
+    model_t* graphics_lod; // Same sections as graphics in lower detail, or NULL if the level doesn't have LODs
     model_t* collision_mesh_debug;
     collision_mesh_t* collision_mesh;
     transform_t transform;
@@ -28,6 +28,7 @@
 #ifdef _PC
 #include "pc/psx.h"
 #include "pc/debug_layer.h"
+#include "pc/jobs.h"
 #endif
 
 #ifdef _NDS
@@ -71,6 +72,9 @@ int main(void) {
 	input_init();
 	input_set_stick_deadzone(36);
 	audio_init();
+#ifdef _PC
+	job_system_init();
+#endif
 
 	// Init state variables
 	memset(&state, 0, sizeof(state));
@@ -79,7 +83,13 @@ int main(void) {
 	state.global.show_debug = 0;
 
 	// Let's start here
+#if defined(BENCHMARK_MODE) && defined(_HEADLESS)
+	// Nobody is there to click through the menus, so go straight to the benchmark level
+	state.in_game.level_load_path = BENCHMARK_LEVEL;
+	current_state = STATE_IN_GAME;
+#else
 	current_state = STATE_DEBUG_MENU_MAIN;
+#endif
 
     while (!renderer_should_close()) {
 #ifndef _PC
@@ -136,7 +146,10 @@ int main(void) {
 		}
 	}
 #ifdef _PC
+#ifndef _HEADLESS
 	debug_layer_close();
+#endif
+	job_system_close();
 #endif
     return 0;
 }
@@ -26,6 +26,7 @@ size_t mem_stack_cursor_level = 0;
 size_t mem_stack_cursor_music = 0;
 size_t mem_stack_cursor_entity = 0;
 size_t mem_stack_cursor_vram_swap = 0;
+uint32_t mem_stack_generation[N_STACK_TYPES] = {0};
 
 #ifdef _DEBUG
 char* mem_cat_strings[] = {
@@ -123,6 +124,7 @@ void* mem_stack_alloc(size_t size, stack_t stack) {
 }
 
 void mem_stack_release(stack_t stack) {
+	if (stack < N_STACK_TYPES) ++mem_stack_generation[stack];
 	switch (stack) {
 		case STACK_LEVEL:
 			mem_stack_cursor_level = 0;
@@ -245,6 +247,11 @@ size_t mem_stack_get_free(stack_t stack) {
 	return mem_stack_get_size(stack) - mem_stack_get_occupied(stack);
 }
 
+uint32_t mem_stack_get_generation(stack_t stack) {
+	if (stack >= N_STACK_TYPES) return 0;
+	return mem_stack_generation[stack];
+}
+
 void* mem_alloc(size_t size, memory_category_t category) {
 #ifdef _DEBUG
     void* result = NULL;
@@ -1,6 +1,7 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
     MEM_CAT_UNDEFINED,
@@ -30,6 +31,7 @@ void mem_stack_reset_to_marker(stack_t stack, size_t marker);
 size_t mem_stack_get_size(stack_t stack);
 size_t mem_stack_get_occupied(stack_t stack);
 size_t mem_stack_get_free(stack_t stack);
+uint32_t mem_stack_get_generation(stack_t stack); // Goes up every time the stack is released, so anything caching data that lived on the stack can tell it went stale
 void mem_free(void* ptr);
 void mem_delayed_free(void* ptr);
 void mem_free_scheduled_frees(void);
@@ -1,6 +1,7 @@
 #include "renderer.h"
 
 #include "structs.h"
+#include "frustum.h"
 #include "vec2.h"
 
 #include <gl2d.h>
@@ -8,6 +9,8 @@
 
 vec3_t camera_pos;
 vec3_t camera_dir;
+static vec3_t camera_rotation;
+frustum_t frustum;
 int tex_level_start = 0;
 int tex_entity_start = 0;
 int tex_weapon_start = 0;
@@ -17,9 +20,7 @@ int vsync_enable = 1;
 int is_pal = 0;
 int textures[256] = {0};
 int texture_pages[8] = {0};
-int n_rendered_quads = 0;
 int vblank_counter = 0;
-int n_meshes_drawn = 0;
 
 void vblank_handler(void) {
     ++vblank_counter;
@@ -66,6 +67,7 @@ int16_t angle_to_16(int angle) {
 }
 
 void renderer_begin_frame(const transform_t* camera_transform) {
+    renderer_stats_begin_frame();
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     gluPerspective(90, 256.0 / 192.0, 0.01, 100);
@@ -78,18 +80,30 @@ void renderer_begin_frame(const transform_t* camera_transform) {
     glRotateZi(angle_to_16(camera_transform->rotation.z));
     glTranslatef32(-camera_transform->position.x >> 12, -camera_transform->position.y >> 12, -camera_transform->position.z >> 12);
     memcpy(&camera_pos, &camera_transform->position, sizeof(camera_pos));
+    camera_rotation = camera_transform->rotation;
+
+    // 90 degree vertical field of view, 256x192 screen
+    frustum = frustum_from_camera(camera_transform, (256 * ONE) / 192, ONE, 0);
+    renderer_set_phase(RENDERER_PHASE_OTHER);
 }
 
 void renderer_end_frame(void) {
+    renderer_set_phase(RENDERER_PHASE_END_FRAME);
     renderer_tick_fade();
     glFlush(0);
     while (vblank_counter < vsync_enable) {
         swiWaitForVBlank();
     }
+    renderer_stats_end_frame();
 }
 
 void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_transform, int local, int facing_camera, int tex_id_offset) {
-    ++n_meshes_drawn; 
+    // If the mesh's bounding box is not inside the viewing frustum, cull it
+    ++renderer_stats.n_meshes_submitted;
+    if (!local && frustum_cull_aabb(&frustum, &mesh->bounds, model_transform, facing_camera)) {
+        ++renderer_stats.n_meshes_culled;
+        return;
+    }
     
     // Set up model view matrix
     glMatrixMode(GL_MODELVIEW);
@@ -165,8 +179,10 @@ void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_tran
         glTexCoord2i(v2.u >> 2, v2.v >> 2);
         glVertex3v16(v2.x, v2.y, v2.z);
         vert_idx += 3;
+        ++renderer_stats.n_triangles;
     }
     glEnd();
+    ++renderer_stats.n_draw_calls;
     // Draw quads
     glPolyFmt(POLY_ALPHA(31) | (local ? POLY_CULL_BACK : POLY_CULL_FRONT));
     glBegin(GL_QUADS);
@@ -192,9 +208,10 @@ void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_tran
         glTexCoord2i(v3.u >> 2, v3.v >> 2);
         glVertex3v16(v3.x, v3.y, v3.z);
         vert_idx += 4;
-        n_rendered_quads++;
+        ++renderer_stats.n_quads;
     }
     glEnd();
+    ++renderer_stats.n_draw_calls;
 
     // Revert matrix
     glPopMatrix(1);
@@ -238,6 +255,8 @@ void renderer_draw_2d_quad(vec2_t tl, vec2_t tr, vec2_t bl, vec2_t br, vec2_t uv
         glTexCoord2i(uv_tl.x / ONE, uv_br.y / ONE); // v4
         glVertex3v16(bl.x, bl.y, depth);
     glEnd();
+    ++renderer_stats.n_quads;
+    ++renderer_stats.n_draw_calls;
 
     // Put the matrices back
     glMatrixMode(GL_MODELVIEW);
@@ -280,6 +299,47 @@ void renderer_apply_fade(int fade_level) {
     glPopMatrix(1);
 }
 
+void renderer_draw_particle_system(const particle_system_t* system) {
+    if (system->n_alive == 0) return;
+
+    glMatrixMode(GL_MODELVIEW);
+    glPolyFmt(POLY_ALPHA(31) | POLY_CULL_NONE);
+    for (int i = 0; i < system->n_alive; ++i) {
+        // Move to the particle, then undo the camera rotation so the quad faces the screen
+        glPushMatrix();
+        glTranslatef32(-system->position_x[i] / COL_SCALE, -system->position_y[i] / COL_SCALE, -system->position_z[i] / COL_SCALE);
+        glRotateZi(angle_to_16(-camera_rotation.z));
+        glRotateYi(angle_to_16(-camera_rotation.y));
+        glRotateXi(angle_to_16(-camera_rotation.x));
+        glScalef32(ONE, -ONE, -ONE);
+
+        const int16_t half_w = (int16_t)system->scale_x[i];
+        const int16_t half_h = (int16_t)system->scale_y[i];
+        if (system->params->texture_id != NO_TEXTURE) glBindTexture(0, textures[system->params->texture_id + system->curr_frame[i] / ONE]);
+        else glBindTexture(0, 0);
+
+        // Same color scale as the 2D quads, where 128 is neutral
+        glColor3b(
+            scalar_clamp((system->colour_r[i] / ONE) * 2, 0, 255),
+            scalar_clamp((system->colour_g[i] / ONE) * 2, 0, 255),
+            scalar_clamp((system->colour_b[i] / ONE) * 2, 0, 255)
+        );
+        glBegin(GL_QUADS);
+            glTexCoord2i(0, 0);
+            glVertex3v16(-half_w, half_h, 0);
+            glTexCoord2i(64, 0);
+            glVertex3v16(half_w, half_h, 0);
+            glTexCoord2i(64, 64);
+            glVertex3v16(half_w, -half_h, 0);
+            glTexCoord2i(0, 64);
+            glVertex3v16(-half_w, -half_h, 0);
+        glEnd();
+        ++renderer_stats.n_quads;
+        glPopMatrix(1);
+    }
+    ++renderer_stats.n_draw_calls;
+}
+
 void renderer_debug_draw_line(vec3_t v0, vec3_t v1, pixel32_t color, const transform_t* model_transform) {
     (void)v0;
     (void)v1;
@@ -298,6 +358,8 @@ void renderer_upload_texture(const texture_cpu_t* texture, uint8_t index) {
     if (glColorTableEXT(0, 0, 16, 0, 0, texture->palette) == 0) {
         printf("Error loading texture %i palette\n", index);
     }
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += (64 * 64 / 2) + (16 * sizeof(pixel16_t));
 }
 
 void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8_t index) {
@@ -310,6 +372,8 @@ void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8
     if (glColorTableEXT(0, 0, 256, 0, 0, texture->palette) == 0) {
         printf("Error loading texture page %i palette\n", index);
     }
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += (256 * 256) + (256 * sizeof(pixel16_t));
 }
 
 void renderer_set_video_mode(int is_pal) {
@@ -327,8 +391,6 @@ int renderer_get_delta_time_ms(void) {
     TODO()
 }
 
-int renderer_n_meshes_drawn(void) { return n_meshes_drawn; }
-
 int renderer_convert_dt_raw_to_ms(int dt_raw) {
     return (1666 * dt_raw) / 100;
 }
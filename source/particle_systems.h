@@ -3,6 +3,8 @@
 
 #include "particles.h"
 
-// todo: add test system here
+// These are defined in particles.c
+extern const particle_system_params_t particle_system_benchmark; // Dense, long-lived sparks, used by the particle benchmark
+extern const particle_system_params_t particle_system_pickup_collect; // A short burst of sparks where a pickup got collected
 
 #endif
@@ -0,0 +1,496 @@
+#include "particles.h"
+
+#include "particle_systems.h"
+#include "renderer.h"
+#include "memory.h"
+#include "random.h"
+
+#include <string.h>
+
+#ifdef BENCHMARK_MODE
+#ifdef _PC
+#include <time.h>
+#endif
+#ifdef _PSX
+#include <hwregs_c.h>
+#endif
+#ifdef _NDS
+#include <nds.h>
+#endif
+#endif
+
+#define N_PARTICLE_ARRAYS 16
+
+// Dense, long-lived sparks, used by the particle benchmark
+const particle_system_params_t particle_system_benchmark = {
+	.texture_id = 0,
+	.blend_mode = BLEND_MODE_ADD,
+	.scale_uniformly = 1,
+	.n_animation_frames = 1,
+	.loop_start = -1,
+	.animation_frame_rate = 0,
+	.lifetime_min = 2 * ONE,
+	.lifetime_max = 4 * ONE,
+	.system_lifetime = 60 * ONE,
+	.spawn_rate_start = 512 * ONE,
+	.spawn_rate_end = 512 * ONE,
+	.n_particles_max = 512,
+	.constant_acceleration = { 0, -200 * ONE, 0 },
+	.initial_velocity_min = { -100 * ONE, 50 * ONE, -100 * ONE },
+	.initial_velocity_max = { 100 * ONE, 200 * ONE, 100 * ONE },
+	.initial_position_offset_min = { -16 * ONE, 0, -16 * ONE },
+	.initial_position_offset_max = { 16 * ONE, 0, 16 * ONE },
+	.initial_scale_min = { 4 * ONE, 4 * ONE },
+	.initial_scale_max = { 8 * ONE, 8 * ONE },
+	.colour_start_min = { 255, 192, 64, 255 },
+	.colour_start_max = { 255, 255, 128, 255 },
+	.colour_end_min = { 64, 0, 0, 255 },
+	.colour_end_max = { 128, 32, 0, 255 },
+	.scale_multiplier_over_time = { ONE / 2, ONE / 2 },
+	.velocity_multiplier_over_time = { ONE / 2, ONE, ONE / 2 },
+};
+
+// A short burst of sparks where a pickup got collected
+const particle_system_params_t particle_system_pickup_collect = {
+	.texture_id = NO_TEXTURE,
+	.blend_mode = BLEND_MODE_ADD,
+	.scale_uniformly = 1,
+	.n_animation_frames = 1,
+	.loop_start = -1,
+	.animation_frame_rate = 0,
+	.lifetime_min = ONE / 4,
+	.lifetime_max = ONE / 2,
+	.system_lifetime = ONE / 8,
+	.spawn_rate_start = 256 * ONE,
+	.spawn_rate_end = 64 * ONE,
+	.n_particles_max = 24,
+	.constant_acceleration = { 0, -150 * ONE, 0 },
+	.initial_velocity_min = { -40 * ONE, 40 * ONE, -40 * ONE },
+	.initial_velocity_max = { 40 * ONE, 120 * ONE, 40 * ONE },
+	.initial_position_offset_min = { -4 * ONE, -4 * ONE, -4 * ONE },
+	.initial_position_offset_max = { 4 * ONE, 4 * ONE, 4 * ONE },
+	.initial_scale_min = { ONE, ONE },
+	.initial_scale_max = { 2 * ONE, 2 * ONE },
+	.colour_start_min = { 192, 192, 96, 255 },
+	.colour_start_max = { 255, 255, 160, 255 },
+	.colour_end_min = { 64, 32, 0, 255 },
+	.colour_end_max = { 96, 64, 16, 255 },
+	.scale_multiplier_over_time = { ONE / 4, ONE / 4 },
+	.velocity_multiplier_over_time = { ONE / 2, ONE, ONE / 2 },
+};
+
+// random_range() divides by (max - min), so handle empty ranges here
+static int32_t random_between(const int32_t min, const int32_t max) {
+    if (max <= min) return min;
+    return random_range(min, max);
+}
+
+// Converts a per-second rate into a per-frame factor, e.g. ONE/2 per second at dt = 0.5s becomes ONE*3/4
+static scalar_t rate_over_time(const scalar_t multiplier_per_second, const scalar_t dt_seconds) {
+    return scalar_lerp(ONE, multiplier_per_second, dt_seconds);
+}
+
+// Points a system at its attribute arrays, which are laid out back to back in a single block
+static void particle_system_init(particle_system_t* system, const particle_system_params_t* params, const vec3_t position, uint8_t* arrays, const int n_particles_max) {
+    const size_t array_size = n_particles_max * sizeof(scalar_t);
+
+    memset(system, 0, sizeof(particle_system_t));
+    system->params = params;
+    system->position = position;
+    system->n_particles_max = n_particles_max;
+    system->n_alive = 0;
+    system->spawn_limit = n_particles_max;
+    system->curr_spawn_rate = params->spawn_rate_start;
+    system->curr_spawn_timer = 0;
+    system->time_since_first_particle_seconds = 0;
+
+    system->position_x = (scalar_t*)(arrays + 0 * array_size);
+    system->position_y = (scalar_t*)(arrays + 1 * array_size);
+    system->position_z = (scalar_t*)(arrays + 2 * array_size);
+    system->velocity_x = (scalar_t*)(arrays + 3 * array_size);
+    system->velocity_y = (scalar_t*)(arrays + 4 * array_size);
+    system->velocity_z = (scalar_t*)(arrays + 5 * array_size);
+    system->scale_x = (scalar_t*)(arrays + 6 * array_size);
+    system->scale_y = (scalar_t*)(arrays + 7 * array_size);
+    system->colour_r = (scalar_t*)(arrays + 8 * array_size);
+    system->colour_g = (scalar_t*)(arrays + 9 * array_size);
+    system->colour_b = (scalar_t*)(arrays + 10 * array_size);
+    system->colour_step_r = (scalar_t*)(arrays + 11 * array_size);
+    system->colour_step_g = (scalar_t*)(arrays + 12 * array_size);
+    system->colour_step_b = (scalar_t*)(arrays + 13 * array_size);
+    system->curr_frame = (scalar_t*)(arrays + 14 * array_size);
+    system->lifetime_left_ms = (int32_t*)(arrays + 15 * array_size);
+}
+
+particle_system_t* particle_system_new(const particle_system_params_t* params, vec3_t position) {
+    // Round up to a multiple of 4, which keeps every array 16 byte aligned
+    const int n_particles_max = (params->n_particles_max + 3) & ~3;
+    const size_t array_size = n_particles_max * sizeof(scalar_t);
+
+    // The stack allocator doesn't check for overflows, so do it here
+    const size_t total_size = ((sizeof(particle_system_t) + 3) & ~3) + N_PARTICLE_ARRAYS * array_size;
+    if (total_size > mem_stack_get_free(STACK_ENTITY)) {
+        printf("[ERROR] Not enough entity stack space for a particle system with %i particles\n", n_particles_max);
+        return NULL;
+    }
+    particle_system_t* system = mem_stack_alloc(sizeof(particle_system_t), STACK_ENTITY);
+    uint8_t* arrays = mem_stack_alloc(N_PARTICLE_ARRAYS * array_size, STACK_ENTITY);
+    particle_system_init(system, params, position, arrays, n_particles_max);
+    return system;
+}
+
+static void copy_particle(particle_system_t* system, const int dst, const int src) {
+    system->position_x[dst] = system->position_x[src];
+    system->position_y[dst] = system->position_y[src];
+    system->position_z[dst] = system->position_z[src];
+    system->velocity_x[dst] = system->velocity_x[src];
+    system->velocity_y[dst] = system->velocity_y[src];
+    system->velocity_z[dst] = system->velocity_z[src];
+    system->scale_x[dst] = system->scale_x[src];
+    system->scale_y[dst] = system->scale_y[src];
+    system->colour_r[dst] = system->colour_r[src];
+    system->colour_g[dst] = system->colour_g[src];
+    system->colour_b[dst] = system->colour_b[src];
+    system->colour_step_r[dst] = system->colour_step_r[src];
+    system->colour_step_g[dst] = system->colour_step_g[src];
+    system->colour_step_b[dst] = system->colour_step_b[src];
+    system->curr_frame[dst] = system->curr_frame[src];
+    system->lifetime_left_ms[dst] = system->lifetime_left_ms[src];
+}
+
+static void spawn_particle(particle_system_t* system) {
+    const particle_system_params_t* params = system->params;
+    const int i = system->n_alive++;
+
+    system->position_x[i] = system->position.x + random_between(params->initial_position_offset_min.x, params->initial_position_offset_max.x);
+    system->position_y[i] = system->position.y + random_between(params->initial_position_offset_min.y, params->initial_position_offset_max.y);
+    system->position_z[i] = system->position.z + random_between(params->initial_position_offset_min.z, params->initial_position_offset_max.z);
+    system->velocity_x[i] = random_between(params->initial_velocity_min.x, params->initial_velocity_max.x);
+    system->velocity_y[i] = random_between(params->initial_velocity_min.y, params->initial_velocity_max.y);
+    system->velocity_z[i] = random_between(params->initial_velocity_min.z, params->initial_velocity_max.z);
+    system->scale_x[i] = random_between(params->initial_scale_min.x, params->initial_scale_max.x);
+    system->scale_y[i] = params->scale_uniformly ? system->scale_x[i] : random_between(params->initial_scale_min.y, params->initial_scale_max.y);
+    system->curr_frame[i] = 0;
+
+    // Lifetime is in seconds, but the update counts down in milliseconds
+    const scalar_t lifetime = random_between(params->lifetime_min, params->lifetime_max);
+    int32_t lifetime_ms = (lifetime * 1000) / ONE;
+    if (lifetime_ms < 1) lifetime_ms = 1;
+    system->lifetime_left_ms[i] = lifetime_ms;
+
+    // Precompute the colour lerp, so the update only has to add a step every frame
+    const int r_start = random_between(params->colour_start_min.r, params->colour_start_max.r);
+    const int g_start = random_between(params->colour_start_min.g, params->colour_start_max.g);
+    const int b_start = random_between(params->colour_start_min.b, params->colour_start_max.b);
+    const int r_end = random_between(params->colour_end_min.r, params->colour_end_max.r);
+    const int g_end = random_between(params->colour_end_min.g, params->colour_end_max.g);
+    const int b_end = random_between(params->colour_end_min.b, params->colour_end_max.b);
+    system->colour_r[i] = r_start * ONE;
+    system->colour_g[i] = g_start * ONE;
+    system->colour_b[i] = b_start * ONE;
+    system->colour_step_r[i] = ((r_end - r_start) * ONE) / lifetime_ms;
+    system->colour_step_g[i] = ((g_end - g_start) * ONE) / lifetime_ms;
+    system->colour_step_b[i] = ((b_end - b_start) * ONE) / lifetime_ms;
+}
+
+void particle_system_update(particle_system_t* system, int dt_ms) {
+    const particle_system_params_t* params = system->params;
+    const scalar_t dt = (dt_ms * ONE) / 1000;
+
+    // Age the particles
+    int32_t* restrict lifetime_left_ms = system->lifetime_left_ms;
+    for (int i = 0; i < system->n_alive; ++i) {
+        lifetime_left_ms[i] -= dt_ms;
+    }
+
+    // Compact dead particles out of the alive range by moving the last alive particle into the gap
+    for (int i = 0; i < system->n_alive;) {
+        if (lifetime_left_ms[i] > 0) {
+            ++i;
+            continue;
+        }
+        copy_particle(system, i, --system->n_alive);
+    }
+
+    const int n = system->n_alive;
+
+    // Velocity - these factors are the same for every particle, so they're only calculated once
+    {
+        const scalar_t damping_x = rate_over_time(params->velocity_multiplier_over_time.x, dt);
+        const scalar_t damping_y = rate_over_time(params->velocity_multiplier_over_time.y, dt);
+        const scalar_t damping_z = rate_over_time(params->velocity_multiplier_over_time.z, dt);
+        const scalar_t delta_x = scalar_mul(params->constant_acceleration.x, dt);
+        const scalar_t delta_y = scalar_mul(params->constant_acceleration.y, dt);
+        const scalar_t delta_z = scalar_mul(params->constant_acceleration.z, dt);
+        scalar_t* restrict velocity_x = system->velocity_x;
+        scalar_t* restrict velocity_y = system->velocity_y;
+        scalar_t* restrict velocity_z = system->velocity_z;
+        for (int i = 0; i < n; ++i) velocity_x[i] = scalar_mul(velocity_x[i], damping_x) + delta_x;
+        for (int i = 0; i < n; ++i) velocity_y[i] = scalar_mul(velocity_y[i], damping_y) + delta_y;
+        for (int i = 0; i < n; ++i) velocity_z[i] = scalar_mul(velocity_z[i], damping_z) + delta_z;
+    }
+
+    // Position
+    {
+        scalar_t* restrict position_x = system->position_x;
+        scalar_t* restrict position_y = system->position_y;
+        scalar_t* restrict position_z = system->position_z;
+        const scalar_t* restrict velocity_x = system->velocity_x;
+        const scalar_t* restrict velocity_y = system->velocity_y;
+        const scalar_t* restrict velocity_z = system->velocity_z;
+        for (int i = 0; i < n; ++i) position_x[i] += scalar_mul(velocity_x[i], dt);
+        for (int i = 0; i < n; ++i) position_y[i] += scalar_mul(velocity_y[i], dt);
+        for (int i = 0; i < n; ++i) position_z[i] += scalar_mul(velocity_z[i], dt);
+    }
+
+    // Scale
+    {
+        const scalar_t factor_x = rate_over_time(params->scale_multiplier_over_time.x, dt);
+        const scalar_t factor_y = rate_over_time(params->scale_multiplier_over_time.y, dt);
+        scalar_t* restrict scale_x = system->scale_x;
+        scalar_t* restrict scale_y = system->scale_y;
+        for (int i = 0; i < n; ++i) scale_x[i] = scalar_mul(scale_x[i], factor_x);
+        for (int i = 0; i < n; ++i) scale_y[i] = scalar_mul(scale_y[i], factor_y);
+    }
+
+    // Colour, which is just an add now that the lerp is precomputed
+    {
+        scalar_t* restrict colour_r = system->colour_r;
+        scalar_t* restrict colour_g = system->colour_g;
+        scalar_t* restrict colour_b = system->colour_b;
+        const scalar_t* restrict colour_step_r = system->colour_step_r;
+        const scalar_t* restrict colour_step_g = system->colour_step_g;
+        const scalar_t* restrict colour_step_b = system->colour_step_b;
+        for (int i = 0; i < n; ++i) colour_r[i] += colour_step_r[i] * dt_ms;
+        for (int i = 0; i < n; ++i) colour_g[i] += colour_step_g[i] * dt_ms;
+        for (int i = 0; i < n; ++i) colour_b[i] += colour_step_b[i] * dt_ms;
+    }
+
+    // Animation
+    if (params->n_animation_frames > 1) {
+        const scalar_t frame_step = scalar_mul(params->animation_frame_rate, dt);
+        const scalar_t end = params->n_animation_frames * ONE;
+        const scalar_t loop_length = (params->n_animation_frames - params->loop_start) * ONE;
+        scalar_t* restrict curr_frame = system->curr_frame;
+        for (int i = 0; i < n; ++i) {
+            curr_frame[i] += frame_step;
+            if (curr_frame[i] >= end) {
+                curr_frame[i] = (params->loop_start < 0) ? (end - 1) : (curr_frame[i] - loop_length);
+            }
+        }
+    }
+
+    // Handle particle spawning
+    if (system->time_since_first_particle_seconds > params->system_lifetime) return;
+    system->time_since_first_particle_seconds += dt;
+    system->curr_spawn_timer -= dt;
+    while (system->curr_spawn_timer <= 0) {
+        if (system->n_alive >= system->spawn_limit) {
+            system->curr_spawn_timer = 0;
+            break;
+        }
+        spawn_particle(system);
+
+        // Update spawn rate
+        system->curr_spawn_rate = scalar_lerp(params->spawn_rate_start, params->spawn_rate_end, scalar_div(system->time_since_first_particle_seconds, params->system_lifetime));
+        if (system->curr_spawn_rate <= 0) {
+            system->curr_spawn_timer = INT32_MAX;
+            break;
+        }
+        system->curr_spawn_timer += scalar_div(ONE, system->curr_spawn_rate);
+    }
+}
+
+int particle_system_is_finished(const particle_system_t* system) {
+    return (system->time_since_first_particle_seconds > system->params->system_lifetime) && (system->n_alive == 0);
+}
+
+// Particle manager. Every slot owns a fixed block of PARTICLE_EMITTER_CAPACITY particles, so emitters never allocate after init
+static particle_system_t particle_emitters[PARTICLE_MAX_EMITTERS];
+static uint8_t particle_emitter_active[PARTICLE_MAX_EMITTERS];
+static uint8_t particle_emitter_culled[PARTICLE_MAX_EMITTERS];
+static uint8_t particle_emitter_priority[PARTICLE_MAX_EMITTERS];
+static uint16_t particle_emitter_generation[PARTICLE_MAX_EMITTERS];
+static uint8_t* particle_emitter_arrays[PARTICLE_MAX_EMITTERS];
+static particle_manager_stats_t particle_stats;
+
+// The generation makes sure a handle to an emitter that has since been recycled doesn't touch the new one
+static int particle_manager_handle_to_slot(const int handle) {
+    if (handle < 0) return -1;
+    const int slot = handle % PARTICLE_MAX_EMITTERS;
+    if (!particle_emitter_active[slot]) return -1;
+    if (particle_emitter_generation[slot] != handle / PARTICLE_MAX_EMITTERS) return -1;
+    return slot;
+}
+
+void particle_manager_init(void) {
+    memset(particle_emitter_active, 0, sizeof(particle_emitter_active));
+    memset(particle_emitter_arrays, 0, sizeof(particle_emitter_arrays));
+    memset(&particle_stats, 0, sizeof(particle_stats));
+
+    const size_t block_size = N_PARTICLE_ARRAYS * PARTICLE_EMITTER_CAPACITY * sizeof(scalar_t);
+    if (PARTICLE_MAX_EMITTERS * block_size > mem_stack_get_free(STACK_ENTITY)) {
+        printf("[ERROR] Not enough entity stack space for the particle emitter pool, particles are disabled\n");
+        return;
+    }
+    uint8_t* pool = mem_stack_alloc(PARTICLE_MAX_EMITTERS * block_size, STACK_ENTITY);
+    for (int i = 0; i < PARTICLE_MAX_EMITTERS; ++i) {
+        particle_emitter_arrays[i] = pool + (i * block_size);
+    }
+}
+
+int particle_manager_spawn(const particle_system_params_t* params, vec3_t position, particle_priority_t priority) {
+    // Take a free slot if there is one, otherwise evict whatever is least important. Culled emitters can't be seen, so they go first
+    int slot = -1;
+    int victim_score = INT32_MAX;
+    for (int i = 0; i < PARTICLE_MAX_EMITTERS; ++i) {
+        if (!particle_emitter_arrays[i]) continue;
+        if (!particle_emitter_active[i]) {
+            slot = i;
+            break;
+        }
+        if (!particle_emitter_culled[i] && particle_emitter_priority[i] >= priority) continue;
+        const int score = particle_emitter_culled[i] ? -1 : particle_emitter_priority[i];
+        if (score < victim_score) {
+            victim_score = score;
+            slot = i;
+        }
+    }
+    if (slot < 0) return PARTICLE_EMITTER_NONE;
+
+    const int n_particles_max = (params->n_particles_max < PARTICLE_EMITTER_CAPACITY) ? ((params->n_particles_max + 3) & ~3) : PARTICLE_EMITTER_CAPACITY;
+    particle_system_init(&particle_emitters[slot], params, position, particle_emitter_arrays[slot], n_particles_max);
+    particle_emitter_active[slot] = 1;
+    particle_emitter_culled[slot] = 0;
+    particle_emitter_priority[slot] = (uint8_t)priority;
+    ++particle_emitter_generation[slot];
+    return slot + (particle_emitter_generation[slot] * PARTICLE_MAX_EMITTERS);
+}
+
+void particle_manager_move(int handle, vec3_t position) {
+    const int slot = particle_manager_handle_to_slot(handle);
+    if (slot < 0) return;
+    particle_emitters[slot].position = position;
+}
+
+void particle_manager_destroy(int handle) {
+    const int slot = particle_manager_handle_to_slot(handle);
+    if (slot < 0) return;
+    particle_emitter_active[slot] = 0;
+}
+
+static int particle_manager_is_far_away(const vec3_t a, const vec3_t b) {
+    // Reject per axis first, so the squared distance below can't overflow
+    const vec3_t delta = vec3_sub(a, b);
+    if (delta.x > PARTICLE_CULL_DISTANCE || delta.x < -PARTICLE_CULL_DISTANCE) return 1;
+    if (delta.y > PARTICLE_CULL_DISTANCE || delta.y < -PARTICLE_CULL_DISTANCE) return 1;
+    if (delta.z > PARTICLE_CULL_DISTANCE || delta.z < -PARTICLE_CULL_DISTANCE) return 1;
+    return vec3_magnitude_squared(delta) > scalar_mul(PARTICLE_CULL_DISTANCE, PARTICLE_CULL_DISTANCE);
+}
+
+void particle_manager_update(vec3_t camera_position, int dt_ms) {
+    memset(&particle_stats, 0, sizeof(particle_stats));
+
+    // Cull distant emitters. Their particles are dropped, but they keep ticking so they still finish on time
+    int n_alive = 0;
+    for (int i = 0; i < PARTICLE_MAX_EMITTERS; ++i) {
+        if (!particle_emitter_active[i]) continue;
+        particle_system_t* system = &particle_emitters[i];
+        particle_emitter_culled[i] = particle_manager_is_far_away(system->position, camera_position);
+        if (particle_emitter_culled[i]) {
+            system->n_alive = 0;
+            system->spawn_limit = 0;
+            ++particle_stats.n_emitters_culled;
+        }
+        n_alive += system->n_alive;
+    }
+
+    // Hand out the rest of the budget, most important emitters first. Particles that are already alive are never taken away
+    int budget_left = PARTICLE_BUDGET - n_alive;
+    for (int priority = PARTICLE_PRIORITY_COUNT - 1; priority >= 0; --priority) {
+        for (int i = 0; i < PARTICLE_MAX_EMITTERS; ++i) {
+            if (!particle_emitter_active[i] || particle_emitter_culled[i] || particle_emitter_priority[i] != priority) continue;
+            particle_system_t* system = &particle_emitters[i];
+            int n_new = system->n_particles_max - system->n_alive;
+            if (n_new > budget_left) {
+                n_new = budget_left;
+                ++particle_stats.n_emitters_throttled;
+            }
+            system->spawn_limit = system->n_alive + n_new;
+            budget_left -= n_new;
+        }
+    }
+
+    // Simulate, and give finished emitters back to the pool
+    for (int i = 0; i < PARTICLE_MAX_EMITTERS; ++i) {
+        if (!particle_emitter_active[i]) continue;
+        particle_system_t* system = &particle_emitters[i];
+        particle_system_update(system, dt_ms);
+        if (particle_system_is_finished(system)) {
+            particle_emitter_active[i] = 0;
+            continue;
+        }
+        ++particle_stats.n_emitters_active;
+        particle_stats.n_particles_alive += system->n_alive;
+    }
+}
+
+void particle_manager_draw(void) {
+    for (int i = 0; i < PARTICLE_MAX_EMITTERS; ++i) {
+        if (!particle_emitter_active[i] || particle_emitter_culled[i]) continue;
+        renderer_draw_particle_system(&particle_emitters[i]);
+    }
+}
+
+particle_manager_stats_t particle_manager_get_stats(void) {
+    return particle_stats;
+}
+
+#ifdef BENCHMARK_MODE
+void particle_benchmark(void) {
+    const int n_frames = 60;
+    const size_t marker = mem_stack_get_marker(STACK_ENTITY);
+    particle_system_t* system = particle_system_new(&particle_system_benchmark, (vec3_t){0, 0, 0});
+    if (!system) return;
+
+    // Let it fill up first, so we measure a full pool
+    while (system->n_alive < system->n_particles_max && system->time_since_first_particle_seconds <= particle_system_benchmark.system_lifetime) {
+        particle_system_update(system, 16);
+    }
+
+    int n_particles_updated = 0;
+#ifdef _PC
+    const clock_t start = clock();
+#elif defined(_PSX)
+    // Timer 1 counts hblanks, which is ~15.7 per millisecond. 16 bits is enough for ~4 seconds
+    TIMER_CTRL(1) = 0b0100000000;
+    TIMER_VALUE(1) = 0;
+#elif defined(_NDS)
+    cpuStartTiming(0);
+#endif
+
+    for (int i = 0; i < n_frames; ++i) {
+        n_particles_updated += system->n_alive;
+        particle_system_update(system, 16);
+    }
+
+#ifdef _PC
+    const int elapsed_us = (int)(((clock() - start) * 1000000) / CLOCKS_PER_SEC);
+#elif defined(_PSX)
+    const int elapsed_us = ((TIMER_VALUE(1) & 0xFFFF) * 1000000) / 15734;
+#elif defined(_NDS)
+    const int elapsed_us = (int)timerTicks2usec(cpuEndTiming());
+#else
+    const int elapsed_us = 0;
+#endif
+
+    if (elapsed_us > 0) {
+        printf("[BENCHMARK] particles: %i updated in %i us, %i per ms\n", n_particles_updated, elapsed_us, (n_particles_updated * 1000) / elapsed_us);
+    }
+    else {
+        printf("[BENCHMARK] particles: %i updated in less than 1 us\n", n_particles_updated);
+    }
+
+    mem_stack_reset_to_marker(STACK_ENTITY, marker);
+}
+#endif
@@ -3,15 +3,21 @@
 
 #include "texture.h"
 #include "structs.h"
-#include "random.h"
 #include "vec3.h"
 #include "vec2.h"
 
+#define PARTICLE_BUDGET 256                         // Maximum number of particles alive at once, across all emitters owned by the particle manager
+#define PARTICLE_MAX_EMITTERS 8                     // Number of pooled emitter slots in the particle manager
+#define PARTICLE_EMITTER_CAPACITY 48                // Particles per pooled emitter slot. Systems asking for more get clamped
+#define PARTICLE_CULL_DISTANCE (384 * ONE)          // Emitters further away from the camera than this don't simulate or draw their particles
+#define PARTICLE_EMITTER_NONE -1
+
 enum BlendMode
 {
 	BLEND_MODE_MIX,
 	BLEND_MODE_ADD,
-	BLEND_MODE_SUB
+	BLEND_MODE_SUB,
+	BLEND_MODE_COUNT
 };
 
 //This struct defines a particle system. A pointer to an instance of this struct will be used in a particle system entity to determine its behaviour and look.
@@ -39,96 +45,69 @@ typedef struct {
 	pixel32_t colour_start_max;				// Maximum starting colour value (RGBA 0 - 255)
 	pixel32_t colour_end_min;				// Ending colour value (RGBA 0 - 255). If the red value is set to a value below zero, the particles will stay the same colour.
 	pixel32_t colour_end_max;				// Ending colour value (RGBA 0 - 255). If the red value is set to a value below zero, the particles will stay the same colour.
-	vec2_t scale_multiplier_over_time;		// Value to multiply the scale by every second - TODO: assess whether this causes any fixed point precision problems
-	vec3_t velocity_multiplier_over_time;	// Value to multiply the velocity by every second. Can be thought of like a friction value per axis
+	vec2_t scale_multiplier_over_time;		// Value to multiply the scale by every second (ONE = no change) - TODO: assess whether this causes any fixed point precision problems
+	vec3_t velocity_multiplier_over_time;	// Value to multiply the velocity by every second (ONE = no change). Can be thought of like a friction value per axis
 } particle_system_params_t;
 
+// Particles are stored as a structure of arrays, so the update kernel can stream through one attribute at a time.
+// Particles [0, n_alive) are alive, dead particles get compacted out during the update
 typedef struct {
-	scalar_t total_lifetime;	// Time before despawning (seconds)
-	scalar_t time_alive;		// Time currently alive. If this exceeds `total_lifetime`, the particle gets destroyed
-	pixel32_t start_colour;	    // Starting colour (RGBA 0 - 255)
-	pixel32_t end_colour;	    // Ending colour (RGBA 0 - 255)
-	vec3_t velocity;		    // Current velocity (world units / second)
-	vec3_t position;		    // Position in world space (world units)
-	vec2_t scale;		        // Scale in world space (world units)
-	scalar_t curr_frame;		// Current frame ID
-} particle_t;
-
-typedef struct {
-    particle_system_params_t* params;
-    particle_t* particle_buffer;
-    scalar_t curr_spawn_rate;
-    scalar_t curr_spawn_timer;
+    const particle_system_params_t* params;
+    vec3_t position;                            // Emitter position (collision space units)
+    int n_particles_max;
+    int n_alive;
+    int spawn_limit;                            // Stops spawning once this many particles are alive, the particle manager lowers it when over budget
+    scalar_t curr_spawn_rate;                   // Particles per second
+    scalar_t curr_spawn_timer;                  // Time until the next particle spawns (seconds)
     scalar_t time_since_first_particle_seconds;
-    int curr_spawn_index;
-} particle_system_t;
-
-particle_system_t* particle_system_new(particle_system_params_t* params) {
-    particle_system_t* particle_system = mem_stack_alloc(sizeof(particle_system_t), STACK_ENTITY);
-    params->n_particles_max = ((params->n_particles_max + 2) / 3) * 3; // align to grid of 3, allows for neat gte_rtpt in rendering
-    particle_system->params = params;
-    particle_system->particle_buffer = mem_stack_alloc(sizeof(particle_t) * params->n_particles_max, STACK_ENTITY);
 
-    // todo
-    return NULL;
-}
-
-void particle_system_update(particle_system_t* system, transform_t* transform) {
-    const particle_system_params_t* params = system->params;
-
-    if (system->time_since_first_particle_seconds > params->system_lifetime) return;
+    scalar_t* position_x;                       // Position in world space (collision space units)
+    scalar_t* position_y;
+    scalar_t* position_z;
+    scalar_t* velocity_x;                       // Current velocity (collision space units / second)
+    scalar_t* velocity_y;
+    scalar_t* velocity_z;
+    scalar_t* scale_x;                          // Scale (graphics space units)
+    scalar_t* scale_y;
+    scalar_t* colour_r;                         // Current colour (0 - 255, fixed point)
+    scalar_t* colour_g;
+    scalar_t* colour_b;
+    scalar_t* colour_step_r;                    // Colour change per millisecond, precomputed from the start and end colours when spawning
+    scalar_t* colour_step_g;
+    scalar_t* colour_step_b;
+    scalar_t* curr_frame;                       // Current animation frame (fixed point)
+    int32_t* lifetime_left_ms;                  // Time before despawning
+} particle_system_t;
 
-    // Handle particle spawning
-    while(system->curr_spawn_timer > 0) {
-        system->particle_buffer[system->curr_spawn_index] = (particle_t) {
-            .start_colour = {
-                .r = random_range(params->colour_start_min.r, params->colour_start_max.r),
-                .g = random_range(params->colour_start_min.g, params->colour_start_max.g),
-                .b = random_range(params->colour_start_min.b, params->colour_start_max.b),
-                .a = 255,
-            },
-            .end_colour = {
-                .r = random_range(params->colour_end_min.r, params->colour_end_max.r),
-                .g = random_range(params->colour_end_min.g, params->colour_end_max.g),
-                .b = random_range(params->colour_end_min.b, params->colour_end_max.b),
-                .a = 255,
-            },
-            .velocity = {
-                .x = random_range(params->initial_velocity_min.x, params->initial_velocity_max.x),
-                .y = random_range(params->initial_velocity_min.y, params->initial_velocity_max.y),
-                .z = random_range(params->initial_velocity_min.z, params->initial_velocity_max.z),
-            },
-            .position = {
-                .x = random_range(params->initial_position_offset_min.x, params->initial_position_offset_max.x),
-                .y = random_range(params->initial_position_offset_min.y, params->initial_position_offset_max.y),
-                .z = random_range(params->initial_position_offset_min.z, params->initial_position_offset_max.z),
-            },
-            .scale = {
-                .x = random_range(params->initial_scale_min.x, params->initial_scale_max.x),
-                .y = random_range(params->initial_scale_min.y, params->initial_scale_max.y),
-            },
-            .total_lifetime = random_range(params->lifetime_min, params->lifetime_max),
-            .curr_frame = 0,
-            .time_alive = 0,
-        };
+particle_system_t* particle_system_new(const particle_system_params_t* params, vec3_t position); // Allocates on STACK_ENTITY, returns NULL if it doesn't fit
+void particle_system_update(particle_system_t* system, int dt_ms);
+int particle_system_is_finished(const particle_system_t* system); // Done spawning and no particles left
 
-        if (params->scale_uniformly) {
-            system->particle_buffer[system->curr_spawn_index].scale.y = system->particle_buffer[system->curr_spawn_index].scale.x;
-        }
+typedef enum {
+    PARTICLE_PRIORITY_LOW,
+    PARTICLE_PRIORITY_NORMAL,
+    PARTICLE_PRIORITY_HIGH,
+    PARTICLE_PRIORITY_COUNT,
+} particle_priority_t;
 
-        // Move to entity transform
-        system->particle_buffer[system->curr_spawn_index].position.x += transform->position.x;
-        system->particle_buffer[system->curr_spawn_index].position.y += transform->position.y;
-        system->particle_buffer[system->curr_spawn_index].position.z += transform->position.z;
+typedef struct {
+    int n_emitters_active;
+    int n_emitters_culled;
+    int n_emitters_throttled;                   // Emitters that wanted to spawn more particles than the budget allowed this frame
+    int n_particles_alive;
+} particle_manager_stats_t;
 
-        // Update spawn rate
-        system->curr_spawn_rate = scalar_lerp(params->spawn_rate_start, params->spawn_rate_end, scalar_div(system->time_since_first_particle_seconds, params->system_lifetime));
-        system->curr_spawn_timer = scalar_div(ONE, system->curr_spawn_rate);
+// The particle manager owns a fixed pool of emitters. Handles are only valid until the emitter finishes or gets destroyed, after that they're ignored
+void particle_manager_init(void); // Allocates the emitter pool on STACK_ENTITY, so call it again whenever that stack gets released
+int particle_manager_spawn(const particle_system_params_t* params, vec3_t position, particle_priority_t priority); // Returns a handle, or PARTICLE_EMITTER_NONE if every slot is taken by something at least as important
+void particle_manager_move(int handle, vec3_t position);
+void particle_manager_destroy(int handle);
+void particle_manager_update(vec3_t camera_position, int dt_ms); // Culls, throttles and updates every emitter, and returns finished ones to the pool
+void particle_manager_draw(void);
+particle_manager_stats_t particle_manager_get_stats(void);
 
-        // Move buffer cursor
-        system->curr_spawn_index++;
-        system->curr_spawn_index %= params->n_particles_max;
-    }
-}
+#ifdef BENCHMARK_MODE
+void particle_benchmark(void);
+#endif
 
 #endif
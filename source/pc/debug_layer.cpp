@@ -1,5 +1,6 @@
 #include "debug_layer.h"
 
+#include "../renderer.h"
 #include "../entity.h"
 #include "imgui.h"
 
@@ -14,7 +15,6 @@
 #include "../entities/chaser.h"
 #include "../entities/crate.h"
 #include "../entities/door.h"
-#include "../renderer.h"
 #include "../input.h"
 #include "../file.h"
 
@@ -24,12 +24,14 @@
 #endif
 
 extern const char* entity_names[];
+static GLFWwindow* debug_layer_window = NULL;
 
 void debug_layer_init(GLFWwindow* window) {
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO();
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;
     ImGui::StyleColorsDark();
+    debug_layer_window = window;
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 430");
     ImGui::LoadIniSettingsFromDisk("imgui_layout.ini");
@@ -46,6 +48,9 @@ void debug_layer_begin(void) {
 }
 
 void debug_layer_end(void) {
+	// Draw the scene into the framebuffer first, ImGui shows it in the viewport window
+	renderer_flush();
+
 	// Clear screen
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
@@ -257,8 +262,8 @@ void debug_layer_manipulate_entity(transform_t* camera, int* selected_entity_slo
     static int render_level_bvh_start_depth = 0;
     static int render_level_bvh_end_depth = 6;
     
-    if (render_level_graphics) renderer_draw_model_shaded(curr_level->graphics, &curr_level->transform, NULL, 0);
-    if (render_level_collision) renderer_draw_model_shaded(curr_level->collision_mesh_debug, &id_transform, NULL, 0);
+    if (render_level_graphics) renderer_draw_model_shaded(curr_level->graphics, NULL, &curr_level->transform, NULL, 0);
+    if (render_level_collision) renderer_draw_model_shaded(curr_level->collision_mesh_debug, NULL, &id_transform, NULL, 0);
     if (render_level_bvh) bvh_debug_draw(&curr_level->collision_bvh, render_level_bvh_start_depth, render_level_bvh_end_depth, (pixel32_t){ .r = 160, .g = 240, .b = 80, .a = 255 });
     if (render_level_nav_graph) bvh_debug_draw_nav_graph(&curr_level->collision_bvh);
     if (render_level_vislist_regions) {
@@ -519,6 +524,7 @@ void debug_layer_manipulate_entity(transform_t* camera, int* selected_entity_slo
             mem_stack_release(STACK_LEVEL);
             mem_stack_release(STACK_ENTITY);
             entity_init();
+            particle_manager_init();
 
             // Load level textures
             texture_cpu_t* tex_level;
@@ -572,6 +578,28 @@ void debug_layer_manipulate_entity(transform_t* camera, int* selected_entity_slo
             ImGui::Checkbox("Render Level navgraph", &render_level_nav_graph);
             ImGui::TreePop();
         }
+        if (ImGui::TreeNodeEx("Renderer", ImGuiTreeNodeFlags_DefaultOpen)) {
+            const renderer_stats_t* stats = renderer_get_stats();
+            ImGui::Text("Meshes: %u submitted, %u culled", stats->n_meshes_submitted, stats->n_meshes_culled);
+            ImGui::Text("Primitives: %u triangles, %u quads", stats->n_triangles, stats->n_quads);
+            ImGui::Text("Draw calls: %u / frame", stats->n_draw_calls);
+            ImGui::Text("State changes: %u / frame", stats->n_state_changes);
+            ImGui::Text("Vertex upload: %u bytes / frame", stats->n_buffer_bytes_uploaded);
+            ImGui::Text("Texture upload: %u textures, %u bytes", stats->n_texture_uploads, stats->n_texture_bytes_uploaded);
+            const char* phase_names[N_RENDERER_PHASES] = { "Begin frame", "Level", "Entities", "UI", "End frame", "Other" };
+            for (int i = 0; i < N_RENDERER_PHASES; ++i) {
+                ImGui::Text("CPU %s: %u us", phase_names[i], stats->time_us[i]);
+            }
+            ImGui::TreePop();
+        }
+        if (ImGui::TreeNodeEx("Particles", ImGuiTreeNodeFlags_DefaultOpen)) {
+            const particle_manager_stats_t stats = particle_manager_get_stats();
+            ImGui::Text("Particles: %i / %i", stats.n_particles_alive, PARTICLE_BUDGET);
+            ImGui::Text("Emitters: %i / %i", stats.n_emitters_active, PARTICLE_MAX_EMITTERS);
+            ImGui::Text("Culled emitters: %i", stats.n_emitters_culled);
+            ImGui::Text("Throttled emitters: %i", stats.n_emitters_throttled);
+            ImGui::TreePop();
+        }
     }
     ImGui::End();
 
@@ -791,7 +819,8 @@ void debug_layer_manipulate_entity(transform_t* camera, int* selected_entity_slo
             *mouse_over_viewport = 1;
 
             if (input_pressed(PAD_L2, 0)) {
-                // Read stencil buffer
+                // Read stencil buffer, the entities have to be drawn into it first
+                renderer_flush();
                 uint8_t entity_index = 255;
                 glReadPixels((GLint)rel_mouse_pos.x, (GLint)(renderer_height() - rel_mouse_pos.y), 1, 1, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, &entity_index);
                 
@@ -813,6 +842,56 @@ void debug_layer_manipulate_entity(transform_t* camera, int* selected_entity_slo
 }
 
 #endif
+#ifndef _LEVEL_EDITOR
+static bool show_gameplay_window = false;
+static bool toggle_key_was_down = false;
+
+void debug_layer_update_gameplay(void) {
+    // F3 toggles the overlay
+    const bool toggle_key_down = glfwGetKey(debug_layer_window, GLFW_KEY_F3) == GLFW_PRESS;
+    if (toggle_key_down && !toggle_key_was_down) show_gameplay_window = !show_gameplay_window;
+    toggle_key_was_down = toggle_key_down;
+    if (!show_gameplay_window) return;
+
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+
+    ImGui::Begin("Renderer");
+    {
+        const renderer_dynamic_res_t* dynamic_res = renderer_get_dynamic_res();
+        bool enabled = dynamic_res->enabled != 0;
+        if (ImGui::Checkbox("Dynamic resolution", &enabled)) {
+            renderer_set_dynamic_res_enabled(enabled);
+        }
+        ImGui::Text("Scale: %i%% (%ix%i)", dynamic_res->scale_percent[dynamic_res->bucket], renderer_width(), renderer_height());
+        ImGui::Text("Frame time: %u us (CPU %u us + GPU %u us)", dynamic_res->smoothed_us, dynamic_res->cpu_us, dynamic_res->gpu_us);
+        ImGui::Text("Target: %u us", dynamic_res->target_us);
+        if (ImGui::TreeNodeEx("Time spent at each scale", ImGuiTreeNodeFlags_DefaultOpen)) {
+            for (int i = DYNAMIC_RES_N_BUCKETS - 1; i >= 0; --i) {
+                ImGui::Text("%s%3i%%: %u.%01u s", (i == dynamic_res->bucket) ? "> " : "  ", dynamic_res->scale_percent[i], dynamic_res->time_ms[i] / 1000, (dynamic_res->time_ms[i] % 1000) / 100);
+            }
+            ImGui::TreePop();
+        }
+        const renderer_stats_t* stats = renderer_get_stats();
+        ImGui::Text("Level LOD: %u sections, %u switches", stats->n_meshes_lod, stats->n_lod_switches);
+        ImGui::Text("Vis BVH: %u traversals, %u nodes tested", stats->n_vis_traversals, stats->n_vis_nodes_tested);
+        bool portal_culling = renderer_get_portal_culling() != 0;
+        if (ImGui::Checkbox("Portal culling", &portal_culling)) {
+            renderer_set_portal_culling(portal_culling);
+        }
+        ImGui::Text("Portals: %u tested, %u sections culled", stats->n_portals_tested, stats->n_sections_portal_culled);
+        ImGui::Text("Meshes submitted: %u, %u without portals", stats->n_meshes_submitted, stats->n_meshes_submitted + stats->n_sections_portal_culled);
+        ImGui::Text("Entity meshes in hidden sections: %u", stats->n_entity_meshes_hidden);
+    }
+    ImGui::End();
+
+    // Draw on top of the blitted frame
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+#endif
+
 void debug_layer_close(void) {
     ImGui::SaveIniSettingsToDisk("imgui_layout.ini");
 }
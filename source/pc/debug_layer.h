@@ -14,7 +14,7 @@ extern "C" {
 void debug_layer_init(GLFWwindow* window);
 void debug_layer_begin(void);
 void debug_layer_end(void);
-void debug_layer_update_gameplay(void);
+void debug_layer_update_gameplay(void); // In-game overlay toggled with F3, drawn straight to the window after the frame is blitted
 void debug_layer_close(void);
 void debug_layer_manipulate_entity(transform_t* camera, int* selected_entity_slot, int* mouse_over_viewport, level_t* curr_level, player_t* player);
 
@@ -0,0 +1,177 @@
+#include "golden.h"
+
+#include "../renderer.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define golden_mkdir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define golden_mkdir(path) mkdir(path, 0755)
+#endif
+
+static int golden_frame_times[GOLDEN_MAX_FRAMES];
+static int golden_n_frames = 0;
+static int golden_segment_start = 0; // First frame since the previous capture
+static int golden_n_captures = 0;
+static int golden_n_failed = 0;
+
+static int golden_compare_int(const void* a, const void* b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+// Same conversion as renderer_dump_frame(), so freshly written goldens compare equal to the frame they came from
+static void golden_framebuffer_to_rgb(uint8_t* rgb, const int n_pixels) {
+    const uint16_t* framebuffer = renderer_get_framebuffer();
+    for (int i = 0; i < n_pixels; ++i) {
+        const uint16_t pixel = framebuffer[i];
+        const uint8_t r = pixel & 31;
+        const uint8_t g = (pixel >> 5) & 31;
+        const uint8_t b = (pixel >> 10) & 31;
+        rgb[i * 3 + 0] = (uint8_t)((r << 3) | (r >> 2));
+        rgb[i * 3 + 1] = (uint8_t)((g << 3) | (g >> 2));
+        rgb[i * 3 + 2] = (uint8_t)((b << 3) | (b >> 2));
+    }
+}
+
+static int golden_load_ppm(const char* path, uint8_t* rgb, const int width, const int height) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return 0;
+
+    int file_width = 0;
+    int file_height = 0;
+    int max_value = 0;
+    if (fscanf(file, "P6 %i %i %i", &file_width, &file_height, &max_value) != 3 || fgetc(file) == EOF) {
+        printf("[ERROR] '%s' is not a binary PPM file\n", path);
+        fclose(file);
+        return 0;
+    }
+    if (file_width != width || file_height != height || max_value != 255) {
+        printf("[ERROR] '%s' is %ix%i (max %i), expected %ix%i (max 255)\n", path, file_width, file_height, max_value, width, height);
+        fclose(file);
+        return 0;
+    }
+
+    const size_t size = (size_t)width * height * 3;
+    const size_t n_read = fread(rgb, 1, size, file);
+    fclose(file);
+    if (n_read != size) {
+        printf("[ERROR] '%s' is truncated\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+void golden_record_frame_time(int time_us) {
+    if (golden_n_frames >= GOLDEN_MAX_FRAMES) return;
+    golden_frame_times[golden_n_frames++] = time_us;
+}
+
+int golden_capture(int index) {
+    const int width = renderer_width();
+    const int height = renderer_height();
+    const int n_pixels = width * height;
+
+    // Frame times since the previous capture, so a slow camera position stands out
+    int64_t segment_total = 0;
+    int segment_max = 0;
+    for (int i = golden_segment_start; i < golden_n_frames; ++i) {
+        segment_total += golden_frame_times[i];
+        if (golden_frame_times[i] > segment_max) segment_max = golden_frame_times[i];
+    }
+    const int segment_n_frames = golden_n_frames - golden_segment_start;
+    const int segment_avg = segment_n_frames > 0 ? (int)(segment_total / segment_n_frames) : 0;
+    golden_segment_start = golden_n_frames;
+    ++golden_n_captures;
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/golden_%02i.ppm", GOLDEN_PATH, index);
+
+    uint8_t* expected = malloc((size_t)n_pixels * 3);
+    uint8_t* actual = malloc((size_t)n_pixels * 3);
+    PANIC_IF("failed to allocate golden image buffers", expected == NULL || actual == NULL);
+
+#ifdef GOLDEN_UPDATE
+    const int update = 1;
+#else
+    const int update = 0;
+#endif
+
+    int result = 1;
+    if (update) {
+        golden_mkdir(GOLDEN_PATH);
+        result = renderer_dump_frame(path);
+        printf("[GOLDEN] %s: %s, cpu %i us avg, %i us max\n", path, result ? "written" : "could not be written", segment_avg, segment_max);
+    }
+    else if (!golden_load_ppm(path, expected, width, height)) {
+        // Writing it here would let a broken renderer pass by creating its own reference
+        result = 0;
+        printf("[GOLDEN] %s: MISSING, build with GOLDEN_UPDATE to write it, cpu %i us avg, %i us max\n", path, segment_avg, segment_max);
+    }
+    else {
+        golden_framebuffer_to_rgb(actual, n_pixels);
+
+        int n_diff_pixels = 0;
+        int max_diff = 0;
+        for (int i = 0; i < n_pixels; ++i) {
+            int pixel_diff = 0;
+            for (int c = 0; c < 3; ++c) {
+                const int diff = abs((int)actual[i * 3 + c] - (int)expected[i * 3 + c]);
+                if (diff > pixel_diff) pixel_diff = diff;
+            }
+            if (pixel_diff > GOLDEN_TOLERANCE) ++n_diff_pixels;
+            if (pixel_diff > max_diff) max_diff = pixel_diff;
+        }
+
+        result = n_diff_pixels <= GOLDEN_MAX_DIFF_PIXELS;
+        printf("[GOLDEN] %s: %s, %i pixels differ (max %i), cpu %i us avg, %i us max\n", path, result ? "ok" : "MISMATCH", n_diff_pixels, max_diff, segment_avg, segment_max);
+
+        // Keep the offending frame next to the golden one so they can be compared by eye
+        if (!result) {
+            snprintf(path, sizeof(path), "%s/golden_%02i_actual.ppm", GOLDEN_PATH, index);
+            renderer_dump_frame(path);
+        }
+    }
+
+    if (!result) ++golden_n_failed;
+    free(expected);
+    free(actual);
+    return result;
+}
+
+int golden_finish(void) {
+    FILE* csv = fopen("frame_times.csv", "w");
+    if (csv) {
+        fprintf(csv, "frame,cpu_us\n");
+        for (int i = 0; i < golden_n_frames; ++i) {
+            fprintf(csv, "%i,%i\n", i, golden_frame_times[i]);
+        }
+        fclose(csv);
+    }
+    else {
+        printf("[ERROR] Failed to open 'frame_times.csv' for writing\n");
+    }
+
+    if (golden_n_frames > 0) {
+        static int sorted[GOLDEN_MAX_FRAMES];
+        memcpy(sorted, golden_frame_times, golden_n_frames * sizeof(int));
+        qsort(sorted, golden_n_frames, sizeof(int), golden_compare_int);
+
+        int64_t total = 0;
+        for (int i = 0; i < golden_n_frames; ++i) total += sorted[i];
+        printf("[GOLDEN] cpu frame time over %i frames: min %i us, avg %i us, p99 %i us, max %i us\n",
+            golden_n_frames,
+            sorted[0],
+            (int)(total / golden_n_frames),
+            sorted[(golden_n_frames * 99) / 100],
+            sorted[golden_n_frames - 1]
+        );
+    }
+    printf("[GOLDEN] %i / %i captures passed\n", golden_n_captures - golden_n_failed, golden_n_captures);
+    return golden_n_failed;
+}
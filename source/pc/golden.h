@@ -0,0 +1,29 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GOLDEN_PATH
+#define GOLDEN_PATH "golden" // Folder the reference images are read from and written to
+#endif
+
+#ifndef GOLDEN_TOLERANCE
+#define GOLDEN_TOLERANCE 8 // A pixel only counts as different if one of its channels is off by more than this (0-255)
+#endif
+
+#ifndef GOLDEN_MAX_DIFF_PIXELS
+#define GOLDEN_MAX_DIFF_PIXELS 64 // A capture fails if more pixels than this are different
+#endif
+
+#define GOLDEN_MAX_FRAMES 8192
+
+void golden_record_frame_time(int time_us); // Call once per frame with renderer_get_cpu_frame_time_us()
+int golden_capture(int index); // Compares the current framebuffer to GOLDEN_PATH/golden_xx.ppm. Writes it instead if GOLDEN_UPDATE is defined. Returns 0 on mismatch or if the reference is missing
+int golden_finish(void); // Prints the results, writes the frame times to frame_times.csv, and returns the number of failed captures
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -2,12 +2,14 @@
 
 #include "pc/psx.h"
 
-#include <GL/gl3w.h>
+#include <stdio.h>
 
+#ifndef _HEADLESS
+#include <GL/gl3w.h>
 #include <GLFW/glfw3.h>
-#include <stdio.h>
 
 extern GLFWwindow* window;
+#endif
 int8_t left_stick_x[2] = { 0, 0 };
 int8_t left_stick_y[2] = { 0, 0 };
 int8_t right_stick_x[2] = { 0, 0 };
@@ -31,17 +33,22 @@ double mouse_scroll_curr = 0.0;
 double mouse_scroll_prev = 0.0;
 uint16_t input_buffer[32];
 
+#ifndef _HEADLESS
 void input_scroll_callback(GLFWwindow* window, double x_offset, double y_offset) {
     (void)window;
     (void)x_offset;
     mouse_scroll_incoming += y_offset;
 }
+#endif
 
 void input_init(void) {
+#ifndef _HEADLESS
     glfwSetScrollCallback(window, input_scroll_callback);
+#endif
 }
 
 void input_update(void) {
+#ifndef _HEADLESS
     // Detect controllers
     for (int i = 0; i < 8; ++i) {
         if (i == player1_index || i == player2_index)
@@ -60,6 +67,7 @@ void input_update(void) {
 
     if (player1_index == -1) player1_index = 0;
     if (player2_index == -1) player2_index = 0;
+#endif
 
     // Reset buttons
     button_prev[0] = button_curr[0];
@@ -76,6 +84,9 @@ void input_update(void) {
     left_stick_x[1] = 0;
     right_stick_y[1] = 0;
     right_stick_x[1] = 0;
+
+    // The headless build has no window and no controllers, so everything stays released
+#ifndef _HEADLESS
     GLFWgamepadstate state1;
     GLFWgamepadstate state2;
     glfwGetGamepadState(player1_index, &state1);
@@ -176,6 +187,7 @@ void input_update(void) {
     button_curr[0] |= (PAD_CIRCLE)*glfwGetKey(window, GLFW_KEY_RIGHT_CONTROL);
     button_curr[0] |= (PAD_CROSS)*glfwGetKey(window, GLFW_KEY_SPACE);
     button_curr[0] |= (PAD_SQUARE)*glfwGetKey(window, GLFW_KEY_LEFT_SHIFT);
+#endif
 
     if (button_curr[0]) keyboard_focus = 1;
     if (abs(left_stick_x[0]) > deadzone) keyboard_focus = 1;
@@ -296,12 +308,16 @@ int input_mouse_connected(void) {
 
 void input_lock_mouse(void) {
     mouse_lock = 1;
+#ifndef _HEADLESS
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+#endif
 }
 
 void input_unlock_mouse(void) {
     mouse_lock = 0;
+#ifndef _HEADLESS
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+#endif
 }
 
 int input_mouse_movement_x(void) {
@@ -0,0 +1,182 @@
+#include "jobs.h"
+
+#include "../common.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Every worker owns a deque of job indices. The owner pops from the tail, idle workers steal from the head
+typedef struct {
+    pthread_mutex_t mutex;
+    int jobs[JOB_QUEUE_LENGTH];
+    int head;
+    int tail;
+} job_queue_t;
+
+static job_queue_t job_queues[JOB_MAX_WORKERS];
+static pthread_t job_threads[JOB_MAX_WORKERS];
+static int job_n_workers = 1;
+
+// Current batch
+static job_func_t job_func = NULL;
+static void* job_user_data = NULL;
+static int job_n_remaining = 0;
+static pthread_mutex_t job_done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_done_cond = PTHREAD_COND_INITIALIZER;
+
+// Worker wake-up
+static uint32_t job_generation = 0;
+static int job_quit = 0;
+static pthread_mutex_t job_wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_wake_cond = PTHREAD_COND_INITIALIZER;
+
+static int job_get_n_hardware_threads(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+static int job_pop(int worker) {
+    job_queue_t* queue = &job_queues[worker];
+    int job = -1;
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->tail > queue->head) job = queue->jobs[--queue->tail];
+    pthread_mutex_unlock(&queue->mutex);
+    return job;
+}
+
+static int job_steal(int worker) {
+    for (int i = 1; i < job_n_workers; ++i) {
+        job_queue_t* queue = &job_queues[(worker + i) % job_n_workers];
+        int job = -1;
+        pthread_mutex_lock(&queue->mutex);
+        if (queue->tail > queue->head) job = queue->jobs[queue->head++];
+        pthread_mutex_unlock(&queue->mutex);
+        if (job >= 0) return job;
+    }
+    return -1;
+}
+
+static void job_work_until_empty(int worker) {
+    while (1) {
+        int job = job_pop(worker);
+        if (job < 0) job = job_steal(worker);
+        if (job < 0) return;
+
+        job_func(job, job_user_data);
+
+        pthread_mutex_lock(&job_done_mutex);
+        if (--job_n_remaining == 0) pthread_cond_signal(&job_done_cond);
+        pthread_mutex_unlock(&job_done_mutex);
+    }
+}
+
+static void* job_worker_main(void* arg) {
+    const int worker = (int)(intptr_t)arg;
+    uint32_t seen_generation = 0;
+
+    while (1) {
+        pthread_mutex_lock(&job_wake_mutex);
+        while (job_generation == seen_generation && !job_quit) pthread_cond_wait(&job_wake_cond, &job_wake_mutex);
+        seen_generation = job_generation;
+        const int quit = job_quit;
+        pthread_mutex_unlock(&job_wake_mutex);
+
+        if (quit) return NULL;
+        job_work_until_empty(worker);
+    }
+}
+
+void job_system_init(void) {
+    // Leave one hardware thread for the audio callback and the driver
+    job_n_workers = job_get_n_hardware_threads() - 1;
+    if (job_n_workers < 1) job_n_workers = 1;
+    if (job_n_workers > JOB_MAX_WORKERS) job_n_workers = JOB_MAX_WORKERS;
+
+    for (int i = 0; i < job_n_workers; ++i) {
+        pthread_mutex_init(&job_queues[i].mutex, NULL);
+        job_queues[i].head = 0;
+        job_queues[i].tail = 0;
+    }
+
+    // Worker 0 is the main thread
+    job_quit = 0;
+    for (int i = 1; i < job_n_workers; ++i) {
+        if (pthread_create(&job_threads[i], NULL, job_worker_main, (void*)(intptr_t)i) != 0) {
+            printf("[ERROR] Failed to create job worker thread %i, continuing with %i workers\n", i, i);
+            job_n_workers = i;
+            break;
+        }
+    }
+}
+
+void job_system_close(void) {
+    pthread_mutex_lock(&job_wake_mutex);
+    job_quit = 1;
+    pthread_cond_broadcast(&job_wake_cond);
+    pthread_mutex_unlock(&job_wake_mutex);
+
+    for (int i = 1; i < job_n_workers; ++i) {
+        pthread_join(job_threads[i], NULL);
+    }
+    for (int i = 0; i < job_n_workers; ++i) {
+        pthread_mutex_destroy(&job_queues[i].mutex);
+    }
+    job_n_workers = 1;
+}
+
+void job_system_run(job_func_t func, void* user_data, int n_jobs) {
+    if (n_jobs <= 0) return;
+
+    // Not worth waking anyone up
+    if (job_n_workers == 1 || n_jobs == 1) {
+        for (int i = 0; i < n_jobs; ++i) func(i, user_data);
+        return;
+    }
+
+    PANIC_IF("too many jobs for the job queues", n_jobs > JOB_QUEUE_LENGTH);
+
+    job_func = func;
+    job_user_data = user_data;
+    pthread_mutex_lock(&job_done_mutex);
+    job_n_remaining = n_jobs;
+    pthread_mutex_unlock(&job_done_mutex);
+
+    // Deal the jobs out round-robin, stealing evens out whatever imbalance is left
+    for (int i = 0; i < job_n_workers; ++i) {
+        job_queue_t* queue = &job_queues[i];
+        pthread_mutex_lock(&queue->mutex);
+        queue->head = 0;
+        queue->tail = 0;
+        for (int job = i; job < n_jobs; job += job_n_workers) {
+            queue->jobs[queue->tail++] = job;
+        }
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    pthread_mutex_lock(&job_wake_mutex);
+    ++job_generation;
+    pthread_cond_broadcast(&job_wake_cond);
+    pthread_mutex_unlock(&job_wake_mutex);
+
+    // Help out, then wait for the stragglers
+    job_work_until_empty(0);
+    pthread_mutex_lock(&job_done_mutex);
+    while (job_n_remaining > 0) pthread_cond_wait(&job_done_cond, &job_done_mutex);
+    pthread_mutex_unlock(&job_done_mutex);
+}
+
+int job_system_get_n_workers(void) {
+    return job_n_workers;
+}
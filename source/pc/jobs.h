@@ -0,0 +1,22 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOB_MAX_WORKERS 16
+#define JOB_QUEUE_LENGTH 256
+
+// Called once per job index. Jobs from the same batch can run on any thread in any order
+typedef void (*job_func_t)(int job_index, void* user_data);
+
+void job_system_init(void);
+void job_system_close(void);
+void job_system_run(job_func_t func, void* user_data, int n_jobs); // Runs func(i) for all i in [0, n_jobs), returns once every job has finished. The calling thread helps out
+int job_system_get_n_workers(void); // Includes the main thread
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,10 +1,79 @@
 #include "memory.h"
+#include "renderer.h"
 #include "mesh.h"
 #include "file.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 
+#define MESH_MAX_VERTICES 65536 // Indices are 16-bit
+#define MESH_MAX_INDICES (65535 * 3) // n_triangles is 16-bit
+
+static uint32_t mesh_hash_vertex(const vertex_3d_t* vertex) {
+    uint32_t words[3];
+    memcpy(words, vertex, sizeof(words));
+    uint32_t hash = words[0] * 0x9E3779B1u;
+    hash = (hash ^ words[1]) * 0x85EBCA77u;
+    hash = (hash ^ words[2]) * 0xC2B2AE3Du;
+    return hash ^ (hash >> 16);
+}
+
+// Merges identical vertices in place and builds a triangle index list, with quads split into (0, 1, 2) and (2, 1, 3).
+// Vertices get numbered in the order they're first used, so the GPU reads them more or less front to back
+static void mesh_build_indices(mesh_t* mesh, uint16_t* indices, uint32_t* hash_table, const uint32_t hash_table_size) {
+    vertex_3d_t* vertices = mesh->vertices;
+    const uint32_t hash_mask = hash_table_size - 1;
+    memset(hash_table, 0, hash_table_size * sizeof(uint32_t)); // Unique vertex index + 1, 0 means empty
+
+    uint32_t n_vertices = 0;
+    uint32_t n_indices = 0;
+    size_t k = 0;
+    const size_t n_polygons = (size_t)mesh->n_triangles + (size_t)mesh->n_quads;
+    for (size_t j = 0; j < n_polygons; ++j) {
+        const size_t n_corners = (j < mesh->n_triangles) ? 3 : 4;
+        if (n_vertices + n_corners > MESH_MAX_VERTICES || n_indices + 6 > MESH_MAX_INDICES) {
+            printf("[ERROR] Mesh '%s' is too big for 16-bit indices, only %u of its %u polygons will be drawn\n", mesh->name, (unsigned)j, (unsigned)n_polygons);
+            break;
+        }
+
+        // Copy the polygon out first, since merged vertices get written over the ones that haven't been read yet
+        vertex_3d_t polygon[4];
+        memcpy(polygon, &vertices[k], n_corners * sizeof(vertex_3d_t));
+        k += n_corners;
+
+        uint16_t corners[4];
+        for (size_t c = 0; c < n_corners; ++c) {
+            // Copy the vertex texture ids to each vertex instead of just the first. OpenGL is annoying about this.
+            polygon[c].tex_id = polygon[0].tex_id;
+
+            uint32_t slot = mesh_hash_vertex(&polygon[c]) & hash_mask;
+            while (hash_table[slot] != 0 && memcmp(&vertices[hash_table[slot] - 1], &polygon[c], sizeof(vertex_3d_t)) != 0) {
+                slot = (slot + 1) & hash_mask;
+            }
+            if (hash_table[slot] == 0) {
+                vertices[n_vertices] = polygon[c];
+                hash_table[slot] = ++n_vertices;
+            }
+            corners[c] = (uint16_t)(hash_table[slot] - 1);
+        }
+
+        indices[n_indices++] = corners[0];
+        indices[n_indices++] = corners[1];
+        indices[n_indices++] = corners[2];
+        if (n_corners == 4) {
+            indices[n_indices++] = corners[2];
+            indices[n_indices++] = corners[1];
+            indices[n_indices++] = corners[3];
+        }
+    }
+
+    mesh->indices = indices;
+    mesh->n_vertices = n_vertices;
+    mesh->n_triangles = (uint16_t)(n_indices / 3);
+    mesh->n_quads = 0;
+}
+
 model_t* model_load(const char* path, int on_stack, stack_t stack, int tex_id_start, int optimize_for_single_render_per_frame) {
     (void)tex_id_start;
     (void)optimize_for_single_render_per_frame;
@@ -40,6 +109,19 @@ model_t* model_load(const char* path, int on_stack, stack_t stack, int tex_id_st
 	}
     model->n_meshes = model_header->n_submeshes;
 
+    // One hash table for merging vertices, big enough for the biggest submesh
+    size_t max_mesh_vertices = 0;
+    for (size_t i = 0; i < model_header->n_submeshes; ++i) {
+        const size_t n_mesh_vertices = ((size_t)mesh_descriptions[i].n_triangles * 3) + ((size_t)mesh_descriptions[i].n_quads * 4);
+        if (n_mesh_vertices > max_mesh_vertices) max_mesh_vertices = n_mesh_vertices;
+    }
+    uint32_t hash_table_capacity = 16;
+    while (hash_table_capacity < max_mesh_vertices * 2) hash_table_capacity *= 2;
+    uint32_t* hash_table = mem_alloc(hash_table_capacity * sizeof(uint32_t), MEM_CAT_MESH);
+    size_t n_vertices_before = 0;
+    size_t n_vertices_after = 0;
+    size_t n_indices_after = 0;
+
     // Loop over each submesh and populate the model
     uint8_t* mesh_name_cursor = (uint8_t*)((intptr_t)binary_section + model_header->offset_mesh_names);
     for (size_t i = 0; i < model_header->n_submeshes; ++i) {
@@ -78,40 +160,36 @@ model_t* model_load(const char* path, int on_stack, stack_t stack, int tex_id_st
         model->meshes[i].bounds.max.z = mesh_descriptions[i].z_max;
         model->meshes[i].name = string;
 
-        // Convert quads to triangles
+        // Merge duplicate vertices and turn the quads into indexed triangles
         mesh_t* mesh = &model->meshes[i];
-        vertex_3d_t* new_verts = mem_alloc(((mesh->n_triangles * 3) + (mesh->n_quads * 6)) * sizeof(vertex_3d_t), MEM_CAT_MODEL);
-
-        // Copy the vertex texture ids to each vertex instead of just the first. OpenGL is annoying about this.
-        size_t k = 0;
-        size_t l = 0;
-        for (size_t j = 0; j < mesh->n_triangles; ++j) {
-            mesh->vertices[k + 1].tex_id = mesh->vertices[k + 0].tex_id;
-            mesh->vertices[k + 2].tex_id = mesh->vertices[k + 0].tex_id;
-            new_verts[l + 0] = mesh->vertices[k + 0];
-            new_verts[l + 1] = mesh->vertices[k + 1];
-            new_verts[l + 2] = mesh->vertices[k + 2];
-            k += 3;
-            l += 3;
+        const size_t n_mesh_vertices = ((size_t)mesh->n_triangles * 3) + ((size_t)mesh->n_quads * 4);
+        const size_t n_mesh_indices = ((size_t)mesh->n_triangles * 3) + ((size_t)mesh->n_quads * 6);
+        uint16_t* indices = NULL;
+        if (on_stack) {
+            indices = mem_stack_alloc(n_mesh_indices * sizeof(uint16_t), stack);
         }
-        for (size_t j = 0; j < mesh->n_quads; ++j) {
-            mesh->vertices[k + 1].tex_id = mesh->vertices[k + 0].tex_id;
-            mesh->vertices[k + 2].tex_id = mesh->vertices[k + 0].tex_id;
-            mesh->vertices[k + 3].tex_id = mesh->vertices[k + 0].tex_id;
-            new_verts[l + 0] = mesh->vertices[k + 0];
-            new_verts[l + 1] = mesh->vertices[k + 1];
-            new_verts[l + 2] = mesh->vertices[k + 2];
-            new_verts[l + 3] = mesh->vertices[k + 2];
-            new_verts[l + 4] = mesh->vertices[k + 1];
-            new_verts[l + 5] = mesh->vertices[k + 3];
-            k += 4;
-            l += 6;
+        else {
+            indices = mem_alloc(n_mesh_indices * sizeof(uint16_t), MEM_CAT_MESH);
         }
-        mesh->vertices = new_verts;
-        mesh->n_triangles += mesh->n_quads * 2;
-        mesh->n_quads = 0;
+        uint32_t hash_table_size = 16;
+        while (hash_table_size < n_mesh_vertices * 2) hash_table_size *= 2;
+        mesh_build_indices(mesh, indices, hash_table, hash_table_size);
+        n_vertices_before += n_mesh_indices;
+        n_vertices_after += mesh->n_vertices;
+        n_indices_after += (size_t)mesh->n_triangles * 3;
+
+        // Put it on the GPU once, instead of every time it's drawn
+        mesh->gpu_vertex_start = -1;
+        if (on_stack) renderer_upload_mesh(mesh, stack);
     }
-    printf("done with model %s\n", path);
+    mem_free(hash_table);
+
+    printf("[INFO] Loaded model %s: %u vertices + %u indices (%u KiB), %u KiB as a triangle list\n", path,
+        (unsigned)n_vertices_after,
+        (unsigned)n_indices_after,
+        (unsigned)((n_vertices_after * sizeof(vertex_3d_t) + n_indices_after * sizeof(uint16_t)) / 1024),
+        (unsigned)((n_vertices_before * sizeof(vertex_3d_t)) / 1024)
+    );
     return model;
 }
 
@@ -145,6 +223,9 @@ model_t* model_load_collision_debug(const char* path, int on_stack, stack_t stac
     model->n_meshes = 1;
     model->meshes[0].n_quads = 0;
     model->meshes[0].n_triangles = col_mesh->n_verts / 3;
+    model->meshes[0].indices = NULL;
+    model->meshes[0].n_vertices = col_mesh->n_verts;
+    model->meshes[0].gpu_vertex_start = -1;
 
     // Since collision model is only meant to be see in the level 
     // editor, don't bother calculating bounding boxes for culling
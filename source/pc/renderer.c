@@ -8,11 +8,14 @@
 #include <cglm/vec3.h>
 #include <cglm/cam.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 
 #include "debug_layer.h"
+#include "texture_convert.h"
+#include "frustum.h"
 #include "memory.h"
 #include "input.h"
 #include "file.h"
@@ -21,6 +24,31 @@
 
 #define PI 3.14159265358979f
 #define RESOLUTION_SCALING 4
+#define BILLBOARD_MAX_QUADS 8192 // Per blend mode, per flush
+#define DYNAMIC_RES_BASE_W 512
+#define DYNAMIC_RES_BASE_H 240
+#define DYNAMIC_RES_DOWNSCALE_AT 90 // Percent of the frame budget. Go down a step once the frame time gets above this
+#define DYNAMIC_RES_UPSCALE_AT 75 // Only go up a step if the frame time at the next scale is expected to stay below this
+#define DYNAMIC_RES_COOLDOWN_FRAMES 30 // Let the average settle after a change before deciding again
+#define DYNAMIC_RES_N_QUERIES 4
+#define VERTEX_ARENA_SIZE_LEVEL (1536 * 1024) // In vertices
+#define VERTEX_ARENA_SIZE_ENTITY (512 * 1024) // In vertices
+#define INDEX_ARENA_SIZE_LEVEL (1536 * 1024) // In indices
+#define INDEX_ARENA_SIZE_ENTITY (512 * 1024) // In indices
+#define DEBUG_LINE_MAX_LINES 65536 // Per flush
+#define DEBUG_LINE_MAX_GROUPS 64
+#define RENDER_QUEUE_MAX_COMMANDS 4096 // Per flush
+#define RENDER_QUEUE_MAX_VERTICES (256 * 1024) // Streamed vertices, per flush
+#define RENDER_QUEUE_MAX_MULTI_DRAWS 4096 // Index ranges for glMultiDrawElementsBaseVertex, per flush
+#define RENDER_QUEUE_MAX_INSTANCES 4096 // Model matrices for instanced draws, per flush
+
+// World space vertex for billboards. Same attribute layout as vertex_3d_t, except for the float position
+typedef struct {
+	float x, y, z;
+	uint8_t r, g, b;
+	uint8_t u, v, tex_id;
+	uint8_t padding[2];
+} billboard_vertex_t;
 GLFWwindow *window;
 mat4 perspective_matrix;
 mat4 view_matrix;
@@ -31,13 +59,19 @@ GLuint shader_gouraud;
 GLuint shader_blit;
 GLuint vao;
 GLuint vbo;
+GLuint vao_billboard;
+GLuint vbo_billboard;
+GLuint vao_arena;
+GLuint vbo_arena;
+GLuint ibo_arena;
+GLuint ssbo_instances;
+GLuint ubo_frame;
 clock_t dt_clock;
 GLuint textures;
 float tex_res[512];
 clock_t dt = 0;
 float dt_ms_float = 0;
 int dt_ms_int = 0;
-uint32_t n_total_triangles = 0;
 int render_w = 512;
 int render_h = 240;
 int prev_render_w = 0;
@@ -52,7 +86,128 @@ vec3_t camera_pos;
 vec3_t camera_dir;
 extern uint8_t tex_id_start;
 int curr_depth_bias = 0;
-int n_meshes_drawn = 0;
+frustum_t frustum;
+
+// Billboards get collected here during the frame, one batch per blend mode, and drawn all at once in renderer_end_frame()
+static billboard_vertex_t billboard_vertices[BLEND_MODE_COUNT][BILLBOARD_MAX_QUADS * 6];
+static int billboard_n_quads[BLEND_MODE_COUNT];
+static void renderer_flush_billboards(void);
+
+// Debug lines get collected during the frame too, and drawn with one draw call per transform and depth bias
+typedef struct {
+	transform_t transform;
+	int depth_bias;
+	int n_lines;
+} debug_line_group_t;
+static line_3d_t debug_lines[DEBUG_LINE_MAX_LINES];
+static line_3d_t debug_lines_sorted[DEBUG_LINE_MAX_LINES];
+static uint8_t debug_line_group_index[DEBUG_LINE_MAX_LINES];
+static debug_line_group_t debug_line_groups[DEBUG_LINE_MAX_GROUPS];
+static int debug_line_n_lines = 0;
+static int debug_line_n_groups = 0;
+static void renderer_flush_debug_lines(void);
+
+// Meshes and 2D quads are queued during the frame, then sorted and drawn in renderer_flush(), so state only changes between groups of draws
+typedef enum {
+	RENDER_PASS_WORLD,
+	RENDER_PASS_LOCAL,
+	RENDER_PASS_SCREEN,
+} render_pass_t;
+
+typedef struct {
+	mat4 model_matrix;
+	GLint first_vertex; // Base vertex in the vertex arena if the mesh is resident, otherwise into render_queue_vertices
+	GLsizei n_vertices; // Streamed triangle list vertices
+	GLint first_index; // Into the index arena, resident meshes only
+	GLsizei n_indices;
+	int multi_draw_start; // If n_multi_draws isn't 0, the command draws these index ranges from the arenas instead
+	int n_multi_draws;
+	int first_instance; // If n_instances isn't 0, the command draws the mesh once per model matrix in render_queue_instance_matrices
+	int n_instances;
+	int depth_bias;
+	int texture_offset;
+	float alpha;
+	uint8_t pass;
+	uint8_t view_mode;
+	uint8_t is_resident;
+	uint8_t texture_bound;
+	uint8_t texture_is_page;
+	uint8_t blend;
+	uint8_t stencil_ref;
+} render_command_t;
+static render_command_t render_queue[RENDER_QUEUE_MAX_COMMANDS];
+static uint64_t render_queue_keys[RENDER_QUEUE_MAX_COMMANDS]; // Sort key in the upper bits, command index in the lower 16
+static vertex_3d_t render_queue_vertices[RENDER_QUEUE_MAX_VERTICES];
+static int render_queue_n_commands = 0;
+static int render_queue_n_vertices = 0;
+static const void* render_queue_multi_indices[RENDER_QUEUE_MAX_MULTI_DRAWS]; // Byte offsets into the index arena
+static GLsizei render_queue_multi_count[RENDER_QUEUE_MAX_MULTI_DRAWS];
+static GLint render_queue_multi_base_vertex[RENDER_QUEUE_MAX_MULTI_DRAWS];
+static int render_queue_n_multi_draws = 0;
+static mat4 render_queue_instance_matrices[RENDER_QUEUE_MAX_INSTANCES];
+static int render_queue_n_instances = 0;
+
+// Static mesh vertices and indices live in two big GPU buffers, split into a section per memory stack. Each section is a bump allocator
+// that starts over once its stack has been released, the same way the CPU side copy of the mesh does
+static const GLint vertex_arena_section_start[N_STACK_TYPES] = { [STACK_LEVEL] = 0, [STACK_ENTITY] = VERTEX_ARENA_SIZE_LEVEL };
+static const GLint vertex_arena_section_size[N_STACK_TYPES] = { [STACK_LEVEL] = VERTEX_ARENA_SIZE_LEVEL, [STACK_ENTITY] = VERTEX_ARENA_SIZE_ENTITY };
+static GLint vertex_arena_section_cursor[N_STACK_TYPES];
+static const GLint index_arena_section_start[N_STACK_TYPES] = { [STACK_LEVEL] = 0, [STACK_ENTITY] = INDEX_ARENA_SIZE_LEVEL };
+static const GLint index_arena_section_size[N_STACK_TYPES] = { [STACK_LEVEL] = INDEX_ARENA_SIZE_LEVEL, [STACK_ENTITY] = INDEX_ARENA_SIZE_ENTITY };
+static GLint index_arena_section_cursor[N_STACK_TYPES];
+static uint32_t vertex_arena_section_generation[N_STACK_TYPES];
+
+// Everything that stays the same for the whole frame, matches the frame_data block in GOURAUD.VSH (std140)
+typedef struct {
+	mat4 proj_matrix;
+	mat4 view_matrix;
+	mat4 view_matrix_local;
+	mat4 screen_matrix;
+	GLint curr_depth_bias;
+	GLint padding[3];
+} frame_uniforms_t;
+
+typedef enum {
+	VIEW_MODE_WORLD,
+	VIEW_MODE_LOCAL,
+	VIEW_MODE_SCREEN,
+} view_mode_t;
+
+// Uniform locations are looked up once at init. The last value sent is kept, so unchanged uniforms don't get sent again
+static struct {
+	GLint model_matrix;
+	GLint view_mode;
+	GLint texture_bound;
+	GLint texture_offset;
+	GLint texture_is_page;
+	GLint depth_bias_offset;
+	GLint alpha;
+	GLint instance_offset;
+} gouraud_locations;
+static struct {
+	int view_mode;
+	int texture_bound;
+	int texture_offset;
+	int texture_is_page;
+	int depth_bias_offset;
+	float alpha;
+	int instance_offset;
+} gouraud_values;
+static frame_uniforms_t frame_uniforms;
+
+static void gouraud_set_int(const GLint location, int* cached, const int value) {
+	if (*cached == value) return;
+	*cached = value;
+	glUniform1i(location, value);
+	++renderer_stats.n_state_changes;
+}
+
+static void gouraud_set_float(const GLint location, float* cached, const float value) {
+	if (*cached == value) return;
+	*cached = value;
+	glUniform1f(location, value);
+	++renderer_stats.n_state_changes;
+}
 
 // todo: i can probably make this more clean
 // Need to define these somewhere so it compiles, unused in Windows build
@@ -263,6 +418,109 @@ int renderer_height(void) {
     return render_h;
 }
 
+double lasttime = 0.0;
+
+#ifndef _LEVEL_EDITOR
+static renderer_dynamic_res_t dynamic_res;
+static GLuint dynamic_res_queries[DYNAMIC_RES_N_QUERIES];
+static int dynamic_res_query_cursor = 0; // Next query to start
+static int dynamic_res_n_queries_pending = 0; // Queries that were started but haven't been read back yet
+static int dynamic_res_query_active = 0;
+static int dynamic_res_cooldown = 0;
+
+static void dynamic_res_apply(void) {
+	const int scale = dynamic_res.scale_percent[dynamic_res.bucket];
+	render_w = ((DYNAMIC_RES_BASE_W * scale) / 100) & ~1;
+	render_h = ((DYNAMIC_RES_BASE_H * scale) / 100) & ~1;
+}
+
+static void dynamic_res_init(void) {
+	memset(&dynamic_res, 0, sizeof(dynamic_res));
+	for (int i = 0; i < DYNAMIC_RES_N_BUCKETS; ++i) {
+		dynamic_res.scale_percent[i] = DYNAMIC_RES_MIN_SCALE + (i * DYNAMIC_RES_STEP);
+	}
+	dynamic_res.bucket = DYNAMIC_RES_N_BUCKETS - 1;
+	dynamic_res.enabled = 1;
+	glGenQueries(DYNAMIC_RES_N_QUERIES, dynamic_res_queries);
+	dynamic_res_apply();
+}
+
+static void dynamic_res_begin_frame(void) {
+	// If the GPU is so far behind that every query is still in flight, this frame just doesn't get timed
+	if (dynamic_res_query_active || dynamic_res_n_queries_pending >= DYNAMIC_RES_N_QUERIES) return;
+	glBeginQuery(GL_TIME_ELAPSED, dynamic_res_queries[dynamic_res_query_cursor]);
+	dynamic_res_query_active = 1;
+}
+
+static void dynamic_res_end_frame(void) {
+	if (dynamic_res_query_active) {
+		glEndQuery(GL_TIME_ELAPSED);
+		dynamic_res_query_cursor = (dynamic_res_query_cursor + 1) % DYNAMIC_RES_N_QUERIES;
+		++dynamic_res_n_queries_pending;
+		dynamic_res_query_active = 0;
+	}
+
+	// Read back whatever the GPU has finished, oldest first, without waiting for the rest
+	while (dynamic_res_n_queries_pending > 0) {
+		const GLuint query = dynamic_res_queries[(dynamic_res_query_cursor - dynamic_res_n_queries_pending + DYNAMIC_RES_N_QUERIES) % DYNAMIC_RES_N_QUERIES];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+		GLuint64 time_ns = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &time_ns);
+		dynamic_res.gpu_us = (uint32_t)(time_ns / 1000);
+		--dynamic_res_n_queries_pending;
+	}
+
+	dynamic_res.cpu_us = (uint32_t)((glfwGetTime() - lasttime) * 1000000.0);
+	dynamic_res.time_ms[dynamic_res.bucket] += dt_ms_int;
+	dynamic_res.target_us = (1000000 * (vsync_enable > 1 ? vsync_enable : 1)) / DYNAMIC_RES_TARGET_FPS;
+	const int32_t sample_us = (int32_t)(dynamic_res.cpu_us + dynamic_res.gpu_us);
+	if (dynamic_res.smoothed_us == 0) dynamic_res.smoothed_us = sample_us;
+	else dynamic_res.smoothed_us += (sample_us - (int32_t)dynamic_res.smoothed_us) / 8;
+
+	if (!dynamic_res.enabled) return;
+	if (dynamic_res_cooldown > 0) {
+		--dynamic_res_cooldown;
+		return;
+	}
+
+	// The gap between the two thresholds keeps it from going back and forth between two scales
+	int bucket = dynamic_res.bucket;
+	const uint64_t smoothed_us = dynamic_res.smoothed_us;
+	const uint64_t target_us = dynamic_res.target_us;
+	if (smoothed_us * 100 > target_us * DYNAMIC_RES_DOWNSCALE_AT && bucket > 0) {
+		--bucket;
+	}
+	else if (bucket < DYNAMIC_RES_N_BUCKETS - 1) {
+		// Assume the whole frame scales with the pixel count. It doesn't, but that only makes it more careful
+		const uint64_t curr_scale = dynamic_res.scale_percent[bucket];
+		const uint64_t next_scale = dynamic_res.scale_percent[bucket + 1];
+		const uint64_t predicted_us = (smoothed_us * next_scale * next_scale) / (curr_scale * curr_scale);
+		if (predicted_us * 100 < target_us * DYNAMIC_RES_UPSCALE_AT) ++bucket;
+	}
+
+	if (bucket != dynamic_res.bucket) {
+		dynamic_res.bucket = bucket;
+		dynamic_res_apply();
+		dynamic_res_cooldown = DYNAMIC_RES_COOLDOWN_FRAMES;
+	}
+}
+
+const renderer_dynamic_res_t* renderer_get_dynamic_res(void) {
+	return &dynamic_res;
+}
+
+void renderer_set_dynamic_res_enabled(int enabled) {
+	dynamic_res.enabled = enabled;
+	if (!enabled) {
+		dynamic_res.bucket = DYNAMIC_RES_N_BUCKETS - 1;
+		dynamic_res_apply();
+	}
+	dynamic_res_cooldown = DYNAMIC_RES_COOLDOWN_FRAMES;
+}
+#endif
+
 void renderer_init(void) {
 	// Create OpenGL window
 	glfwInit();
@@ -288,6 +546,37 @@ void renderer_init(void) {
 	shader_gouraud = shader_from_file("GOURAUD.VSH", "GOURAUD.FSH");
 	shader_blit = shader_from_file("BLIT.VSH", "BLIT.FSH");
 
+	// Look up the gouraud shader's uniforms once. The cached values start out invalid, so the first draw sends everything
+	gouraud_locations.model_matrix = glGetUniformLocation(shader_gouraud, "model_matrix");
+	gouraud_locations.view_mode = glGetUniformLocation(shader_gouraud, "view_mode");
+	gouraud_locations.texture_bound = glGetUniformLocation(shader_gouraud, "texture_bound");
+	gouraud_locations.texture_offset = glGetUniformLocation(shader_gouraud, "texture_offset");
+	gouraud_locations.texture_is_page = glGetUniformLocation(shader_gouraud, "texture_is_page");
+	gouraud_locations.depth_bias_offset = glGetUniformLocation(shader_gouraud, "depth_bias_offset");
+	gouraud_locations.alpha = glGetUniformLocation(shader_gouraud, "alpha");
+	gouraud_locations.instance_offset = glGetUniformLocation(shader_gouraud, "instance_offset");
+	gouraud_values.view_mode = -1;
+	gouraud_values.texture_bound = -1;
+	gouraud_values.texture_offset = -1;
+	gouraud_values.texture_is_page = -1;
+	gouraud_values.depth_bias_offset = INT32_MIN;
+	gouraud_values.alpha = -1.0f;
+	gouraud_values.instance_offset = INT32_MIN;
+
+	// Set up the per-frame uniform buffer. The local and screen space view matrices never change
+	memset(&frame_uniforms, 0, sizeof(frame_uniforms));
+	glm_mat4_identity(frame_uniforms.view_matrix_local);
+	frame_uniforms.view_matrix_local[1][1] = -1.0f;
+	frame_uniforms.view_matrix_local[2][2] = -1.0f;
+	glm_mat4_identity(frame_uniforms.screen_matrix);
+	frame_uniforms.screen_matrix[0][0] = 1.0f / 256.0f;
+	frame_uniforms.screen_matrix[1][1] = -2.0f / 240.0f;
+	frame_uniforms.screen_matrix[2][2] = 1.0f / 256.0f;
+	glGenBuffers(1, &ubo_frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo_frame);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_uniforms), &frame_uniforms, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, ubo_frame);
+
 	// Set up VAO and VBO
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
@@ -302,12 +591,56 @@ void renderer_init(void) {
 	glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(vertex_3d_t), (const void *)offsetof(vertex_3d_t, u));
 	glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(vertex_3d_t), (const void *)offsetof(vertex_3d_t, tex_id));
 
+	// Set up the streaming VAO and VBO for billboards
+	glGenVertexArrays(1, &vao_billboard);
+	glBindVertexArray(vao_billboard);
+	glGenBuffers(1, &vbo_billboard);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_billboard);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(billboard_vertices), NULL, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(billboard_vertex_t), (const void *)offsetof(billboard_vertex_t, x));
+	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(billboard_vertex_t), (const void *)offsetof(billboard_vertex_t, r));
+	glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(billboard_vertex_t), (const void *)offsetof(billboard_vertex_t, u));
+	glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(billboard_vertex_t), (const void *)offsetof(billboard_vertex_t, tex_id));
+
+	// Set up the vertex arena for static meshes
+	glGenVertexArrays(1, &vao_arena);
+	glBindVertexArray(vao_arena);
+	glGenBuffers(1, &vbo_arena);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_arena);
+	glBufferData(GL_ARRAY_BUFFER, (VERTEX_ARENA_SIZE_LEVEL + VERTEX_ARENA_SIZE_ENTITY) * sizeof(vertex_3d_t), NULL, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(vertex_3d_t), (const void *)offsetof(vertex_3d_t, x));
+	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex_3d_t), (const void *)offsetof(vertex_3d_t, r));
+	glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(vertex_3d_t), (const void *)offsetof(vertex_3d_t, u));
+	glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(vertex_3d_t), (const void *)offsetof(vertex_3d_t, tex_id));
+	glGenBuffers(1, &ibo_arena);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo_arena);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (INDEX_ARENA_SIZE_LEVEL + INDEX_ARENA_SIZE_ENTITY) * sizeof(uint16_t), NULL, GL_STATIC_DRAW);
+	glBindVertexArray(vao);
+
+	// Model matrices for instanced draws, refilled every flush
+	glGenBuffers(1, &ssbo_instances);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_instances);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(render_queue_instance_matrices), NULL, GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo_instances);
+
 	// Initialize delta time clock
 	dt_clock = clock();
 
 	// Initialize ImGui
 	debug_layer_init(window);
 
+#ifndef _LEVEL_EDITOR
+	dynamic_res_init();
+#endif
+
 	// Zero init textures
     void* random_data = mem_alloc(2048 * 512 * 4, MEM_CAT_TEXTURE);
 	glGenTextures(1, &textures);
@@ -348,12 +681,19 @@ void renderer_init(void) {
     glBindTexture(GL_TEXTURE_2D, 0);
 
 	glfwGetWindowSize(window, &window_w, &window_h);
+
+#ifdef BENCHMARK_MODE
+	texture_convert_benchmark();
+#endif
 }
-double lasttime = 0.0;
 void renderer_begin_frame(const transform_t *camera_transform) {
+	renderer_stats_begin_frame();
 	curr_depth_bias = 0;
     cam_transform = *camera_transform;
 	lasttime = glfwGetTime();
+#ifndef _LEVEL_EDITOR
+	dynamic_res_begin_frame();
+#endif
 	// Set up viewport
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 	glViewport(0, 0, render_w, render_h);
@@ -387,6 +727,8 @@ void renderer_begin_frame(const transform_t *camera_transform) {
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, fb_depth, 0);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, fb_depth, 0);
 		glBindTexture(GL_TEXTURE_2D, 0);
+		prev_render_w = render_w;
+		prev_render_h = render_h;
 	}
 
 	// Convert from PS1 to GLM
@@ -451,16 +793,30 @@ void renderer_begin_frame(const transform_t *camera_transform) {
         memcpy(view_matrix, view_matrix_normal, sizeof(view_matrix_normal));
     }
 
+	// 90 degree vertical field of view. The debug views see more than the camera does, so don't cull anything for those
+	frustum = frustum_from_camera(camera_transform, scalar_from_float(aspect), ONE, 0);
+#ifndef _LEVEL_EDITOR
+	if (input_held(PAD_SQUARE, 0) || input_held(PAD_TRIANGLE, 0)) frustum.n_planes = 0;
+#endif
+
 	camera_dir.x = -view_matrix_normal[2][0] * 4096.f;
 	camera_dir.y = -view_matrix_normal[2][1] * 4096.f;
 	camera_dir.z = -view_matrix_normal[2][2] * 4096.f;
 	memcpy(&camera_pos, &camera_transform->position, sizeof(camera_pos));
 
-	n_total_triangles = 0;
+	// Upload this frame's matrices
+	memcpy(frame_uniforms.proj_matrix, perspective_matrix, sizeof(mat4));
+	memcpy(frame_uniforms.view_matrix, view_matrix, sizeof(mat4));
+	frame_uniforms.curr_depth_bias = curr_depth_bias;
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo_frame);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame_uniforms), &frame_uniforms);
+	renderer_set_phase(RENDERER_PHASE_OTHER);
 }
 
 void renderer_end_frame(void) {
+	renderer_set_phase(RENDERER_PHASE_END_FRAME);
     renderer_tick_fade();
+	renderer_flush();
 	
 	update_delta_time_ms();
 
@@ -476,24 +832,267 @@ void renderer_end_frame(void) {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glBindTexture(GL_TEXTURE_2D, fb_texture);
 	glDrawArrays(GL_TRIANGLES, 0, 3);
+	++renderer_stats.n_draw_calls;
 	glUseProgram(0);
+
+	debug_layer_update_gameplay();
+	dynamic_res_end_frame();
 #endif
 
 	// Flip buffers
 	glfwSwapInterval(vsync_enable);
 	glfwSwapBuffers(window);
 	glfwPollEvents();
+	renderer_stats_end_frame();
 }
 
-int32_t max_dot_value = 0;
-void renderer_draw_mesh_shaded(const mesh_t *mesh, const transform_t *model_transform, int local, int facing_camera, int tex_id_offset) {
-	++n_meshes_drawn;
+void renderer_upload_mesh(mesh_t* mesh, stack_t stack) {
+	mesh->gpu_vertex_start = -1;
+	if (stack >= N_STACK_TYPES || vertex_arena_section_size[stack] == 0 || mesh->indices == NULL || mesh->n_quads != 0) return;
 
-	// Calculate model matrix
-	mat4 model_matrix;
+	// The stack got released since the last upload, so everything in this section is stale now
+	const uint32_t generation = mem_stack_get_generation(stack);
+	if (vertex_arena_section_generation[stack] != generation) {
+		vertex_arena_section_generation[stack] = generation;
+		vertex_arena_section_cursor[stack] = 0;
+		index_arena_section_cursor[stack] = 0;
+	}
+
+	const GLint n_vertices = (GLint)mesh->n_vertices;
+	const GLint n_indices = mesh->n_triangles * 3;
+	if (vertex_arena_section_cursor[stack] + n_vertices > vertex_arena_section_size[stack] || index_arena_section_cursor[stack] + n_indices > index_arena_section_size[stack]) {
+		printf("[ERROR] Vertex arena for stack %i is full, mesh '%s' will be streamed every draw instead\n", stack, mesh->name);
+		return;
+	}
+
+	const GLint first_vertex = vertex_arena_section_start[stack] + vertex_arena_section_cursor[stack];
+	const GLint first_index = index_arena_section_start[stack] + index_arena_section_cursor[stack];
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_arena);
+	glBufferSubData(GL_ARRAY_BUFFER, first_vertex * sizeof(vertex_3d_t), n_vertices * sizeof(vertex_3d_t), mesh->vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+	// The element buffer binding is part of the VAO
+	glBindVertexArray(vao_arena);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, first_index * sizeof(uint16_t), n_indices * sizeof(uint16_t), mesh->indices);
+	glBindVertexArray(vao);
+	vertex_arena_section_cursor[stack] += n_vertices;
+	index_arena_section_cursor[stack] += n_indices;
+	renderer_stats.n_buffer_bytes_uploaded += n_vertices * sizeof(vertex_3d_t) + n_indices * sizeof(uint16_t);
+
+	mesh->gpu_vertex_start = first_vertex;
+	mesh->gpu_index_start = first_index;
+	mesh->gpu_generation = generation;
+	mesh->gpu_stack = (uint8_t)stack;
+}
+
+static int renderer_mesh_is_resident(const mesh_t* mesh) {
+	if (mesh->gpu_vertex_start < 0) return 0;
+	return mesh->gpu_generation == mem_stack_get_generation(mesh->gpu_stack);
+}
+
+// Meshes that aren't resident get drawn as a plain triangle list from the streaming buffer
+static void renderer_stream_mesh_vertices(const mesh_t* mesh, vertex_3d_t* out) {
+	if (mesh->indices) {
+		for (int i = 0; i < mesh->n_triangles * 3; ++i) {
+			out[i] = mesh->vertices[mesh->indices[i]];
+		}
+		return;
+	}
+
+	const int n_triangle_vertices = mesh->n_triangles * 3;
+	memcpy(out, mesh->vertices, n_triangle_vertices * sizeof(vertex_3d_t));
+	const vertex_3d_t* quad = &mesh->vertices[n_triangle_vertices];
+	out += n_triangle_vertices;
+	for (int i = 0; i < mesh->n_quads; ++i) {
+		out[0] = quad[0];
+		out[1] = quad[1];
+		out[2] = quad[2];
+		out[3] = quad[2];
+		out[4] = quad[1];
+		out[5] = quad[3];
+		quad += 4;
+		out += 6;
+	}
+}
+
+static render_command_t* renderer_queue_command(const int n_streamed_vertices) {
+	PANIC_IF("mesh has too many vertices for the render queue", n_streamed_vertices > RENDER_QUEUE_MAX_VERTICES);
+
+	// Out of space, so draw what we have so far. This can put things drawn later in the frame behind the UI, but only when the queue overflows
+	if (render_queue_n_commands == RENDER_QUEUE_MAX_COMMANDS || render_queue_n_vertices + n_streamed_vertices > RENDER_QUEUE_MAX_VERTICES) {
+		renderer_flush();
+	}
+
+	render_command_t* command = &render_queue[render_queue_n_commands++];
+	command->first_vertex = render_queue_n_vertices;
+	command->n_multi_draws = 0;
+	command->n_instances = 0;
+	command->depth_bias = curr_depth_bias;
+	command->stencil_ref = 255;
+	render_queue_n_vertices += n_streamed_vertices;
+	return command;
+}
+
+static uint64_t renderer_command_sort_key(const render_command_t* command, const int index) {
+	// Screen space quads are blended, so they keep the order they were drawn in
+	if (command->pass == RENDER_PASS_SCREEN) {
+		return ((uint64_t)command->pass << 62) | (uint64_t)index;
+	}
+
+	// There's only one shader for these, so after the pass and depth bias, sort by everything that needs a state change
+	return ((uint64_t)command->pass << 62)
+		| ((uint64_t)(uint16_t)(command->depth_bias + 0x8000) << 46)
+		| ((uint64_t)command->is_resident << 45)
+		| ((uint64_t)command->texture_bound << 44)
+		| ((uint64_t)command->texture_is_page << 43)
+		| ((uint64_t)(uint8_t)command->texture_offset << 35)
+		| ((uint64_t)command->stencil_ref << 27)
+		| (uint64_t)index;
+}
+
+static int renderer_compare_sort_keys(const void* a, const void* b) {
+	const uint64_t key_a = *(const uint64_t*)a;
+	const uint64_t key_b = *(const uint64_t*)b;
+	return (key_a > key_b) - (key_a < key_b);
+}
+
+// Draws the sorted commands starting at cursor, until it reaches one from end_pass or later. Returns where it stopped
+static int renderer_execute_queue(int cursor, const render_pass_t end_pass) {
+	if (cursor >= render_queue_n_commands) return cursor;
+	if ((render_queue_keys[cursor] >> 62) >= end_pass) return cursor;
+
+	// State that's the same for every command
+	glUseProgram(shader_gouraud);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, render_w, render_h);
+	glBindTexture(GL_TEXTURE_2D, textures);
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	renderer_stats.n_state_changes += 6;
+#ifdef _LEVEL_EDITOR
+	glEnable(GL_STENCIL_TEST);
+	glStencilMask(0xFF);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	renderer_stats.n_state_changes += 1;
+#endif
+
+	// Only change what differs from the previous command
+	GLuint curr_vao = 0;
+	int curr_blend = -1;
+#ifdef _LEVEL_EDITOR
+	int curr_stencil_ref = -1;
+#endif
+	const float* curr_model_matrix = NULL;
+
+	for (; cursor < render_queue_n_commands; ++cursor) {
+		if ((render_queue_keys[cursor] >> 62) >= end_pass) break;
+		const render_command_t* command = &render_queue[render_queue_keys[cursor] & 0xFFFF];
+
+		const GLuint command_vao = command->is_resident ? vao_arena : vao;
+		if (command_vao != curr_vao) {
+			glBindVertexArray(command_vao);
+			curr_vao = command_vao;
+			++renderer_stats.n_state_changes;
+		}
+
+		if (command->blend != curr_blend) {
+			if (command->blend) glEnable(GL_BLEND);
+			else glDisable(GL_BLEND);
+			curr_blend = command->blend;
+			++renderer_stats.n_state_changes;
+		}
+
+#ifdef _LEVEL_EDITOR
+		if (command->stencil_ref != curr_stencil_ref) {
+			glStencilFunc(GL_ALWAYS, command->stencil_ref, 0xFF);
+			curr_stencil_ref = command->stencil_ref;
+			++renderer_stats.n_state_changes;
+		}
+#endif
+
+		// Level sections and UI quads tend to share a model matrix
+		if (curr_model_matrix == NULL || memcmp(curr_model_matrix, command->model_matrix, sizeof(mat4)) != 0) {
+			glUniformMatrix4fv(gouraud_locations.model_matrix, 1, GL_FALSE, &command->model_matrix[0][0]);
+			curr_model_matrix = &command->model_matrix[0][0];
+			++renderer_stats.n_state_changes;
+		}
+
+		// The frame uniforms hold the depth bias at flush time, so correct for the bias the command was queued with
+		gouraud_set_int(gouraud_locations.view_mode, &gouraud_values.view_mode, command->view_mode);
+		gouraud_set_int(gouraud_locations.texture_bound, &gouraud_values.texture_bound, command->texture_bound);
+		gouraud_set_int(gouraud_locations.texture_offset, &gouraud_values.texture_offset, command->texture_offset);
+		gouraud_set_int(gouraud_locations.texture_is_page, &gouraud_values.texture_is_page, command->texture_is_page);
+		gouraud_set_int(gouraud_locations.depth_bias_offset, &gouraud_values.depth_bias_offset, command->depth_bias - curr_depth_bias);
+		gouraud_set_float(gouraud_locations.alpha, &gouraud_values.alpha, command->alpha);
+		gouraud_set_int(gouraud_locations.instance_offset, &gouraud_values.instance_offset, command->n_instances > 0 ? command->first_instance : -1);
+
+		// Draw
+		if (command->n_instances > 0) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command->n_indices, GL_UNSIGNED_SHORT, (const void*)(command->first_index * sizeof(uint16_t)), command->n_instances, command->first_vertex);
+			++renderer_stats.n_draw_calls;
+		}
+		else if (command->n_multi_draws > 0) {
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+				&render_queue_multi_count[command->multi_draw_start],
+				GL_UNSIGNED_SHORT,
+				&render_queue_multi_indices[command->multi_draw_start],
+				command->n_multi_draws,
+				&render_queue_multi_base_vertex[command->multi_draw_start]
+			);
+			++renderer_stats.n_draw_calls;
+		}
+		else if (command->is_resident) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, command->n_indices, GL_UNSIGNED_SHORT, (const void*)(command->first_index * sizeof(uint16_t)), command->first_vertex);
+			++renderer_stats.n_draw_calls;
+		}
+		else if (command->n_vertices > 0) {
+			glDrawArrays(GL_TRIANGLES, command->first_vertex, command->n_vertices);
+			++renderer_stats.n_draw_calls;
+		}
+	}
+
+	glDisable(GL_BLEND);
+	glBindVertexArray(vao);
+	return cursor;
+}
+
+void renderer_flush(void) {
+	// Debug lines share the streaming buffer with the queue, so they have to go first
+	renderer_flush_debug_lines();
+
+	if (render_queue_n_commands > 0) {
+		if (render_queue_n_vertices > 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, render_queue_n_vertices * sizeof(vertex_3d_t), render_queue_vertices, GL_STREAM_DRAW);
+			renderer_stats.n_buffer_bytes_uploaded += render_queue_n_vertices * sizeof(vertex_3d_t);
+		}
+		if (render_queue_n_instances > 0) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_instances);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, render_queue_n_instances * sizeof(mat4), render_queue_instance_matrices);
+			renderer_stats.n_buffer_bytes_uploaded += render_queue_n_instances * sizeof(mat4);
+		}
+		for (int i = 0; i < render_queue_n_commands; ++i) {
+			render_queue_keys[i] = renderer_command_sort_key(&render_queue[i], i);
+		}
+		qsort(render_queue_keys, render_queue_n_commands, sizeof(uint64_t), renderer_compare_sort_keys);
+	}
+
+	// Billboards get blended with the scene, but the UI goes on top of them
+	const int cursor = renderer_execute_queue(0, RENDER_PASS_SCREEN);
+	renderer_flush_billboards();
+	renderer_execute_queue(cursor, RENDER_PASS_SCREEN + 1);
+
+	render_queue_n_commands = 0;
+	render_queue_n_vertices = 0;
+	render_queue_n_multi_draws = 0;
+	render_queue_n_instances = 0;
+}
+
+static void renderer_calculate_model_matrix(const transform_t* model_transform, const int facing_camera, mat4 model_matrix) {
 	glm_mat4_identity(model_matrix);
-    glViewport(0, 0, render_w, render_h);
-    tex_id_start = tex_id_offset;
 
 	// Apply rotation
 	// Apply translation
@@ -532,59 +1131,161 @@ void renderer_draw_mesh_shaded(const mesh_t *mesh, const transform_t *model_tran
 		glm_rotate_y(model_matrix, (float)model_transform->rotation.y * 2 * PI / 131072.0f, model_matrix);
 		glm_rotate_z(model_matrix, (float)model_transform->rotation.z * 2 * PI / 131072.0f, model_matrix);
 	}
+}
 
-	// Bind shader
-	glUseProgram(shader_gouraud);
-
-	// Bind texture
-	glBindTexture(GL_TEXTURE_2D, textures);
+int32_t max_dot_value = 0;
+void renderer_draw_mesh_shaded(const mesh_t *mesh, const transform_t *model_transform, int local, int facing_camera, int tex_id_offset) {
+	// If the mesh's bounding box is not inside the viewing frustum, cull it
+	++renderer_stats.n_meshes_submitted;
+	if (!local && frustum_cull_aabb(&frustum, &mesh->bounds, model_transform, facing_camera)) {
+		++renderer_stats.n_meshes_culled;
+		return;
+	}
 
-	// Bind vertex buffers
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	// Calculate model matrix
+	mat4 model_matrix;
+	renderer_calculate_model_matrix(model_transform, facing_camera, model_matrix);
+    tex_id_start = tex_id_offset;
 
-	// Set matrices
-	glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "proj_matrix"), 1, GL_FALSE, &perspective_matrix[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "model_matrix"), 1, GL_FALSE, &model_matrix[0][0]);
-	if (local) {
-		static const mat4 id_matrix =   {{1.0f, 0.0f, 0.0f, 0.0f},                    \
-                                 		 {0.0f, -1.0f, 0.0f, 0.0f},                    \
-                                 		 {0.0f, 0.0f, -1.0f, 0.0f},                    \
-                                 		 {0.0f, 0.0f, 0.0f, 1.0f}};
-		glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "view_matrix"), 1, GL_FALSE, &id_matrix[0][0]);
+	// Queue the draw, the vertices only need to be copied if they aren't on the GPU already
+	const int is_resident = renderer_mesh_is_resident(mesh);
+	const int n_vertices = (mesh->n_triangles * 3) + (mesh->n_quads * 6);
+	render_command_t* command = renderer_queue_command(is_resident ? 0 : n_vertices);
+	memcpy(command->model_matrix, model_matrix, sizeof(mat4));
+	command->pass = local ? RENDER_PASS_LOCAL : RENDER_PASS_WORLD;
+	command->view_mode = local ? VIEW_MODE_LOCAL : VIEW_MODE_WORLD;
+	command->is_resident = (uint8_t)is_resident;
+	command->n_vertices = n_vertices;
+	command->texture_bound = mesh->vertices[0].tex_id != 255;
+	command->texture_offset = tex_id_start;
+	command->texture_is_page = 0;
+	command->alpha = 1.0f;
+	command->blend = 0;
+#ifdef _LEVEL_EDITOR
+	// The stencil buffer is used to detect clicking on entities in the level editor
+	command->stencil_ref = (uint8_t)drawing_entity_id;
+#endif
+	if (is_resident) {
+		command->first_vertex = mesh->gpu_vertex_start;
+		command->first_index = mesh->gpu_index_start;
+		command->n_indices = mesh->n_triangles * 3;
 	}
 	else {
-		glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "view_matrix"), 1, GL_FALSE, &view_matrix[0][0]);
+		renderer_stream_mesh_vertices(mesh, &render_queue_vertices[command->first_vertex]);
 	}
 
-    glUniform1i(glGetUniformLocation(shader_gouraud, "texture_bound"), mesh->vertices[0].tex_id != 255);
-    glUniform1i(glGetUniformLocation(shader_gouraud, "texture_offset"), tex_id_start);
-	glUniform1i(glGetUniformLocation(shader_gouraud, "texture_is_page"), 0);
-	glUniform1i(glGetUniformLocation(shader_gouraud, "curr_depth_bias"), curr_depth_bias);
-	glUniform1f(glGetUniformLocation(shader_gouraud, "alpha"), 1.0f);
-    
-	// Copy data into it
-	glBufferData(GL_ARRAY_BUFFER, ((mesh->n_triangles * 3) + (mesh->n_quads * 4)) * sizeof(vertex_3d_t), mesh->vertices, GL_STATIC_DRAW);
-
-	// Enable depth, culling
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
+	renderer_stats.n_triangles += mesh->n_triangles;
+	renderer_stats.n_quads += mesh->n_quads;
+    tex_id_start = 0;
 
 #ifdef _LEVEL_EDITOR
-	// Enable stencil, which we use to detect clicking on entities in the level editor
-	glEnable(GL_STENCIL_TEST);
-	glStencilMask(0xFF);
-	glStencilFunc(GL_ALWAYS, drawing_entity_id, 0xFF);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	drawing_entity_id = 255;
 #endif
+}
 
-	// Draw
-	glDrawArrays(GL_TRIANGLES, 0, mesh->n_triangles * 3);
-    glDrawArrays(GL_QUADS, mesh->n_triangles * 3, mesh->n_quads * 4);
+void renderer_draw_mesh_instanced(const mesh_t* mesh, const transform_t* model_transforms, const size_t n_instances, int tex_id_offset) {
+	// Streamed meshes get copied once per draw anyway, so those are drawn one by one
+	if (!renderer_mesh_is_resident(mesh) || n_instances > RENDER_QUEUE_MAX_INSTANCES) {
+		for (size_t i = 0; i < n_instances; ++i) {
+			renderer_draw_mesh_shaded(mesh, &model_transforms[i], 0, 0, tex_id_offset);
+		}
+		return;
+	}
 
-	n_total_triangles += mesh->n_triangles;
-    tex_id_start = 0;
+	// Make sure every instance fits, so the queue can't get flushed halfway through
+	if (render_queue_n_commands + 1 > RENDER_QUEUE_MAX_COMMANDS || render_queue_n_instances + (int)n_instances > RENDER_QUEUE_MAX_INSTANCES) {
+		renderer_flush();
+	}
+
+	// Cull each instance on its own, only the visible ones get a model matrix
+	const int first_instance = render_queue_n_instances;
+	for (size_t i = 0; i < n_instances; ++i) {
+		++renderer_stats.n_meshes_submitted;
+		if (frustum_cull_aabb(&frustum, &mesh->bounds, &model_transforms[i], 0)) {
+			++renderer_stats.n_meshes_culled;
+			continue;
+		}
+		renderer_calculate_model_matrix(&model_transforms[i], 0, render_queue_instance_matrices[render_queue_n_instances++]);
+		renderer_stats.n_triangles += mesh->n_triangles;
+	}
+	if (render_queue_n_instances == first_instance) return;
+
+	render_command_t* command = renderer_queue_command(0);
+	glm_mat4_identity(command->model_matrix);
+	command->pass = RENDER_PASS_WORLD;
+	command->view_mode = VIEW_MODE_WORLD;
+	command->is_resident = 1;
+	command->first_vertex = mesh->gpu_vertex_start;
+	command->n_vertices = 0;
+	command->first_index = mesh->gpu_index_start;
+	command->n_indices = mesh->n_triangles * 3;
+	command->first_instance = first_instance;
+	command->n_instances = render_queue_n_instances - first_instance;
+	command->texture_bound = mesh->vertices[0].tex_id != 255;
+	command->texture_offset = tex_id_offset;
+	command->texture_is_page = 0;
+	command->alpha = 1.0f;
+	command->blend = 0;
+}
+
+void renderer_draw_meshes_shaded(const mesh_t* const* meshes, const size_t n_meshes, const transform_t* model_transform, int tex_id_offset) {
+	// Meshes that aren't in the vertex arena get streamed, so those are drawn one by one
+	for (size_t i = 0; i < n_meshes; ++i) {
+		if (!renderer_mesh_is_resident(meshes[i])) {
+			renderer_draw_mesh_shaded(meshes[i], model_transform, 0, 0, tex_id_offset);
+		}
+	}
+
+	// Make sure the whole batch fits, so the queue can't get flushed halfway through
+	if (render_queue_n_commands + 2 > RENDER_QUEUE_MAX_COMMANDS || render_queue_n_multi_draws + (int)n_meshes > RENDER_QUEUE_MAX_MULTI_DRAWS) {
+		renderer_flush();
+	}
+
+	// Calculate model matrix
+	mat4 model_matrix;
+	renderer_calculate_model_matrix(model_transform, 0, model_matrix);
+
+	// The resident meshes become one multi-draw for the textured ones, and one for the untextured ones
+	for (int texture_bound = 1; texture_bound >= 0; --texture_bound) {
+		const int multi_draw_start = render_queue_n_multi_draws;
+		for (size_t i = 0; i < n_meshes; ++i) {
+			const mesh_t* mesh = meshes[i];
+			if (!renderer_mesh_is_resident(mesh) || (mesh->vertices[0].tex_id != 255) != texture_bound) continue;
+			++renderer_stats.n_meshes_submitted;
+			if (frustum_cull_aabb(&frustum, &mesh->bounds, model_transform, 0)) {
+				++renderer_stats.n_meshes_culled;
+				continue;
+			}
+			renderer_stats.n_triangles += mesh->n_triangles;
+
+			// Every mesh has its own base vertex, since the indices are 16-bit
+			render_queue_multi_indices[render_queue_n_multi_draws] = (const void*)(mesh->gpu_index_start * sizeof(uint16_t));
+			render_queue_multi_count[render_queue_n_multi_draws] = mesh->n_triangles * 3;
+			render_queue_multi_base_vertex[render_queue_n_multi_draws] = mesh->gpu_vertex_start;
+			++render_queue_n_multi_draws;
+		}
+		if (render_queue_n_multi_draws == multi_draw_start) continue;
+
+		render_command_t* command = renderer_queue_command(0);
+		memcpy(command->model_matrix, model_matrix, sizeof(mat4));
+		command->pass = RENDER_PASS_WORLD;
+		command->view_mode = VIEW_MODE_WORLD;
+		command->is_resident = 1;
+		command->first_vertex = 0;
+		command->n_vertices = 0;
+		command->first_index = 0;
+		command->n_indices = 0;
+		command->multi_draw_start = multi_draw_start;
+		command->n_multi_draws = render_queue_n_multi_draws - multi_draw_start;
+		command->texture_bound = (uint8_t)texture_bound;
+		command->texture_offset = tex_id_offset;
+		command->texture_is_page = 0;
+		command->alpha = 1.0f;
+		command->blend = 0;
+#ifdef _LEVEL_EDITOR
+		command->stencil_ref = (uint8_t)drawing_entity_id;
+#endif
+	}
 
 #ifdef _LEVEL_EDITOR
 	drawing_entity_id = 255;
@@ -605,71 +1306,220 @@ void renderer_update_window_res(int width, int height) {
 }
 #endif
 
+static void renderer_flush_billboards(void) {
+	int n_quads_total = 0;
+	for (int i = 0; i < BLEND_MODE_COUNT; ++i) n_quads_total += billboard_n_quads[i];
+	if (n_quads_total == 0) return;
+
+	// Orphan last frame's buffer, then upload every batch back to back
+	glBindVertexArray(vao_billboard);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_billboard);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(billboard_vertices), NULL, GL_STREAM_DRAW);
+	GLint first_vertex[BLEND_MODE_COUNT];
+	GLint n_vertices_uploaded = 0;
+	for (int i = 0; i < BLEND_MODE_COUNT; ++i) {
+		first_vertex[i] = n_vertices_uploaded;
+		if (billboard_n_quads[i] == 0) continue;
+		glBufferSubData(GL_ARRAY_BUFFER, n_vertices_uploaded * sizeof(billboard_vertex_t), billboard_n_quads[i] * 6 * sizeof(billboard_vertex_t), billboard_vertices[i]);
+		renderer_stats.n_buffer_bytes_uploaded += billboard_n_quads[i] * 6 * sizeof(billboard_vertex_t);
+		renderer_stats.n_quads += billboard_n_quads[i];
+		n_vertices_uploaded += billboard_n_quads[i] * 6;
+	}
+
+	// Bind shader
+	glUseProgram(shader_gouraud);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, render_w, render_h);
+
+	// Bind texture
+	glBindTexture(GL_TEXTURE_2D, textures);
+
+	// Set matrices. Billboards don't use the depth bias, so cancel it out
+	mat4 id_matrix;
+	glm_mat4_identity(id_matrix);
+	glUniformMatrix4fv(gouraud_locations.model_matrix, 1, GL_FALSE, &id_matrix[0][0]);
+	gouraud_set_int(gouraud_locations.view_mode, &gouraud_values.view_mode, VIEW_MODE_WORLD);
+	gouraud_set_int(gouraud_locations.instance_offset, &gouraud_values.instance_offset, -1);
+	gouraud_set_int(gouraud_locations.texture_bound, &gouraud_values.texture_bound, 1);
+	gouraud_set_int(gouraud_locations.texture_offset, &gouraud_values.texture_offset, 0);
+	gouraud_set_int(gouraud_locations.texture_is_page, &gouraud_values.texture_is_page, 0);
+	gouraud_set_int(gouraud_locations.depth_bias_offset, &gouraud_values.depth_bias_offset, -curr_depth_bias);
+	gouraud_set_float(gouraud_locations.alpha, &gouraud_values.alpha, 1.0f);
+
+	// Depth test against the scene, but don't write, so overlapping particles don't cut each other off
+	glEnable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_BLEND);
+
+	// One draw call per blend mode
+	for (int i = 0; i < BLEND_MODE_COUNT; ++i) {
+		if (billboard_n_quads[i] == 0) continue;
+		switch (i) {
+			case BLEND_MODE_MIX: glBlendEquation(GL_FUNC_ADD); glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); break;
+			case BLEND_MODE_ADD: glBlendEquation(GL_FUNC_ADD); glBlendFunc(GL_SRC_ALPHA, GL_ONE); break;
+			case BLEND_MODE_SUB: glBlendEquation(GL_FUNC_REVERSE_SUBTRACT); glBlendFunc(GL_SRC_ALPHA, GL_ONE); break;
+		}
+		glDrawArrays(GL_TRIANGLES, first_vertex[i], billboard_n_quads[i] * 6);
+		++renderer_stats.n_draw_calls;
+		renderer_stats.n_triangles += billboard_n_quads[i] * 2;
+		billboard_n_quads[i] = 0;
+	}
+
+	glBlendEquation(GL_FUNC_ADD);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+}
+
+void renderer_draw_particle_system(const particle_system_t* system) {
+	if (system->n_alive == 0) return;
+
+	const int blend_mode = (system->params->blend_mode < BLEND_MODE_COUNT) ? system->params->blend_mode : BLEND_MODE_MIX;
+
+	// The camera's right and up axes in world space, so the quads always face the camera.
+	// Scale is divided by the PS1's projection plane distance, which makes the particles the same size on screen as on PS1
+	const float size_scale = 1.0f / (120.0f * 2.0f);
+	const vec3 right = { view_matrix[0][0] * size_scale, view_matrix[1][0] * size_scale, view_matrix[2][0] * size_scale };
+	const vec3 up = { view_matrix[0][1] * size_scale, view_matrix[1][1] * size_scale, view_matrix[2][1] * size_scale };
+
+	for (int i = 0; i < system->n_alive; ++i) {
+		if (billboard_n_quads[blend_mode] >= BILLBOARD_MAX_QUADS) {
+			renderer_flush_billboards();
+		}
+
+		const float x = -(float)system->position_x[i] / (float)COL_SCALE;
+		const float y = -(float)system->position_y[i] / (float)COL_SCALE;
+		const float z = -(float)system->position_z[i] / (float)COL_SCALE;
+		const float half_w = (float)system->scale_x[i];
+		const float half_h = (float)system->scale_y[i];
+		billboard_vertex_t corner = {
+			.r = (uint8_t)(system->colour_r[i] / ONE),
+			.g = (uint8_t)(system->colour_g[i] / ONE),
+			.b = (uint8_t)(system->colour_b[i] / ONE),
+			.tex_id = (uint8_t)(system->params->texture_id + system->curr_frame[i] / ONE),
+		};
+
+		billboard_vertex_t tl = corner, tr = corner, bl = corner, br = corner;
+		tl.x = x + (-right[0] * half_w) + (up[0] * half_h); tl.y = y + (-right[1] * half_w) + (up[1] * half_h); tl.z = z + (-right[2] * half_w) + (up[2] * half_h);
+		tr.x = x + ( right[0] * half_w) + (up[0] * half_h); tr.y = y + ( right[1] * half_w) + (up[1] * half_h); tr.z = z + ( right[2] * half_w) + (up[2] * half_h);
+		bl.x = x + (-right[0] * half_w) - (up[0] * half_h); bl.y = y + (-right[1] * half_w) - (up[1] * half_h); bl.z = z + (-right[2] * half_w) - (up[2] * half_h);
+		br.x = x + ( right[0] * half_w) - (up[0] * half_h); br.y = y + ( right[1] * half_w) - (up[1] * half_h); br.z = z + ( right[2] * half_w) - (up[2] * half_h);
+		tl.u = 0;   tl.v = 0;
+		tr.u = 255; tr.v = 0;
+		bl.u = 0;   bl.v = 255;
+		br.u = 255; br.v = 255;
+
+		billboard_vertex_t* verts = &billboard_vertices[blend_mode][billboard_n_quads[blend_mode]++ * 6];
+		verts[0] = tl; verts[1] = tr; verts[2] = br;
+		verts[3] = tl; verts[4] = br; verts[5] = bl;
+	}
+}
+
 void renderer_debug_draw_line(vec3_t v0, vec3_t v1, pixel32_t color, const transform_t* model_transform) {
-    // Calculate model matrix
-    mat4 model_matrix;
-    glm_mat4_identity(model_matrix);
+    // Make room first, flushing also empties the group list
+    if (debug_line_n_lines == DEBUG_LINE_MAX_LINES) renderer_flush_debug_lines();
+
+    // Find the group for this transform and depth bias. Debug views tend to draw thousands of lines with the same transform
+    int group = -1;
+    for (int i = debug_line_n_groups - 1; i >= 0; --i) {
+        if (debug_line_groups[i].depth_bias == curr_depth_bias && memcmp(&debug_line_groups[i].transform, model_transform, sizeof(transform_t)) == 0) {
+            group = i;
+            break;
+        }
+    }
 
-    // Apply rotation
-    // Apply translation
-    // Apply scale
-    vec3 position = {
-            (float)model_transform->position.x,
-            (float)model_transform->position.y,
-            (float)model_transform->position.z,
-    };
-    vec3 scale = {
-            (float)model_transform->scale.x / (float)COL_SCALE,
-            (float)model_transform->scale.y / (float)COL_SCALE,
-            (float)model_transform->scale.z / (float)COL_SCALE,
-    };
-    glm_translate(model_matrix, position);
-    glm_scale(model_matrix, scale);
-    glm_rotate_x(model_matrix, (float)model_transform->rotation.x * 2 * PI / 131072.0f, model_matrix);
-    glm_rotate_y(model_matrix, (float)model_transform->rotation.y * 2 * PI / 131072.0f, model_matrix);
-    glm_rotate_z(model_matrix, (float)model_transform->rotation.z * 2 * PI / 131072.0f, model_matrix);
+    if (group < 0) {
+        if (debug_line_n_groups == DEBUG_LINE_MAX_GROUPS) renderer_flush_debug_lines();
+        group = debug_line_n_groups++;
+        debug_line_groups[group].transform = *model_transform;
+        debug_line_groups[group].depth_bias = curr_depth_bias;
+        debug_line_groups[group].n_lines = 0;
+    }
+
+    line_3d_t* line = &debug_lines[debug_line_n_lines];
+    memset(line, 0, sizeof(line_3d_t));
+    line->v0.x = (int16_t)(v0.x >> 12);
+    line->v0.y = (int16_t)(v0.y >> 12);
+    line->v0.z = (int16_t)(v0.z >> 12);
+    line->v1.x = (int16_t)(v1.x >> 12);
+    line->v1.y = (int16_t)(v1.y >> 12);
+    line->v1.z = (int16_t)(v1.z >> 12);
+    line->v0.r = color.r;
+    line->v0.g = color.g;
+    line->v0.b = color.b;
+    line->v1.r = color.r;
+    line->v1.g = color.g;
+    line->v1.b = color.b;
+    debug_line_group_index[debug_line_n_lines] = (uint8_t)group;
+    ++debug_line_groups[group].n_lines;
+    ++debug_line_n_lines;
+}
+
+static void renderer_flush_debug_lines(void) {
+    if (debug_line_n_lines == 0) {
+        debug_line_n_groups = 0;
+        return;
+    }
+
+    // Sort the lines by group, so every group is one contiguous range
+    int first_line[DEBUG_LINE_MAX_GROUPS];
+    int cursor[DEBUG_LINE_MAX_GROUPS];
+    int n_lines_sorted = 0;
+    for (int i = 0; i < debug_line_n_groups; ++i) {
+        first_line[i] = n_lines_sorted;
+        cursor[i] = n_lines_sorted;
+        n_lines_sorted += debug_line_groups[i].n_lines;
+    }
+    for (int i = 0; i < debug_line_n_lines; ++i) {
+        debug_lines_sorted[cursor[debug_line_group_index[i]]++] = debug_lines[i];
+    }
 
     // Bind shader
     glUseProgram(shader_gouraud);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, render_w, render_h);
 
     // Bind texture
     glBindTexture(GL_TEXTURE_2D, 0);
-    glUniform1i(glGetUniformLocation(shader_gouraud, "texture_bound"), 0);
 
-    // Bind vertex buffers
+    // Bind vertex buffers, and upload every line at once
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, debug_line_n_lines * sizeof(line_3d_t), debug_lines_sorted, GL_STREAM_DRAW);
+    renderer_stats.n_buffer_bytes_uploaded += debug_line_n_lines * sizeof(line_3d_t);
+
+    gouraud_set_int(gouraud_locations.view_mode, &gouraud_values.view_mode, VIEW_MODE_WORLD);
+    gouraud_set_int(gouraud_locations.instance_offset, &gouraud_values.instance_offset, -1);
+    gouraud_set_int(gouraud_locations.texture_bound, &gouraud_values.texture_bound, 0);
+    gouraud_set_int(gouraud_locations.texture_is_page, &gouraud_values.texture_is_page, 0);
+    gouraud_set_float(gouraud_locations.alpha, &gouraud_values.alpha, 1.0f);
 
-    // Set matrices
-    glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "proj_matrix"), 1, GL_FALSE, &perspective_matrix[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "view_matrix"), 1, GL_FALSE, &view_matrix[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "model_matrix"), 1, GL_FALSE, &model_matrix[0][0]);
-    glUniform1i(glGetUniformLocation(shader_gouraud, "texture_is_page"), 0);
-    glUniform1i(glGetUniformLocation(shader_gouraud, "curr_depth_bias"), curr_depth_bias - 16);
-    glUniform1f(glGetUniformLocation(shader_gouraud, "alpha"), 1.0f);
-
-    // Copy data into it
-    line_3d_t line;
-    line.v0.x = (int16_t)(v0.x >> 12);
-    line.v0.y = (int16_t)(v0.y >> 12);
-    line.v0.z = (int16_t)(v0.z >> 12);
-    line.v1.x = (int16_t)(v1.x >> 12);
-    line.v1.y = (int16_t)(v1.y >> 12);
-    line.v1.z = (int16_t)(v1.z >> 12);
-    line.v0.r = color.r;
-    line.v0.g = color.g;
-    line.v0.b = color.b;
-    line.v1.r = color.r;
-    line.v1.g = color.g;
-    line.v1.b = color.b;
-    glBufferData(GL_ARRAY_BUFFER, sizeof(line_3d_t),
-        &line, GL_STATIC_DRAW);
-
-    // Enable depth and draw
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glCullFace(GL_FRONT);
-    glDrawArrays(GL_LINES, 0, 2);
+
+    // One draw per group
+    for (int i = 0; i < debug_line_n_groups; ++i) {
+        const transform_t* model_transform = &debug_line_groups[i].transform;
+
+        // Calculate model matrix. Line vertices are in collision space, so scale by COL_SCALE instead of 4096
+        mat4 model_matrix;
+        vec3 collision_scale = { 4096.0f / (float)COL_SCALE, 4096.0f / (float)COL_SCALE, 4096.0f / (float)COL_SCALE };
+        renderer_calculate_model_matrix(model_transform, 0, model_matrix);
+        glm_scale(model_matrix, collision_scale);
+
+        // Lines are pulled slightly towards the camera so they show up on top of the surfaces they outline.
+        // The frame uniforms hold the depth bias at flush time, so correct for the bias the lines were drawn with
+        glUniformMatrix4fv(gouraud_locations.model_matrix, 1, GL_FALSE, &model_matrix[0][0]);
+        gouraud_set_int(gouraud_locations.depth_bias_offset, &gouraud_values.depth_bias_offset, debug_line_groups[i].depth_bias - curr_depth_bias - 16);
+        glDrawArrays(GL_LINES, first_line[i] * 2, debug_line_groups[i].n_lines * 2);
+        ++renderer_stats.n_draw_calls;
+    }
+
+    debug_line_n_lines = 0;
+    debug_line_n_groups = 0;
 }
 
 void renderer_debug_draw_bvh_triangles(const level_collision_t* box, const pixel32_t color, const transform_t* model_transform) {
@@ -682,32 +1532,11 @@ void renderer_debug_draw_bvh_triangles(const level_collision_t* box, const pixel
 }
 
 void renderer_upload_texture(const texture_cpu_t *texture, const uint8_t index) {
-	// This is where all the pixels will be stored
-	pixel32_t *pixels = mem_alloc((size_t)texture->width * (size_t)texture->height * 4, MEM_CAT_TEXTURE);
-
 	// The texture is stored in 4bpp format, so each byte in the texture is 2
 	// pixels horizontally - Convert to 32-bit color
-	for (size_t i = 0; i < (texture->width * texture->height / 2); ++i) {
-		// Get indices from texture
-		const uint8_t color_index_left = (texture->data[i] >> 0) & 0x0F;
-		const uint8_t color_index_right = (texture->data[i] >> 4) & 0x0F;
-
-		// Get 16-bit color values from palette
-		const pixel16_t pixel_left = texture->palette[color_index_left];
-		const pixel16_t pixel_right = texture->palette[color_index_right];
-
-		// Expand to 32-bit color
-		pixels[i * 2 + 0].r = pixel_left.r << 3;
-		pixels[i * 2 + 0].g = pixel_left.g << 3;
-		pixels[i * 2 + 0].b = pixel_left.b << 3;
-		pixels[i * 2 + 0].a = pixel_left.a * 255;
-
-		// And on the right side as well
-		pixels[i * 2 + 1].r = pixel_right.r << 3;
-		pixels[i * 2 + 1].g = pixel_right.g << 3;
-		pixels[i * 2 + 1].b = pixel_right.b << 3;
-		pixels[i * 2 + 1].a = pixel_right.a * 255;
-	}
+	const size_t n_pixels = (size_t)texture->width * (size_t)texture->height;
+	pixel32_t *pixels = texture_convert_get_scratch(n_pixels);
+	texture_convert_4bpp(pixels, texture->data, texture->palette, n_pixels);
 
 	// Upload texture
 	glBindTexture(GL_TEXTURE_2D, textures);
@@ -719,23 +1548,18 @@ void renderer_upload_texture(const texture_cpu_t *texture, const uint8_t index)
 		GL_RGBA, GL_UNSIGNED_BYTE, pixels
 	);
 	glGenerateMipmap(GL_TEXTURE_2D);
+	++renderer_stats.n_texture_uploads;
+	renderer_stats.n_texture_bytes_uploaded += texture->width * texture->height * sizeof(pixel32_t);
 
 	// Store texture resolution
 	tex_res[(size_t)index * 2 + 0] = (float)texture->width;
 	tex_res[(size_t)index * 2 + 1] = (float)texture->height;
-
-	// Clean up after we're done
-	mem_free(pixels);
 }
 
 int renderer_get_delta_time_raw(void) { return 0; }
 
 int renderer_get_delta_time_ms(void) { return dt_ms_int; }
 
-uint32_t renderer_get_n_total_triangles(void) { return n_total_triangles; }
-
-int renderer_n_meshes_drawn(void) { return n_meshes_drawn; }
-
 int renderer_should_close(void) { return glfwWindowShouldClose(window); }
 
 vec3_t renderer_get_forward_vector(void) {
@@ -792,45 +1616,20 @@ void renderer_draw_2d_quad(vec2_t tl, vec2_t tr, vec2_t bl, vec2_t br, vec2_t uv
 		verts[0], verts[2], verts[3]
 	};
 
-	// Bind shader
-	glUseProgram(shader_gouraud);
-
-	// Bind texture
-	glBindTexture(GL_TEXTURE_2D, textures);
-
-	// Bind vertex buffers
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-	// Set matrices
-	mat4 id_matrix;
-	glm_mat4_identity(id_matrix);
-	mat4 screen_matrix;
-	glm_mat4_identity(screen_matrix);
-	screen_matrix[0][0] = 1.0f / 256.0f;
-	screen_matrix[1][1] = -2.0f / 240.0f;
-	screen_matrix[2][2] = 1.0f / 256.0f;
-	glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "proj_matrix"), 1, GL_FALSE, &id_matrix[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "view_matrix"), 1, GL_FALSE, &screen_matrix[0][0]);
-	glUniformMatrix4fv(glGetUniformLocation(shader_gouraud, "model_matrix"), 1, GL_FALSE, &id_matrix[0][0]);
-
-	glUniform1i(glGetUniformLocation(shader_gouraud, "texture_bound"), texture_id != 255);
-	glUniform1i(glGetUniformLocation(shader_gouraud, "texture_offset"), 0);
-	glUniform1i(glGetUniformLocation(shader_gouraud, "texture_is_page"), is_page);
-	glUniform1i(glGetUniformLocation(shader_gouraud, "curr_depth_bias"), curr_depth_bias);
-	glUniform1f(glGetUniformLocation(shader_gouraud, "alpha"), ((float)color.a) / 255.0f);
-
-	// Copy data into it
-	glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(vertex_3d_t), triangulated, GL_STATIC_DRAW);
-
-	// Enable depth and draw
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisable(GL_BLEND);
+	// Queue the draw, the screen space matrix comes from the frame uniform buffer
+	render_command_t* command = renderer_queue_command(6);
+	glm_mat4_identity(command->model_matrix);
+	command->pass = RENDER_PASS_SCREEN;
+	command->view_mode = VIEW_MODE_SCREEN;
+	command->is_resident = 0;
+	command->n_vertices = 6;
+	command->texture_bound = texture_id != 255;
+	command->texture_offset = 0;
+	command->texture_is_page = (uint8_t)is_page;
+	command->alpha = ((float)color.a) / 255.0f;
+	command->blend = 1;
+	memcpy(&render_queue_vertices[command->first_vertex], triangulated, sizeof(triangulated));
+	renderer_stats.n_triangles += 2;
 }
 
 void renderer_apply_fade(int fade_level) {
@@ -848,22 +1647,10 @@ void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8
     // This is where all the pixels will be stored
     const size_t width = (texture->width == 0) ? 256 : texture->width;
     const size_t height = (texture->height == 0) ? 256 : texture->height;
-    pixel32_t* pixels = mem_alloc((size_t)width * (size_t)height * 4, MEM_CAT_TEXTURE);
+    pixel32_t* pixels = texture_convert_get_scratch(width * height);
 
     // The texture is stored in 8bpp format, convert it to 32-bit color
-    for (size_t i = 0; i < ((size_t)width * (size_t)height); ++i) {
-        // Get indices from source texture
-        const uint8_t color_index = texture->data[i];
-
-        // Get 16-bit color values from palette
-        const pixel16_t pixel = texture->palette[color_index];
-
-        // Expand to 32-bit color and store to destination texture
-        pixels[i].r = pixel.r << 3;
-        pixels[i].g = pixel.g << 3;
-        pixels[i].b = pixel.b << 3;
-        pixels[i].a = 255 * ((pixel.r | pixel.g | pixel.b) != 0);
-    }
+    texture_convert_8bpp(pixels, texture->data, texture->palette, width * height);
 
     // Upload texture
     glBindTexture(GL_TEXTURE_2D, textures);
@@ -874,13 +1661,12 @@ void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8
         height,
         GL_RGBA, GL_UNSIGNED_BYTE, pixels
 	);
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += width * height * sizeof(pixel32_t);
 
     // Store texture resolution
     tex_res[(size_t)index * 2 + 0] = (float)width;
     tex_res[(size_t)index * 2 + 1] = (float)height;
-
-    // Clean up after we're done
-    mem_free(pixels);
 }
 
 void renderer_set_video_mode(int is_pal) {
@@ -888,7 +1674,13 @@ void renderer_set_video_mode(int is_pal) {
 }
 
 void renderer_set_depth_bias(int bias) {
+	if (bias == curr_depth_bias) return;
 	curr_depth_bias = bias;
+
+	// Only the depth bias changes mid-frame, so only update that part of the frame uniforms
+	frame_uniforms.curr_depth_bias = bias;
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo_frame);
+	glBufferSubData(GL_UNIFORM_BUFFER, offsetof(frame_uniforms_t, curr_depth_bias), sizeof(GLint), &frame_uniforms.curr_depth_bias);
 }
 
 float* renderer_debug_perspective_matrix(void) {
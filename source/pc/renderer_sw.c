@@ -0,0 +1,861 @@
+#include "renderer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "frustum.h"
+#include "memory.h"
+#include "input.h"
+#include "jobs.h"
+#include "vec3.h"
+
+// Headless renderer for the PC build. Instead of OpenGL, it rasterizes into an in-memory 15-bit framebuffer the way the
+// PS1 GPU would: whole pixel vertex coordinates, affine texture mapping, Gouraud shading, 4bpp textures with the distance
+// fade CLUTs, and no depth buffer, only an ordering table. The geometry itself goes through the same transforms as the
+// OpenGL renderer, so both backends show the same thing. Useful for automated runs on machines without a GPU.
+
+#define PI 3.14159265358979f
+#define SW_RES_X 320
+#define SW_RES_Y 240
+#define SW_FOCAL_LENGTH (SW_RES_Y / 2) // 90 degree vertical field of view, same as the OpenGL renderer. Also matches the PS1's geometry screen distance
+#define SW_NEAR_Z 1.0f // In graphics units
+#define SW_MAX_COORD (1 << 20) // Projected coordinates get clamped to this, so the rasterizer math can't overflow
+#define SW_BAND_HEIGHT 16 // Rows per rasterizer job
+#define SW_N_BANDS ((SW_RES_Y + SW_BAND_HEIGHT - 1) / SW_BAND_HEIGHT)
+#define SW_MAX_PRIMITIVES (64 * 1024) // Per flush
+#define SW_MAX_TEXTURE_PAGES 8
+#define SW_CLEAR_COLOR ((2 << 10) | (2 << 5) | 2) // Same as the PS1 build's draw environment
+#define SW_FRAME_TIME_MS 16 // Every frame pretends to take this long, so runs are reproducible
+#define TRI_THRESHOLD_FADE_START 600
+#define TRI_THRESHOLD_FADE_END 900
+#define N_CLUT_FADES 16
+
+#ifndef HEADLESS_N_FRAMES
+#define HEADLESS_N_FRAMES 600 // renderer_should_close() returns 1 after this many frames. 0 runs forever
+#endif
+
+#ifndef HEADLESS_DUMP_INTERVAL
+#define HEADLESS_DUMP_INTERVAL 0 // Every this many frames, the framebuffer is written to frame_xxxxx.ppm. 0 disables it
+#endif
+
+typedef enum {
+    SW_ATTR_R,
+    SW_ATTR_G,
+    SW_ATTR_B,
+    SW_ATTR_U,
+    SW_ATTR_V,
+    SW_N_ATTRIBUTES,
+} sw_attribute_t;
+
+typedef enum {
+    SW_PRIM_TRIANGLE,
+    SW_PRIM_LINE,
+} sw_primitive_type_t;
+
+typedef enum {
+    SW_BLEND_NONE,
+    SW_BLEND_MIX, // (B + F) / 2
+    SW_BLEND_ADD, // B + F
+    SW_BLEND_SUB, // B - F
+} sw_blend_t;
+
+typedef struct {
+    uint8_t texture; // NO_TEXTURE for untextured primitives
+    uint8_t is_page;
+    uint8_t clut_row; // Distance fade, 0 is the original palette
+    uint8_t blend;
+    uint8_t cull_backfaces;
+} sw_material_t;
+
+// Camera space vertex, the camera looks down negative Z
+typedef struct {
+    float x, y, z;
+    float r, g, b, u, v;
+} sw_clip_vertex_t;
+
+typedef struct {
+    int32_t x, y;
+    uint8_t r, g, b, u, v;
+} sw_screen_vertex_t;
+
+// Triangles are set up once when they're added, the rasterizer jobs only evaluate the plane equations.
+// Attributes are 16.16 fixed point, texture coordinates are in texels
+typedef struct {
+    int32_t x[3], y[3]; // Sorted top to bottom. Lines only use the first two
+    int32_t value[SW_N_ATTRIBUTES]; // At the top vertex
+    int32_t d_dx[SW_N_ATTRIBUTES];
+    int32_t d_dy[SW_N_ATTRIBUTES];
+    int32_t next; // Next primitive in the same ordering table entry, -1 ends the list
+    int32_t y_min, y_max;
+    uint8_t type;
+    sw_material_t material;
+} sw_primitive_t;
+
+typedef struct {
+    uint8_t texels[64 * 64]; // One palette index per byte
+    uint16_t clut[N_CLUT_FADES * 16]; // One row per distance fade level
+} sw_texture_t;
+
+typedef struct {
+    uint8_t texels[256 * 256];
+    uint16_t clut[256];
+} sw_texture_page_t;
+
+typedef struct {
+    float m[3][3]; // Row major
+    float t[3];
+} sw_matrix_t;
+
+// Need to define these somewhere so it compiles, same as the OpenGL renderer
+int is_pal = 0;
+int vsync_enable = 0;
+int tex_entity_start = 0;
+int tex_weapon_start = 0;
+int tex_level_start = 0;
+int tex_alloc_cursor = 0;
+extern uint8_t tex_id_start;
+
+vec3_t camera_pos;
+frustum_t frustum;
+int curr_depth_bias = 0;
+static int sw_frame_index = 0;
+static struct timespec sw_frame_start_time;
+static int sw_cpu_frame_time_us = 0;
+
+static uint16_t sw_framebuffer[SW_RES_X * SW_RES_Y];
+static sw_texture_t sw_textures[256];
+static sw_texture_page_t sw_texture_pages[SW_MAX_TEXTURE_PAGES];
+static sw_primitive_t sw_primitives[SW_MAX_PRIMITIVES];
+static int32_t sw_draw_order[SW_MAX_PRIMITIVES];
+static int32_t sw_ord_tbl[ORD_TBL_LENGTH];
+static int sw_n_primitives = 0;
+static int sw_n_primitives_drawn = 0;
+static sw_matrix_t sw_view_matrix;
+static sw_matrix_t sw_view_matrix_local;
+
+static void sw_rotation_matrix(float out[3][3], const float x, const float y, const float z) {
+    // Rx * Ry * Rz, which is what glm_rotate_x, glm_rotate_y and glm_rotate_z build in the OpenGL renderer
+    const float cx = cosf(x), sx = sinf(x);
+    const float cy = cosf(y), sy = sinf(y);
+    const float cz = cosf(z), sz = sinf(z);
+    out[0][0] = cy * cz;                    out[0][1] = -cy * sz;                   out[0][2] = sy;
+    out[1][0] = sx * sy * cz + cx * sz;     out[1][1] = -sx * sy * sz + cx * cz;    out[1][2] = -sx * cy;
+    out[2][0] = -cx * sy * cz + sx * sz;    out[2][1] = cx * sy * sz + sx * cz;     out[2][2] = cx * cy;
+}
+
+static sw_matrix_t sw_matrix_mul(const sw_matrix_t* a, const sw_matrix_t* b) {
+    sw_matrix_t out;
+    for (int row = 0; row < 3; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            out.m[row][col] = a->m[row][0] * b->m[0][col] + a->m[row][1] * b->m[1][col] + a->m[row][2] * b->m[2][col];
+        }
+        out.t[row] = a->m[row][0] * b->t[0] + a->m[row][1] * b->t[1] + a->m[row][2] * b->t[2] + a->t[row];
+    }
+    return out;
+}
+
+static void sw_transform(const sw_matrix_t* matrix, const float x, const float y, const float z, sw_clip_vertex_t* out) {
+    out->x = matrix->m[0][0] * x + matrix->m[0][1] * y + matrix->m[0][2] * z + matrix->t[0];
+    out->y = matrix->m[1][0] * x + matrix->m[1][1] * y + matrix->m[1][2] * z + matrix->t[1];
+    out->z = matrix->m[2][0] * x + matrix->m[2][1] * y + matrix->m[2][2] * z + matrix->t[2];
+}
+
+static sw_matrix_t sw_model_matrix(const transform_t* model_transform, const float scale_one, const int facing_camera) {
+    sw_matrix_t model;
+    const float position[3] = { (float)model_transform->position.x, (float)model_transform->position.y, (float)model_transform->position.z };
+    const float scale[3] = { (float)model_transform->scale.x / scale_one, (float)model_transform->scale.y / scale_one, (float)model_transform->scale.z / scale_one };
+
+    if (facing_camera) {
+        // Same as the OpenGL renderer, the basis replaces the scale too
+        float forward[3] = { (float)camera_pos.x / 4096.f - position[0], (float)camera_pos.y / 4096.f - position[1], (float)camera_pos.z / 4096.f - position[2] };
+        const float forward_length = sqrtf(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+        if (forward_length > 0.0f) for (int i = 0; i < 3; ++i) forward[i] /= forward_length;
+        float right[3] = { forward[2], 0.0f, -forward[0] }; // cross(up, forward)
+        const float right_length = sqrtf(right[0] * right[0] + right[2] * right[2]);
+        if (right_length > 0.0f) for (int i = 0; i < 3; ++i) right[i] /= right_length;
+        for (int i = 0; i < 3; ++i) {
+            model.m[i][0] = right[i];
+            model.m[i][1] = (i == 1) ? 1.0f : 0.0f;
+            model.m[i][2] = forward[i];
+        }
+    }
+    else {
+        sw_rotation_matrix(model.m,
+            (float)model_transform->rotation.x * 2 * PI / 131072.0f,
+            (float)model_transform->rotation.y * 2 * PI / 131072.0f,
+            (float)model_transform->rotation.z * 2 * PI / 131072.0f
+        );
+        for (int row = 0; row < 3; ++row) {
+            for (int col = 0; col < 3; ++col) model.m[row][col] *= scale[row];
+        }
+    }
+
+    for (int i = 0; i < 3; ++i) model.t[i] = position[i];
+    return model;
+}
+
+static uint8_t sw_float_to_u8(const float value) {
+    if (value <= 0.0f) return 0;
+    if (value >= 255.0f) return 255;
+    return (uint8_t)(value + 0.5f);
+}
+
+static int32_t sw_clamp_coord(const float value) {
+    if (value < -(float)SW_MAX_COORD) return -SW_MAX_COORD;
+    if (value > (float)SW_MAX_COORD) return SW_MAX_COORD;
+    return (int32_t)floorf(value + 0.5f);
+}
+
+static sw_screen_vertex_t sw_project(const sw_clip_vertex_t* vertex) {
+    const float depth = -vertex->z;
+    sw_screen_vertex_t out;
+    out.x = sw_clamp_coord((float)(SW_RES_X / 2) + (vertex->x * (float)SW_FOCAL_LENGTH) / depth);
+    out.y = sw_clamp_coord((float)(SW_RES_Y / 2) - (vertex->y * (float)SW_FOCAL_LENGTH) / depth);
+    out.r = sw_float_to_u8(vertex->r);
+    out.g = sw_float_to_u8(vertex->g);
+    out.b = sw_float_to_u8(vertex->b);
+    out.u = sw_float_to_u8(vertex->u);
+    out.v = sw_float_to_u8(vertex->v);
+    return out;
+}
+
+static sw_clip_vertex_t sw_lerp_vertex(const sw_clip_vertex_t* a, const sw_clip_vertex_t* b, const float t) {
+    return (sw_clip_vertex_t){
+        a->x + (b->x - a->x) * t,
+        a->y + (b->y - a->y) * t,
+        a->z + (b->z - a->z) * t,
+        a->r + (b->r - a->r) * t,
+        a->g + (b->g - a->g) * t,
+        a->b + (b->b - a->b) * t,
+        a->u + (b->u - a->u) * t,
+        a->v + (b->v - a->v) * t,
+    };
+}
+
+static sw_primitive_t* sw_alloc_primitive(const int ot_index) {
+    if (ot_index < 0 || ot_index >= ORD_TBL_LENGTH) return NULL;
+    if (sw_n_primitives == SW_MAX_PRIMITIVES) {
+        WARN_IF("software renderer primitive buffer is full", 1);
+        return NULL;
+    }
+
+    // Like addPrim(), newer primitives in the same entry are drawn first
+    sw_primitive_t* prim = &sw_primitives[sw_n_primitives];
+    prim->next = sw_ord_tbl[ot_index];
+    sw_ord_tbl[ot_index] = sw_n_primitives++;
+    return prim;
+}
+
+static void sw_add_triangle(const sw_screen_vertex_t* v0, const sw_screen_vertex_t* v1, const sw_screen_vertex_t* v2, const int ot_index, const sw_material_t* material) {
+    // Clockwise on screen is front facing, same as the GTE's normal clip
+    const int64_t area = (int64_t)(v1->x - v0->x) * (v2->y - v0->y) - (int64_t)(v2->x - v0->x) * (v1->y - v0->y);
+    if (area == 0) return;
+    if (material->cull_backfaces && area < 0) return;
+
+    // Nothing on screen
+    if (v0->x < 0 && v1->x < 0 && v2->x < 0) return;
+    if (v0->y < 0 && v1->y < 0 && v2->y < 0) return;
+    if (v0->x >= SW_RES_X && v1->x >= SW_RES_X && v2->x >= SW_RES_X) return;
+    if (v0->y >= SW_RES_Y && v1->y >= SW_RES_Y && v2->y >= SW_RES_Y) return;
+
+    sw_primitive_t* prim = sw_alloc_primitive(ot_index);
+    if (!prim) return;
+    ++renderer_stats.n_triangles;
+    prim->type = SW_PRIM_TRIANGLE;
+    prim->material = *material;
+
+    // Sort top to bottom
+    const sw_screen_vertex_t* sorted[3] = { v0, v1, v2 };
+    if (sorted[1]->y < sorted[0]->y) { const sw_screen_vertex_t* temp = sorted[0]; sorted[0] = sorted[1]; sorted[1] = temp; }
+    if (sorted[2]->y < sorted[1]->y) { const sw_screen_vertex_t* temp = sorted[1]; sorted[1] = sorted[2]; sorted[2] = temp; }
+    if (sorted[1]->y < sorted[0]->y) { const sw_screen_vertex_t* temp = sorted[0]; sorted[0] = sorted[1]; sorted[1] = temp; }
+    for (int i = 0; i < 3; ++i) {
+        prim->x[i] = sorted[i]->x;
+        prim->y[i] = sorted[i]->y;
+    }
+    prim->y_min = prim->y[0];
+    prim->y_max = prim->y[2];
+
+    // 64x64 cells are addressed with 0-255 texture coordinates, pages with one texel per step
+    const int uv_shift = material->is_page ? 16 : 14;
+    int64_t values[3][SW_N_ATTRIBUTES];
+    for (int i = 0; i < 3; ++i) {
+        values[i][SW_ATTR_R] = (int64_t)sorted[i]->r << 16;
+        values[i][SW_ATTR_G] = (int64_t)sorted[i]->g << 16;
+        values[i][SW_ATTR_B] = (int64_t)sorted[i]->b << 16;
+        values[i][SW_ATTR_U] = (int64_t)sorted[i]->u << uv_shift;
+        values[i][SW_ATTR_V] = (int64_t)sorted[i]->v << uv_shift;
+    }
+
+    // Affine plane equations, no perspective correction, just like the real thing
+    const int64_t dx1 = prim->x[1] - prim->x[0];
+    const int64_t dy1 = prim->y[1] - prim->y[0];
+    const int64_t dx2 = prim->x[2] - prim->x[0];
+    const int64_t dy2 = prim->y[2] - prim->y[0];
+    const int64_t sorted_area = dx1 * dy2 - dx2 * dy1;
+    for (int i = 0; i < SW_N_ATTRIBUTES; ++i) {
+        const int64_t da1 = values[1][i] - values[0][i];
+        const int64_t da2 = values[2][i] - values[0][i];
+        int64_t d_dx = (da1 * dy2 - da2 * dy1) / sorted_area;
+        int64_t d_dy = (da2 * dx1 - da1 * dx2) / sorted_area;
+        if (d_dx > INT32_MAX) d_dx = INT32_MAX; else if (d_dx < INT32_MIN) d_dx = INT32_MIN;
+        if (d_dy > INT32_MAX) d_dy = INT32_MAX; else if (d_dy < INT32_MIN) d_dy = INT32_MIN;
+        prim->value[i] = (int32_t)values[0][i];
+        prim->d_dx[i] = (int32_t)d_dx;
+        prim->d_dy[i] = (int32_t)d_dy;
+    }
+}
+
+// Clips a camera space triangle against the near plane, then projects it and adds it to the ordering table
+static void sw_add_clipped_triangle(const sw_clip_vertex_t* triangle, const int ot_index, const sw_material_t* material) {
+    sw_clip_vertex_t clipped[4];
+    int n_clipped = 0;
+    for (int i = 0; i < 3; ++i) {
+        const sw_clip_vertex_t* a = &triangle[i];
+        const sw_clip_vertex_t* b = &triangle[(i + 1) % 3];
+        const int a_inside = -a->z >= SW_NEAR_Z;
+        const int b_inside = -b->z >= SW_NEAR_Z;
+        if (a_inside) clipped[n_clipped++] = *a;
+        if (a_inside != b_inside) clipped[n_clipped++] = sw_lerp_vertex(a, b, (-SW_NEAR_Z - a->z) / (b->z - a->z));
+    }
+    if (n_clipped < 3) return;
+
+    sw_screen_vertex_t screen[4];
+    for (int i = 0; i < n_clipped; ++i) screen[i] = sw_project(&clipped[i]);
+    sw_add_triangle(&screen[0], &screen[1], &screen[2], ot_index, material);
+    if (n_clipped == 4) sw_add_triangle(&screen[0], &screen[2], &screen[3], ot_index, material);
+}
+
+static void sw_add_line(const sw_clip_vertex_t* v0, const sw_clip_vertex_t* v1, const int ot_index, const pixel32_t color) {
+    // Clip against the near plane
+    sw_clip_vertex_t a = *v0;
+    sw_clip_vertex_t b = *v1;
+    const int a_inside = -a.z >= SW_NEAR_Z;
+    const int b_inside = -b.z >= SW_NEAR_Z;
+    if (!a_inside && !b_inside) return;
+    if (!a_inside) a = sw_lerp_vertex(&a, &b, (-SW_NEAR_Z - a.z) / (b.z - a.z));
+    if (!b_inside) b = sw_lerp_vertex(&b, &a, (-SW_NEAR_Z - b.z) / (a.z - b.z));
+
+    // Clip against the screen edges, so the rasterizer never walks off screen
+    const float ax = (float)(SW_RES_X / 2) + (a.x * (float)SW_FOCAL_LENGTH) / -a.z;
+    const float ay = (float)(SW_RES_Y / 2) - (a.y * (float)SW_FOCAL_LENGTH) / -a.z;
+    const float bx = (float)(SW_RES_X / 2) + (b.x * (float)SW_FOCAL_LENGTH) / -b.z;
+    const float by = (float)(SW_RES_Y / 2) - (b.y * (float)SW_FOCAL_LENGTH) / -b.z;
+    const float p[4] = { -(bx - ax), bx - ax, -(by - ay), by - ay };
+    const float q[4] = { ax, (float)(SW_RES_X - 1) - ax, ay, (float)(SW_RES_Y - 1) - ay };
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    for (int i = 0; i < 4; ++i) {
+        if (p[i] == 0.0f) {
+            if (q[i] < 0.0f) return;
+            continue;
+        }
+        const float t = q[i] / p[i];
+        if (p[i] < 0.0f) { if (t > t0) t0 = t; }
+        else if (t < t1) t1 = t;
+    }
+    if (t0 > t1) return;
+
+    sw_primitive_t* prim = sw_alloc_primitive(ot_index);
+    if (!prim) return;
+    prim->type = SW_PRIM_LINE;
+    prim->material = (sw_material_t){ .texture = NO_TEXTURE };
+    prim->x[0] = sw_clamp_coord(ax + (bx - ax) * t0);
+    prim->y[0] = sw_clamp_coord(ay + (by - ay) * t0);
+    prim->x[1] = sw_clamp_coord(ax + (bx - ax) * t1);
+    prim->y[1] = sw_clamp_coord(ay + (by - ay) * t1);
+    prim->y_min = (prim->y[0] < prim->y[1]) ? prim->y[0] : prim->y[1];
+    prim->y_max = (prim->y[0] < prim->y[1]) ? prim->y[1] : prim->y[0];
+    prim->value[SW_ATTR_R] = color.r << 16;
+    prim->value[SW_ATTR_G] = color.g << 16;
+    prim->value[SW_ATTR_B] = color.b << 16;
+}
+
+static uint16_t sw_blend(const uint16_t back, const uint16_t front, const uint8_t blend) {
+    int r = front & 31;
+    int g = (front >> 5) & 31;
+    int b = (front >> 10) & 31;
+    const int back_r = back & 31;
+    const int back_g = (back >> 5) & 31;
+    const int back_b = (back >> 10) & 31;
+    switch (blend) {
+        case SW_BLEND_MIX: r = (back_r + r) >> 1; g = (back_g + g) >> 1; b = (back_b + b) >> 1; break;
+        case SW_BLEND_ADD: r = back_r + r; g = back_g + g; b = back_b + b; break;
+        case SW_BLEND_SUB: r = back_r - r; g = back_g - g; b = back_b - b; break;
+    }
+    r = (r < 0) ? 0 : (r > 31) ? 31 : r;
+    g = (g < 0) ? 0 : (g > 31) ? 31 : g;
+    b = (b < 0) ? 0 : (b > 31) ? 31 : b;
+    return (uint16_t)(r | (g << 5) | (b << 10));
+}
+
+static int sw_attribute_to_u8(const int32_t value) {
+    if (value < 0) return 0;
+    if (value >= (255 << 16)) return 255;
+    return value >> 16;
+}
+
+static void sw_draw_span(const sw_primitive_t* prim, const int y, const int x_start, const int x_end) {
+    const sw_material_t* material = &prim->material;
+    const int64_t dx = x_start - prim->x[0];
+    const int64_t dy = y - prim->y[0];
+    int32_t value[SW_N_ATTRIBUTES];
+    for (int i = 0; i < SW_N_ATTRIBUTES; ++i) {
+        value[i] = (int32_t)(prim->value[i] + prim->d_dx[i] * dx + prim->d_dy[i] * dy);
+    }
+
+    const uint8_t* texels = NULL;
+    const uint16_t* clut = NULL;
+    int uv_mask = 0;
+    int v_shift = 0;
+    if (material->texture != NO_TEXTURE) {
+        if (material->is_page) {
+            texels = sw_texture_pages[material->texture % SW_MAX_TEXTURE_PAGES].texels;
+            clut = sw_texture_pages[material->texture % SW_MAX_TEXTURE_PAGES].clut;
+            uv_mask = 255;
+            v_shift = 8;
+        }
+        else {
+            texels = sw_textures[material->texture].texels;
+            clut = &sw_textures[material->texture].clut[material->clut_row * 16];
+            uv_mask = 63;
+            v_shift = 6;
+        }
+    }
+
+    uint16_t* pixel = &sw_framebuffer[y * SW_RES_X + x_start];
+    for (int x = x_start; x < x_end; ++x, ++pixel) {
+        const int r = sw_attribute_to_u8(value[SW_ATTR_R]);
+        const int g = sw_attribute_to_u8(value[SW_ATTR_G]);
+        const int b = sw_attribute_to_u8(value[SW_ATTR_B]);
+        uint16_t color;
+        if (texels) {
+            const int u = (value[SW_ATTR_U] >> 16) & uv_mask;
+            const int v = (value[SW_ATTR_V] >> 16) & uv_mask;
+            const uint16_t texel = clut[texels[(v << v_shift) | u]];
+            for (int i = 0; i < SW_N_ATTRIBUTES; ++i) value[i] += prim->d_dx[i];
+
+            // Fully black texels are transparent
+            if (texel == 0x0000) continue;
+
+            // 128 is full brightness
+            int texel_r = ((texel & 31) * r) >> 7;
+            int texel_g = (((texel >> 5) & 31) * g) >> 7;
+            int texel_b = (((texel >> 10) & 31) * b) >> 7;
+            if (texel_r > 31) texel_r = 31;
+            if (texel_g > 31) texel_g = 31;
+            if (texel_b > 31) texel_b = 31;
+            color = (uint16_t)(texel_r | (texel_g << 5) | (texel_b << 10));
+        }
+        else {
+            for (int i = 0; i < SW_N_ATTRIBUTES; ++i) value[i] += prim->d_dx[i];
+            color = (uint16_t)((r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10));
+        }
+
+        *pixel = (material->blend == SW_BLEND_NONE) ? color : sw_blend(*pixel, color, material->blend);
+    }
+}
+
+// X coordinate of an edge at a given row, in 16.16 fixed point
+static int64_t sw_edge_x(const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1, const int y) {
+    return (int64_t)x0 * 65536 + ((int64_t)(x1 - x0) * 65536 * (y - y0)) / (y1 - y0);
+}
+
+static void sw_raster_triangle(const sw_primitive_t* prim, const int band_y0, const int band_y1) {
+    const int32_t* x = prim->x;
+    const int32_t* y = prim->y;
+    const int y_start = (y[0] > band_y0) ? y[0] : band_y0;
+    const int y_end = (y[2] < band_y1) ? y[2] : band_y1;
+
+    // Pixels are sampled at their top left corner. Left and top edges are inclusive, right and bottom edges aren't
+    for (int row = y_start; row < y_end; ++row) {
+        const int64_t x_long = sw_edge_x(x[0], y[0], x[2], y[2], row);
+        const int64_t x_short = (row < y[1]) ? sw_edge_x(x[0], y[0], x[1], y[1], row) : sw_edge_x(x[1], y[1], x[2], y[2], row);
+        const int64_t x_left = (x_long < x_short) ? x_long : x_short;
+        const int64_t x_right = (x_long < x_short) ? x_short : x_long;
+        int x_start = (int)((x_left + 0xFFFF) >> 16);
+        int x_end = (int)((x_right + 0xFFFF) >> 16);
+        if (x_start < 0) x_start = 0;
+        if (x_end > SW_RES_X) x_end = SW_RES_X;
+        if (x_start >= x_end) continue;
+        sw_draw_span(prim, row, x_start, x_end);
+    }
+}
+
+static void sw_raster_line(const sw_primitive_t* prim, const int band_y0, const int band_y1) {
+    const int dx = prim->x[1] - prim->x[0];
+    const int dy = prim->y[1] - prim->y[0];
+    const int n_steps = (abs(dx) > abs(dy)) ? abs(dx) : abs(dy);
+    const uint16_t color = (uint16_t)((prim->value[SW_ATTR_R] >> 19) | ((prim->value[SW_ATTR_G] >> 19) << 5) | ((prim->value[SW_ATTR_B] >> 19) << 10));
+    for (int i = 0; i <= n_steps; ++i) {
+        const int x = prim->x[0] + ((n_steps == 0) ? 0 : (dx * i + ((dx >= 0) ? n_steps / 2 : -n_steps / 2)) / n_steps);
+        const int y = prim->y[0] + ((n_steps == 0) ? 0 : (dy * i + ((dy >= 0) ? n_steps / 2 : -n_steps / 2)) / n_steps);
+        if (y < band_y0 || y >= band_y1 || x < 0 || x >= SW_RES_X) continue;
+        sw_framebuffer[y * SW_RES_X + x] = color;
+    }
+}
+
+// Every job owns a band of rows, and draws every primitive that touches it in ordering table order.
+// Bands never share pixels, so the jobs don't need to synchronize, and the result doesn't depend on the thread count
+static void sw_raster_band(const int band, void* user_data) {
+    (void)user_data;
+    const int band_y0 = band * SW_BAND_HEIGHT;
+    const int band_y1 = (band_y0 + SW_BAND_HEIGHT < SW_RES_Y) ? (band_y0 + SW_BAND_HEIGHT) : SW_RES_Y;
+
+    for (int i = 0; i < sw_n_primitives_drawn; ++i) {
+        const sw_primitive_t* prim = &sw_primitives[sw_draw_order[i]];
+        if (prim->y_max < band_y0 || prim->y_min >= band_y1) continue;
+        if (prim->type == SW_PRIM_LINE) sw_raster_line(prim, band_y0, band_y1);
+        else sw_raster_triangle(prim, band_y0, band_y1);
+    }
+}
+
+static void sw_clear_ordering_table(void) {
+    for (int i = 0; i < ORD_TBL_LENGTH; ++i) sw_ord_tbl[i] = -1;
+    sw_n_primitives = 0;
+}
+
+void renderer_init(void) {
+    memset(sw_textures, 0, sizeof(sw_textures));
+    memset(sw_texture_pages, 0, sizeof(sw_texture_pages));
+    sw_clear_ordering_table();
+    for (int i = 0; i < SW_RES_X * SW_RES_Y; ++i) sw_framebuffer[i] = SW_CLEAR_COLOR;
+
+    // View models are drawn relative to the camera, flipped the same way the OpenGL renderer does it
+    memset(&sw_view_matrix_local, 0, sizeof(sw_view_matrix_local));
+    sw_view_matrix_local.m[0][0] = 1.0f;
+    sw_view_matrix_local.m[1][1] = -1.0f;
+    sw_view_matrix_local.m[2][2] = -1.0f;
+    sw_frame_index = 0;
+}
+
+void renderer_begin_frame(const transform_t* camera_transform) {
+    renderer_stats_begin_frame();
+    timespec_get(&sw_frame_start_time, TIME_UTC);
+    curr_depth_bias = 0;
+    for (int i = 0; i < SW_RES_X * SW_RES_Y; ++i) sw_framebuffer[i] = SW_CLEAR_COLOR;
+
+    // Same view matrix as the OpenGL renderer: rotate by X, 180 - Y, Z + 180, then move the camera to the origin
+    sw_matrix_t translation = { .m = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } } };
+    translation.t[0] = -(float)(camera_transform->position.x >> 12);
+    translation.t[1] = -(float)(camera_transform->position.y >> 12);
+    translation.t[2] = -(float)(camera_transform->position.z >> 12);
+    sw_matrix_t rotation = { 0 };
+    sw_rotation_matrix(rotation.m,
+        (float)camera_transform->rotation.x * (2 * PI / 131072.0f),
+        -(float)camera_transform->rotation.y * (2 * PI / 131072.0f) + PI,
+        (float)camera_transform->rotation.z * (2 * PI / 131072.0f) + PI
+    );
+    sw_view_matrix = sw_matrix_mul(&rotation, &translation);
+
+    frustum = frustum_from_camera(camera_transform, (SW_RES_X * ONE) / SW_RES_Y, ONE, 0);
+    memcpy(&camera_pos, &camera_transform->position, sizeof(camera_pos));
+    renderer_set_phase(RENDERER_PHASE_OTHER);
+}
+
+void renderer_flush(void) {
+    // Walk the ordering table back to front once, so the jobs only have to go through a flat list
+    sw_n_primitives_drawn = 0;
+    for (int i = ORD_TBL_LENGTH - 1; i >= 0; --i) {
+        for (int prim = sw_ord_tbl[i]; prim >= 0; prim = sw_primitives[prim].next) {
+            sw_draw_order[sw_n_primitives_drawn++] = prim;
+        }
+    }
+
+    if (sw_n_primitives_drawn > 0) {
+        job_system_run(sw_raster_band, NULL, SW_N_BANDS);
+        ++renderer_stats.n_draw_calls;
+    }
+    sw_clear_ordering_table();
+}
+
+void renderer_end_frame(void) {
+    renderer_set_phase(RENDERER_PHASE_END_FRAME);
+    renderer_tick_fade();
+    renderer_flush();
+
+    struct timespec end_time;
+    timespec_get(&end_time, TIME_UTC);
+    sw_cpu_frame_time_us = (int)((end_time.tv_sec - sw_frame_start_time.tv_sec) * 1000000 + (end_time.tv_nsec - sw_frame_start_time.tv_nsec) / 1000);
+
+#if HEADLESS_DUMP_INTERVAL > 0
+    if (sw_frame_index % HEADLESS_DUMP_INTERVAL == 0) {
+        char path[32];
+        snprintf(path, sizeof(path), "frame_%05i.ppm", sw_frame_index);
+        renderer_dump_frame(path);
+    }
+#endif
+    ++sw_frame_index;
+    renderer_stats_end_frame();
+}
+
+int renderer_dump_frame(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        printf("[ERROR] Failed to open '%s' for writing\n", path);
+        return 0;
+    }
+
+    // Binary PPM, 8 bits per channel
+    static uint8_t rgb[SW_RES_X * SW_RES_Y * 3];
+    for (int i = 0; i < SW_RES_X * SW_RES_Y; ++i) {
+        const uint16_t pixel = sw_framebuffer[i];
+        const uint8_t r = pixel & 31;
+        const uint8_t g = (pixel >> 5) & 31;
+        const uint8_t b = (pixel >> 10) & 31;
+        rgb[i * 3 + 0] = (uint8_t)((r << 3) | (r >> 2));
+        rgb[i * 3 + 1] = (uint8_t)((g << 3) | (g >> 2));
+        rgb[i * 3 + 2] = (uint8_t)((b << 3) | (b >> 2));
+    }
+    fprintf(file, "P6\n%i %i\n255\n", SW_RES_X, SW_RES_Y);
+    const size_t n_written = fwrite(rgb, 1, sizeof(rgb), file);
+    fclose(file);
+    return n_written == sizeof(rgb);
+}
+
+const uint16_t* renderer_get_framebuffer(void) {
+    return sw_framebuffer;
+}
+
+int renderer_get_cpu_frame_time_us(void) {
+    return sw_cpu_frame_time_us;
+}
+
+void renderer_upload_mesh(mesh_t* mesh, stack_t stack) {
+    (void)stack;
+    mesh->gpu_vertex_start = -1;
+}
+
+void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_transform, int local, int facing_camera, int tex_id_offset) {
+    // If the mesh's bounding box is not inside the viewing frustum, cull it
+    ++renderer_stats.n_meshes_submitted;
+    if (!local && frustum_cull_aabb(&frustum, &mesh->bounds, model_transform, facing_camera)) {
+        ++renderer_stats.n_meshes_culled;
+        return;
+    }
+    tex_id_start = tex_id_offset;
+
+    const sw_matrix_t model_matrix = sw_model_matrix(model_transform, 4096.0f, facing_camera);
+    const sw_matrix_t model_view_matrix = sw_matrix_mul(local ? &sw_view_matrix_local : &sw_view_matrix, &model_matrix);
+    const int textured = mesh->vertices[0].tex_id != NO_TEXTURE;
+
+    const int n_polygons = mesh->n_triangles + mesh->n_quads;
+    const vertex_3d_t* vertex = mesh->vertices;
+    for (int i = 0; i < n_polygons; ++i) {
+        // Indexed meshes are all triangles
+        const int n_vertices = (i < mesh->n_triangles) ? 3 : 4;
+        const vertex_3d_t* polygon[4];
+        for (int j = 0; j < n_vertices; ++j) {
+            polygon[j] = mesh->indices ? &mesh->vertices[mesh->indices[i * 3 + j]] : &vertex[j];
+        }
+        vertex += n_vertices;
+
+        // If this is an occluder, don't render it
+        if (polygon[0]->tex_id == 254) continue;
+
+        sw_clip_vertex_t transformed[4];
+        float depth_sum = 0.0f;
+        for (int j = 0; j < n_vertices; ++j) {
+            sw_transform(&model_view_matrix, (float)polygon[j]->x, (float)polygon[j]->y, (float)polygon[j]->z, &transformed[j]);
+            transformed[j].r = (float)polygon[j]->r;
+            transformed[j].g = (float)polygon[j]->g;
+            transformed[j].b = (float)polygon[j]->b;
+            transformed[j].u = (float)polygon[j]->u;
+            transformed[j].v = (float)polygon[j]->v;
+            depth_sum -= transformed[j].z;
+        }
+
+        // The ordering table index is a quarter of the average depth, same as the GTE's AVSZ3 and AVSZ4
+        int avg_z = (int)(depth_sum / (float)(n_vertices * 4));
+        if (avg_z < 1) avg_z = 1;
+        if (avg_z + curr_depth_bias >= ORD_TBL_LENGTH) continue;
+
+        // Fade into the texture's average color in the distance, using the faded palettes
+        int clut_fade = ((N_CLUT_FADES - 1) * (avg_z - TRI_THRESHOLD_FADE_START)) / (TRI_THRESHOLD_FADE_END - TRI_THRESHOLD_FADE_START);
+        if (clut_fade > (N_CLUT_FADES - 1)) clut_fade = (N_CLUT_FADES - 1);
+        else if (clut_fade < 0) clut_fade = 0;
+
+        const sw_material_t material = {
+            .texture = (textured && polygon[0]->tex_id != NO_TEXTURE) ? (uint8_t)(polygon[0]->tex_id + tex_id_start) : NO_TEXTURE,
+            .is_page = 0,
+            .clut_row = (uint8_t)clut_fade,
+            .blend = SW_BLEND_NONE,
+            .cull_backfaces = 1,
+        };
+        sw_add_clipped_triangle(&transformed[0], avg_z + curr_depth_bias, &material);
+        if (n_vertices == 4) {
+            const sw_clip_vertex_t second_half[3] = { transformed[2], transformed[1], transformed[3] };
+            sw_add_clipped_triangle(second_half, avg_z + curr_depth_bias, &material);
+        }
+    }
+
+    tex_id_start = 0;
+}
+
+void renderer_draw_meshes_shaded(const mesh_t* const* meshes, const size_t n_meshes, const transform_t* model_transform, int tex_id_offset) {
+    for (size_t i = 0; i < n_meshes; ++i) {
+        renderer_draw_mesh_shaded(meshes[i], model_transform, 0, 0, tex_id_offset);
+    }
+}
+
+void renderer_draw_mesh_instanced(const mesh_t* mesh, const transform_t* model_transforms, const size_t n_instances, int tex_id_offset) {
+    for (size_t i = 0; i < n_instances; ++i) {
+        renderer_draw_mesh_shaded(mesh, &model_transforms[i], 0, 0, tex_id_offset);
+    }
+}
+
+void renderer_draw_2d_quad(vec2_t tl, vec2_t tr, vec2_t bl, vec2_t br, vec2_t uv_tl, vec2_t uv_br, pixel32_t color, int depth, int texture_id, int is_page) {
+    // Same screen space as the PS1 build: X goes from 0 to 512, and NTSC cuts off the top 16 lines
+    const int y_offset = is_pal ? 0 : -16;
+    const vec2_t positions[4] = { tl, tr, bl, br };
+    const uint8_t u[4] = { uv_tl.x / ONE, uv_br.x / ONE, uv_tl.x / ONE, uv_br.x / ONE };
+    const uint8_t v[4] = { uv_tl.y / ONE, uv_tl.y / ONE, uv_br.y / ONE, uv_br.y / ONE };
+    sw_screen_vertex_t verts[4];
+    for (int i = 0; i < 4; ++i) {
+        verts[i].x = (int32_t)(((int64_t)positions[i].x * SW_RES_X) / (512 * ONE));
+        verts[i].y = (positions[i].y / ONE) + y_offset;
+        verts[i].r = color.r;
+        verts[i].g = color.g;
+        verts[i].b = color.b;
+        verts[i].u = u[i];
+        verts[i].v = v[i];
+    }
+
+    int ot_index = depth + curr_depth_bias;
+    if (ot_index < 0) ot_index = 0;
+    if (ot_index >= ORD_TBL_LENGTH) ot_index = ORD_TBL_LENGTH - 1;
+    const sw_material_t material = {
+        .texture = (uint8_t)texture_id,
+        .is_page = (uint8_t)is_page,
+    };
+    sw_add_triangle(&verts[0], &verts[1], &verts[2], ot_index, &material);
+    sw_add_triangle(&verts[1], &verts[3], &verts[2], ot_index, &material);
+}
+
+void renderer_apply_fade(int fade_level) {
+    // Subtractive full screen tile in front of everything, same curve as the PS1 build
+    if (fade_level <= 0) return;
+    if (fade_level > 255) fade_level = 255;
+    fade_level *= fade_level;
+    fade_level /= 255;
+
+    const sw_material_t material = { .texture = NO_TEXTURE, .blend = SW_BLEND_SUB };
+    const uint8_t level = (uint8_t)fade_level;
+    const sw_screen_vertex_t tl = { 0, 0, level, level, level, 0, 0 };
+    const sw_screen_vertex_t tr = { SW_RES_X, 0, level, level, level, 0, 0 };
+    const sw_screen_vertex_t bl = { 0, SW_RES_Y, level, level, level, 0, 0 };
+    const sw_screen_vertex_t br = { SW_RES_X, SW_RES_Y, level, level, level, 0, 0 };
+    sw_add_triangle(&tl, &tr, &bl, 0, &material);
+    sw_add_triangle(&tr, &br, &bl, 0, &material);
+}
+
+void renderer_draw_particle_system(const particle_system_t* system) {
+    if (system->n_alive == 0) return;
+
+    static const uint8_t blend_modes[BLEND_MODE_COUNT] = {
+        [BLEND_MODE_MIX] = SW_BLEND_MIX,
+        [BLEND_MODE_ADD] = SW_BLEND_ADD,
+        [BLEND_MODE_SUB] = SW_BLEND_SUB,
+    };
+    const int blend_mode = (system->params->blend_mode < BLEND_MODE_COUNT) ? system->params->blend_mode : BLEND_MODE_MIX;
+
+    for (int i = 0; i < system->n_alive; ++i) {
+        sw_clip_vertex_t center;
+        sw_transform(&sw_view_matrix,
+            -(float)system->position_x[i] / (float)COL_SCALE,
+            -(float)system->position_y[i] / (float)COL_SCALE,
+            -(float)system->position_z[i] / (float)COL_SCALE,
+            &center
+        );
+        const float depth = -center.z;
+        if (depth < SW_NEAR_Z) continue;
+
+        // Same size on screen as the OpenGL renderer's billboards
+        const sw_screen_vertex_t projected = sw_project(&center);
+        const int32_t half_w = sw_clamp_coord(((float)system->scale_x[i] / 240.0f) * (float)SW_FOCAL_LENGTH / depth);
+        const int32_t half_h = sw_clamp_coord(((float)system->scale_y[i] / 240.0f) * (float)SW_FOCAL_LENGTH / depth);
+        const uint8_t r = (uint8_t)(system->colour_r[i] / ONE);
+        const uint8_t g = (uint8_t)(system->colour_g[i] / ONE);
+        const uint8_t b = (uint8_t)(system->colour_b[i] / ONE);
+        const sw_screen_vertex_t tl = { projected.x - half_w, projected.y - half_h, r, g, b, 0, 0 };
+        const sw_screen_vertex_t tr = { projected.x + half_w, projected.y - half_h, r, g, b, 255, 0 };
+        const sw_screen_vertex_t bl = { projected.x - half_w, projected.y + half_h, r, g, b, 0, 255 };
+        const sw_screen_vertex_t br = { projected.x + half_w, projected.y + half_h, r, g, b, 255, 255 };
+
+        int ot_index = (int)(depth / 4.0f) + curr_depth_bias;
+        if (ot_index >= ORD_TBL_LENGTH) ot_index = ORD_TBL_LENGTH - 1;
+        const sw_material_t material = {
+            .texture = (uint8_t)(system->params->texture_id + system->curr_frame[i] / ONE),
+            .blend = blend_modes[blend_mode],
+        };
+        sw_add_triangle(&tl, &tr, &bl, ot_index, &material);
+        sw_add_triangle(&tr, &br, &bl, ot_index, &material);
+    }
+}
+
+void renderer_debug_draw_line(vec3_t v0, vec3_t v1, pixel32_t color, const transform_t* model_transform) {
+    const sw_matrix_t model_matrix = sw_model_matrix(model_transform, (float)COL_SCALE, 0);
+    const sw_matrix_t model_view_matrix = sw_matrix_mul(&sw_view_matrix, &model_matrix);
+    sw_clip_vertex_t a;
+    sw_clip_vertex_t b;
+    sw_transform(&model_view_matrix, (float)(v0.x >> 12), (float)(v0.y >> 12), (float)(v0.z >> 12), &a);
+    sw_transform(&model_view_matrix, (float)(v1.x >> 12), (float)(v1.y >> 12), (float)(v1.z >> 12), &b);
+
+    // Pulled slightly towards the camera, so lines show up on top of the surfaces they outline
+    int ot_index = (int)(-(a.z + b.z) / 8.0f) + curr_depth_bias - 16;
+    if (ot_index < 0) ot_index = 0;
+    if (ot_index >= ORD_TBL_LENGTH) return;
+    sw_add_line(&a, &b, ot_index, color);
+}
+
+void renderer_upload_texture(const texture_cpu_t* texture, const uint8_t index) {
+    WARN_IF("texture is larger than 64x64!", texture->width > 64 || texture->height > 64);
+    sw_texture_t* dest = &sw_textures[index];
+    memset(dest->texels, 0, sizeof(dest->texels));
+
+    // The texture is stored in 4bpp format, the left pixel is in the low nibble
+    const int width = (texture->width > 64) ? 64 : texture->width;
+    const int height = (texture->height > 64) ? 64 : texture->height;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t i = (size_t)y * texture->width + x;
+            dest->texels[y * 64 + x] = (texture->data[i / 2] >> ((i & 1) * 4)) & 0x0F;
+        }
+    }
+
+    // 16 palettes, each one fading a bit further into the average color
+    memcpy(dest->clut, texture->palette, sizeof(dest->clut));
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += sizeof(dest->texels) + sizeof(dest->clut);
+}
+
+void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8_t index) {
+    WARN_IF("texture is not a full page!", texture->width != 0 || texture->height != 0); // 0 is interpreted as 256
+    PANIC_IF("texture page index is out of range!", index >= SW_MAX_TEXTURE_PAGES);
+    sw_texture_page_t* dest = &sw_texture_pages[index];
+    memcpy(dest->texels, texture->data, sizeof(dest->texels));
+    memcpy(dest->clut, texture->palette, sizeof(dest->clut));
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += sizeof(dest->texels) + sizeof(dest->clut);
+}
+
+void renderer_set_video_mode(int is_pal) {
+    (void)is_pal;
+}
+
+void renderer_set_depth_bias(int bias) {
+    curr_depth_bias = bias;
+}
+
+int renderer_get_delta_time_raw(void) { return 0; }
+
+int renderer_get_delta_time_ms(void) { return SW_FRAME_TIME_MS; }
+
+int renderer_should_close(void) { return (HEADLESS_N_FRAMES > 0) && (sw_frame_index >= HEADLESS_N_FRAMES); }
+
+int renderer_width(void) { return SW_RES_X; }
+
+int renderer_height(void) { return SW_RES_Y; }
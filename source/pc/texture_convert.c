@@ -0,0 +1,239 @@
+#include "texture_convert.h"
+
+#include "../common.h"
+#include "../memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef TEXTURE_CONVERT_SSSE3
+#include <tmmintrin.h>
+#endif
+
+static pixel32_t* scratch = NULL;
+static size_t scratch_n_pixels = 0;
+
+#ifdef TEXTURE_CONVERT_SSSE3
+static int has_ssse3 = -1; // -1 until the CPU has been asked
+#endif
+
+static pixel32_t expand_4bpp_color(const pixel16_t color) {
+    pixel32_t result;
+    result.r = color.r << 3;
+    result.g = color.g << 3;
+    result.b = color.b << 3;
+    result.a = color.a * 255;
+    return result;
+}
+
+static pixel32_t expand_8bpp_color(const pixel16_t color) {
+    pixel32_t result;
+    result.r = color.r << 3;
+    result.g = color.g << 3;
+    result.b = color.b << 3;
+    result.a = 255 * ((color.r | color.g | color.b) != 0);
+    return result;
+}
+
+void texture_convert_4bpp_scalar(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels) {
+    for (size_t i = 0; i < n_pixels / 2; ++i) {
+        dst[i * 2 + 0] = expand_4bpp_color(palette[(src[i] >> 0) & 0x0F]);
+        dst[i * 2 + 1] = expand_4bpp_color(palette[(src[i] >> 4) & 0x0F]);
+    }
+}
+
+void texture_convert_8bpp_scalar(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels) {
+    for (size_t i = 0; i < n_pixels; ++i) {
+        dst[i] = expand_8bpp_color(palette[src[i]]);
+    }
+}
+
+static void expand_4bpp_palette(pixel32_t* palette32, const pixel16_t* palette) {
+    for (int i = 0; i < 16; ++i) {
+        palette32[i] = expand_4bpp_color(palette[i]);
+    }
+}
+
+// Looks up the texels in a palette that's already expanded, starting at source byte start
+static void texture_convert_4bpp_from(pixel32_t* dst, const uint8_t* src, const pixel32_t* palette32, size_t start, const size_t n_bytes) {
+    for (size_t i = start; i < n_bytes; ++i) {
+        dst[i * 2 + 0] = palette32[(src[i] >> 0) & 0x0F];
+        dst[i * 2 + 1] = palette32[(src[i] >> 4) & 0x0F];
+    }
+}
+
+void texture_convert_4bpp_lookup(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels) {
+    // Expand the palette once instead of once per texel
+    pixel32_t palette32[16];
+    expand_4bpp_palette(palette32, palette);
+    texture_convert_4bpp_from(dst, src, palette32, 0, n_pixels / 2);
+}
+
+#ifdef TEXTURE_CONVERT_SSSE3
+// Converts 16 texels per iteration, returns how many source bytes were done so the caller can finish the rest
+__attribute__((target("ssse3")))
+static size_t texture_convert_4bpp_ssse3_kernel(pixel32_t* dst, const uint8_t* src, const pixel32_t* palette32, size_t n_bytes) {
+    // One 16 byte table per channel, so a single shuffle looks up that channel for 16 texels
+    uint8_t tables[4][16];
+    for (int i = 0; i < 16; ++i) {
+        tables[0][i] = palette32[i].r;
+        tables[1][i] = palette32[i].g;
+        tables[2][i] = palette32[i].b;
+        tables[3][i] = palette32[i].a;
+    }
+    const __m128i table_r = _mm_loadu_si128((const __m128i*)tables[0]);
+    const __m128i table_g = _mm_loadu_si128((const __m128i*)tables[1]);
+    const __m128i table_b = _mm_loadu_si128((const __m128i*)tables[2]);
+    const __m128i table_a = _mm_loadu_si128((const __m128i*)tables[3]);
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 8 <= n_bytes; i += 8) {
+        // Split the nibbles and interleave them back into texel order
+        const __m128i bytes = _mm_loadl_epi64((const __m128i*)&src[i]);
+        const __m128i left = _mm_and_si128(bytes, nibble_mask);
+        const __m128i right = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+        const __m128i indices = _mm_unpacklo_epi8(left, right);
+
+        const __m128i r = _mm_shuffle_epi8(table_r, indices);
+        const __m128i g = _mm_shuffle_epi8(table_g, indices);
+        const __m128i b = _mm_shuffle_epi8(table_b, indices);
+        const __m128i a = _mm_shuffle_epi8(table_a, indices);
+
+        // Interleave the channels into RGBA
+        const __m128i rg_low = _mm_unpacklo_epi8(r, g);
+        const __m128i rg_high = _mm_unpackhi_epi8(r, g);
+        const __m128i ba_low = _mm_unpacklo_epi8(b, a);
+        const __m128i ba_high = _mm_unpackhi_epi8(b, a);
+        __m128i* out = (__m128i*)&dst[i * 2];
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg_low, ba_low));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_low, ba_low));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_high, ba_high));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_high, ba_high));
+    }
+    return i;
+}
+
+void texture_convert_4bpp_ssse3(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels) {
+    pixel32_t palette32[16];
+    expand_4bpp_palette(palette32, palette);
+    const size_t n_bytes = n_pixels / 2;
+    const size_t n_done = texture_convert_4bpp_ssse3_kernel(dst, src, palette32, n_bytes);
+    texture_convert_4bpp_from(dst, src, palette32, n_done, n_bytes);
+}
+#endif
+
+int texture_convert_has_ssse3(void) {
+#ifdef TEXTURE_CONVERT_SSSE3
+    if (has_ssse3 < 0) {
+        __builtin_cpu_init();
+        has_ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    }
+    return has_ssse3;
+#else
+    return 0;
+#endif
+}
+
+void texture_convert_4bpp(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels) {
+#ifdef TEXTURE_CONVERT_SSSE3
+    if (texture_convert_has_ssse3()) {
+        texture_convert_4bpp_ssse3(dst, src, palette, n_pixels);
+        return;
+    }
+#endif
+    texture_convert_4bpp_lookup(dst, src, palette, n_pixels);
+}
+
+void texture_convert_8bpp(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels) {
+    // 256 entries don't fit in a shuffle table, but a plain lookup is still a lot cheaper than expanding every texel
+    pixel32_t palette32[256];
+    for (int i = 0; i < 256; ++i) {
+        palette32[i] = expand_8bpp_color(palette[i]);
+    }
+
+    for (size_t i = 0; i < n_pixels; ++i) {
+        dst[i] = palette32[src[i]];
+    }
+}
+
+pixel32_t* texture_convert_get_scratch(size_t n_pixels) {
+    if (n_pixels > scratch_n_pixels) {
+        if (scratch) mem_free(scratch);
+        scratch = mem_alloc(n_pixels * sizeof(pixel32_t), MEM_CAT_TEXTURE);
+        PANIC_IF("failed to allocate texture conversion buffer", scratch == NULL);
+        scratch_n_pixels = n_pixels;
+    }
+    return scratch;
+}
+
+const char* texture_convert_get_path_name(void) {
+    if (texture_convert_has_ssse3()) return "ssse3";
+    return "lookup";
+}
+
+#ifdef BENCHMARK_MODE
+static uint32_t benchmark_random_state = 0x12345678;
+
+static uint32_t benchmark_random(void) {
+    // Xorshift, so the results don't depend on the C library
+    benchmark_random_state ^= benchmark_random_state << 13;
+    benchmark_random_state ^= benchmark_random_state >> 17;
+    benchmark_random_state ^= benchmark_random_state << 5;
+    return benchmark_random_state;
+}
+
+static void benchmark_randomize(uint8_t* src, size_t n_bytes, pixel16_t* palette, int n_colors) {
+    for (size_t i = 0; i < n_bytes; ++i) {
+        src[i] = (uint8_t)benchmark_random();
+    }
+    for (int i = 0; i < n_colors; ++i) {
+        const uint16_t raw = (uint16_t)benchmark_random();
+        memcpy(&palette[i], &raw, sizeof(raw));
+    }
+}
+
+static int benchmark_elapsed_us(const clock_t start) {
+    return (int)(((clock() - start) * 1000000) / CLOCKS_PER_SEC);
+}
+
+void texture_convert_benchmark(void) {
+    const size_t max_pixels = 256 * 256;
+    uint8_t* src = malloc(max_pixels);
+    pixel16_t* palette = malloc(256 * sizeof(pixel16_t));
+    pixel32_t* dst = malloc(max_pixels * sizeof(pixel32_t));
+    PANIC_IF("failed to allocate texture conversion benchmark buffers", !src || !palette || !dst);
+
+    // 64x64 4bpp textures are what levels are made of, 8bpp pages are 256x256. Correctness is checked by `make test`
+    const int n_textures_4bpp = 1024;
+    const int n_pages_8bpp = 64;
+    const size_t n_texels_4bpp = (size_t)n_textures_4bpp * 64 * 64;
+    const size_t n_texels_8bpp = (size_t)n_pages_8bpp * 256 * 256;
+    benchmark_randomize(src, max_pixels, palette, 256);
+
+    clock_t start = clock();
+    for (int i = 0; i < n_textures_4bpp; ++i) texture_convert_4bpp_scalar(dst, src, palette, 64 * 64);
+    const int scalar_4bpp_us = benchmark_elapsed_us(start);
+    start = clock();
+    for (int i = 0; i < n_textures_4bpp; ++i) texture_convert_4bpp(dst, src, palette, 64 * 64);
+    const int fast_4bpp_us = benchmark_elapsed_us(start);
+
+    start = clock();
+    for (int i = 0; i < n_pages_8bpp; ++i) texture_convert_8bpp_scalar(dst, src, palette, 256 * 256);
+    const int scalar_8bpp_us = benchmark_elapsed_us(start);
+    start = clock();
+    for (int i = 0; i < n_pages_8bpp; ++i) texture_convert_8bpp(dst, src, palette, 256 * 256);
+    const int fast_8bpp_us = benchmark_elapsed_us(start);
+
+    printf("[BENCHMARK] texture conversion 4bpp: %i texels, scalar %i us, %s %i us\n",
+        (int)n_texels_4bpp, scalar_4bpp_us, texture_convert_get_path_name(), fast_4bpp_us);
+    printf("[BENCHMARK] texture conversion 8bpp: %i texels, scalar %i us, lookup %i us\n",
+        (int)n_texels_8bpp, scalar_8bpp_us, fast_8bpp_us);
+
+    free(src);
+    free(palette);
+    free(dst);
+}
+#endif
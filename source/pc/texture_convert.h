@@ -0,0 +1,37 @@
+#ifndef TEXTURE_CONVERT_H
+#define TEXTURE_CONVERT_H
+
+#include "../texture.h"
+
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TEXTURE_CONVERT_SSSE3
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Palettized texture to RGBA8 conversion for the OpenGL renderer. 4bpp textures store the left pixel in the low nibble
+// 4bpp palette entries keep their alpha bit, 8bpp texture pages are opaque unless the color is black
+void texture_convert_4bpp(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels); // Uses SSSE3 shuffles when the CPU supports them
+void texture_convert_4bpp_lookup(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels); // Through a precomputed 32-bit palette, for other CPUs
+#ifdef TEXTURE_CONVERT_SSSE3
+void texture_convert_4bpp_ssse3(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels); // Only call this if texture_convert_has_ssse3() returns 1
+#endif
+void texture_convert_4bpp_scalar(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels); // Reference implementation, one texel at a time
+void texture_convert_8bpp(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels);
+void texture_convert_8bpp_scalar(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels);
+int texture_convert_has_ssse3(void);
+pixel32_t* texture_convert_get_scratch(size_t n_pixels); // Reused between uploads, only valid until the next call
+const char* texture_convert_get_path_name(void);
+
+#ifdef BENCHMARK_MODE
+void texture_convert_benchmark(void); // Times the fast paths against the scalar ones
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,6 +1,7 @@
 #include "renderer.h"
 
 #include "particles.h"
+#include "frustum.h"
 #include "lut.h"
 
 #include <string.h>
@@ -37,6 +38,7 @@ MATRIX view_matrix;
 MATRIX aspect_matrix;
 vec3_t camera_pos;
 vec3_t camera_dir;
+frustum_t frustum;
 
 // Settings
 int horizontal_resolutions[] = {256, 320, 368, 512};
@@ -47,7 +49,6 @@ int is_pal = 0;
 // Misc
 int drawn_first_frame = 0;
 int frame_counter = 0;
-int n_meshes_drawn = 0;
 int delta_time_raw_curr = 0;
 int delta_time_raw_prev = 0;
 int tex_level_start = 0;
@@ -113,6 +114,7 @@ void renderer_init(void) {
 }
 
 void renderer_begin_frame(const transform_t* camera_transform) {
+    renderer_stats_begin_frame();
     mem_stack_release(STACK_TEMP);
 
     // Set the next primitive to draw to be the first primitive in the buffer
@@ -147,10 +149,14 @@ void renderer_begin_frame(const transform_t* camera_transform) {
 	camera_dir.x = view_matrix.m[2][0];
 	camera_dir.y = view_matrix.m[2][1];
 	camera_dir.z = view_matrix.m[2][2];
-    n_meshes_drawn = 0;
+
+    // The screen is 120 units away from the camera, and the aspect matrix squashes widescreen into the same width
+    frustum = frustum_from_camera(camera_transform, ((widescreen ? 427 : 320) * ONE) / 240, (curr_res_y * ONE) / 240, MESH_RENDER_DISTANCE);
+    renderer_set_phase(RENDERER_PHASE_OTHER);
 }
 
 void renderer_end_frame(void) {
+    renderer_set_phase(RENDERER_PHASE_END_FRAME);
     renderer_tick_fade();
     
     // Wait for GPU to finish drawing and V-blank
@@ -179,8 +185,10 @@ void renderer_end_frame(void) {
     
     // Draw Ordering Table
     DrawOTag(ord_tbl[1-drawbuffer] + ORD_TBL_LENGTH - 1);
+    ++renderer_stats.n_draw_calls;
 
     drawn_first_frame = 1;
+    renderer_stats_end_frame();
 }
 
 void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_transform, int local, int facing_camera, int tex_id_offset) {
@@ -188,6 +196,13 @@ void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_tran
         printf("renderer_draw_mesh_shaded: mesh was null!\n");
         return;
     }
+    ++renderer_stats.n_meshes_submitted;
+
+	// If the mesh's bounding box is not inside the viewing frustum, cull it
+    if (!local && frustum_cull_aabb(&frustum, &mesh->bounds, model_transform, facing_camera)) {
+        ++renderer_stats.n_meshes_culled;
+        return;
+    }
     tex_id_start = tex_id_offset;
 
     // Set rotation and translation matrix
@@ -211,11 +226,6 @@ void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_tran
     gte_SetRotMatrix(&model_matrix);
     gte_SetTransMatrix(&model_matrix);
 
-	// If the mesh's bounding box is not inside the viewing frustum, cull it
-    if (frustrum_cull_aabb(mesh->bounds.min, mesh->bounds.max)) return;
-
-    ++n_meshes_drawn;
-
     // Loop over each triangle
     size_t vert_idx = 0;
     if (mesh->optimized_for_single_render_per_frame) {
@@ -279,6 +289,7 @@ void renderer_draw_2d_quad(vec2_t tl, vec2_t tr, vec2_t bl, vec2_t br, vec2_t uv
         );
     }
     addPrim(ord_tbl[drawbuffer] + depth + curr_ot_bias, new_triangle);
+    ++renderer_stats.n_quads;
 }
 
 void renderer_apply_fade(int fade_level) {
@@ -369,6 +380,10 @@ void renderer_upload_texture(const texture_cpu_t* texture, uint8_t index) {
     LoadImage(&rect_palette, (uint32_t*)texture->palette);
     DrawSync(0);
     palettes[index] = rect_palette;
+
+    // VRAM pixels are 16-bit
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += (rect_tex.w * rect_tex.h + rect_palette.w * rect_palette.h) * 2;
 }
 
 void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8_t index) {
@@ -391,6 +406,9 @@ void renderer_upload_8bit_texture_page(const texture_cpu_t* texture, const uint8
     };
     LoadImage(&rect_palette, (uint32_t*)texture->palette);
     DrawSync(0);
+
+    ++renderer_stats.n_texture_uploads;
+    renderer_stats.n_texture_bytes_uploaded += (rect_page.w * rect_page.h + rect_palette.w * rect_palette.h) * 2;
 }
 
 void renderer_set_video_mode(int is_pal) {
@@ -460,8 +478,6 @@ int renderer_get_delta_time_ms(void) {
     return renderer_convert_dt_raw_to_ms(dt_raw);
 }
 
-int renderer_n_meshes_drawn(void) { return n_meshes_drawn; }
-
 int renderer_convert_dt_raw_to_ms(int dt_raw) {
     int dt_ms;
     if (vsync_enable) {
@@ -483,43 +499,44 @@ int renderer_should_close(void) {
     return 0;
 }
 
-void renderer_draw_particle_system(particle_system_t* system, scalar_t dt) {
-    // Loop over the particles in chunks of 3
-    for (int i = 0; i < system->params->n_particles_max; ++i) {
-        particle_t* p = &system->particle_buffer[i];
+void renderer_draw_particle_system(const particle_system_t* system) {
+    if (system->n_alive == 0) return;
 
-        // If none of these are active, don't render them
-        if (p->time_alive > p->total_lifetime) continue;
+    PushMatrix();
+    gte_SetRotMatrix(&view_matrix);
+    gte_SetTransMatrix(&view_matrix);
 
+    for (int i = 0; i < system->n_alive; ++i) {
         // Transform the point
-        gte_ldv0(&p->position);
-        gte_rtps_b();
-
-        // While it's transforming, we update the particle's data
-        p->velocity = vec3_mul(p->velocity, system->params->velocity_multiplier_over_time);
-        p->velocity = vec3_add(p->velocity, vec3_muls(system->params->constant_acceleration, dt));
-        p->position = vec3_add(p->position, vec3_muls(p->velocity, dt));
-        p->scale = vec2_mul(p->scale, system->params->scale_multiplier_over_time);
-        p->curr_frame += dt * system->params->animation_frame_rate;
-        p->curr_frame -= ((p->curr_frame / ONE) > system->params->n_animation_frames) ? system->params->loop_start * ONE : 0;
+        SVECTOR position = {
+            -system->position_x[i] / COL_SCALE,
+            -system->position_y[i] / COL_SCALE,
+            -system->position_z[i] / COL_SCALE,
+        };
+        gte_ldv0(&position);
+        gte_rtps();
 
         // Let's get the transformed point, and base the size on the Z component. The number here is a bit hacky but eh it works right
         svec2_t scenter;
         scalar_t depth;
         gte_stsxy(&scenter);
         gte_stsz(&depth);
-        vec2_t size = vec2_divs(p->scale, depth);
+        if (depth <= 0) continue;
+        if (depth >= ORD_TBL_LENGTH) depth = ORD_TBL_LENGTH - 1;
+        vec2_t size = vec2_divs((vec2_t){system->scale_x[i], system->scale_y[i]}, depth);
         vec2_t center = (vec2_t){scenter.x * ONE, scenter.y * ONE};
         pixel32_t color = {
-            .r = scalar_lerp(p->start_colour.r, p->end_colour.r, scalar_div(p->time_alive, p->total_lifetime)),
-            .g = scalar_lerp(p->start_colour.g, p->end_colour.g, scalar_div(p->time_alive, p->total_lifetime)),
-            .b = scalar_lerp(p->start_colour.b, p->end_colour.b, scalar_div(p->time_alive, p->total_lifetime)),
+            .r = system->colour_r[i] / ONE,
+            .g = system->colour_g[i] / ONE,
+            .b = system->colour_b[i] / ONE,
             .a = 255,
         };
 
         // Render quad
-        renderer_draw_2d_quad_axis_aligned(center, size, (vec2_t){0, 0}, (vec2_t){63, 63}, color, depth, system->params->texture_id + p->curr_frame / ONE, 0);
+        renderer_draw_2d_quad_axis_aligned(center, size, (vec2_t){0, 0}, (vec2_t){63 * ONE, 63 * ONE}, color, depth, system->params->texture_id + system->curr_frame[i] / ONE, 0);
     }
+
+    PopMatrix();
 }
 
 #pragma GCC diagnostic pop
@@ -57,64 +57,6 @@ static inline void copy_rgb_uv(uint8_t const *const src, uint8_t* dest) {
     dest_cast->v = src_cast->v;
 }
 
-static inline int frustrum_cull_aabb(const vec3_t min, const vec3_t max) {
-    return 0;
-    // We will transform these to screen space
-    aligned_position_t vertices[8] = {
-        ((aligned_position_t) {.x = min.x, .y = min.y, .z = min.z}),
-        ((aligned_position_t) {.x = min.x, .y = min.y, .z = max.z}),
-        ((aligned_position_t) {.x = min.x, .y = max.y, .z = min.z}),
-        ((aligned_position_t) {.x = min.x, .y = max.y, .z = max.z}),
-        ((aligned_position_t) {.x = max.x, .y = min.y, .z = min.z}),
-        ((aligned_position_t) {.x = max.x, .y = min.y, .z = max.z}),
-        ((aligned_position_t) {.x = max.x, .y = max.y, .z = min.z}),
-        ((aligned_position_t) {.x = max.x, .y = max.y, .z = max.z}),
-    };
-
-    // Transform vertices and store them back
-    // 0, 1, 2
-    gte_ldv3(&vertices[0].x, &vertices[1].x, &vertices[2].x);
-    gte_rtpt();
-    gte_stsxy3(&vertices[0].x, &vertices[1].x, &vertices[2].x);
-    gte_stsz3(&vertices[0].z, &vertices[1].z, &vertices[2].z);
-    // 3, 4, 5
-    gte_ldv3(&vertices[3].x, &vertices[4].x, &vertices[5].x);
-    gte_rtpt();
-    gte_stsxy3(&vertices[3].x, &vertices[4].x, &vertices[5].x);
-    gte_stsz3(&vertices[3].z, &vertices[4].z, &vertices[5].z);
-    // 6, 7
-    gte_ldv01(&vertices[6].x, &vertices[7].x);
-    gte_rtpt();
-    gte_stsxy01(&vertices[6].x, &vertices[7].x);
-    gte_stsz01(&vertices[6].z, &vertices[7].z);
-
-    // Find screen aligned bounding box
-    aligned_position_t after_min = (aligned_position_t){.x = INT16_MAX, .y = INT16_MAX, .z = INT16_MAX};
-    aligned_position_t after_max = (aligned_position_t){.x = INT16_MIN, .y = INT16_MIN, .z = INT16_MIN};
-    
-    for (size_t i = 0; i < 8; ++i) {
-        if (vertices[i].x < after_min.x) after_min.x = vertices[i].x;
-        if (vertices[i].x > after_max.x) after_max.x = vertices[i].x;
-        if (vertices[i].y < after_min.y) after_min.y = vertices[i].y;
-        if (vertices[i].y > after_max.y) after_max.y = vertices[i].y;
-        if (vertices[i].z < after_min.z) after_min.z = vertices[i].z;
-        if (vertices[i].z > after_max.z) after_max.z = vertices[i].z;
-    }
-
-    // If this screen aligned bounding box is off screen, do not draw this mesh
-    #define FRUSCUL_PAD_X 0 // these are in case I ever want to add a safe zone
-    #define FRUSCUL_PAD_Y 0 // or for debugging.
-    if (after_max.x < 0+FRUSCUL_PAD_X) return 1; // mesh is to the left of the screen
-    if (after_max.y < 0+FRUSCUL_PAD_Y) return 1; // mesh is above the screen
-    if (after_max.z == 0) return 1; // mesh is behind the screen
-    if (after_min.z > MESH_RENDER_DISTANCE) return 1; // mesh is too far away
-    if (after_min.x > res_x-FRUSCUL_PAD_X) return 1; // mesh is to the right of the screen
-    if (after_min.y > curr_res_y-FRUSCUL_PAD_Y) return 1; // mesh is below the screen
-    #undef FRUSCUL_PAD_X
-    #undef FRUSCUL_PAD_Y
-    return 0;
-}
-
 static inline vertex_3d_t get_halfway_point(const vertex_3d_t v0, const vertex_3d_t v1) {
     return (vertex_3d_t) {
         .x = v0.x + ((v1.x - v0.x) >> 1),
@@ -225,6 +167,9 @@ void draw_level1_subdivided_triangle(const mesh_t* mesh, const size_t vert_idx,
     setPolyGT3(tri_250);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_250);
     setPolyGT3(tri_031);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_031);
     setPolyGT3(tri_142);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_142);
+    renderer_stats.n_quads += 1;
+    renderer_stats.n_triangles += 5;
+    ++renderer_stats.n_subdivided[1];
 }
 
 void draw_level2_subdivided_triangle(const mesh_t* mesh, const size_t vert_idx, const size_t poly_idx, scalar_t otz) {
@@ -493,6 +438,9 @@ void draw_level2_subdivided_triangle(const mesh_t* mesh, const size_t vert_idx,
     setPolyGT3(tri_2EC);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_2EC);
     setPolyGT3(tri_2DA);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_2DA);
     setPolyGT3(tri_A60);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_A60);
+    renderer_stats.n_quads += 6;
+    renderer_stats.n_triangles += 10;
+    ++renderer_stats.n_subdivided[2];
 }
 
 void draw_level1_subdivided_quad(const mesh_t* mesh, const size_t vert_idx, const size_t poly_idx, scalar_t otz) {
@@ -625,6 +573,9 @@ void draw_level1_subdivided_quad(const mesh_t* mesh, const size_t vert_idx, cons
     setPolyGT3(tri_136);  addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_136);
     setPolyGT3(tri_327);  addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_327);
     setPolyGT3(tri_205);  addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_205);
+    renderer_stats.n_quads += 4;
+    renderer_stats.n_triangles += 4;
+    ++renderer_stats.n_subdivided[1];
 }
 
 void draw_level2_subdivided_quad(const mesh_t* mesh, const size_t vert_idx, const size_t poly_idx, scalar_t otz) {
@@ -1084,6 +1035,9 @@ void draw_level2_subdivided_quad(const mesh_t* mesh, const size_t vert_idx, cons
     setPolyGT3(tri_62D);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_62D);
     setPolyGT3(tri_27E);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_27E);
     setPolyGT3(tri_70F);    addPrim(ord_tbl[drawbuffer] + otz + curr_ot_bias, tri_70F);
+    renderer_stats.n_quads += 16;
+    renderer_stats.n_triangles += 8;
+    ++renderer_stats.n_subdivided[2];
 }
 
 // Transform and add to queue a textured, shaded triangle, with automatic subdivision based on size, fading to solid color in the distance.
@@ -1137,6 +1091,8 @@ static inline void draw_tex_triangle3d_fancy(const mesh_t* mesh, const size_t ve
     gte_stsxy3_gt3(&mesh->tex_tris[drawbuffer][poly_idx]);
     SET_DISTANCE_FADE(&mesh->tex_tris[drawbuffer][poly_idx], clut_fade);
     addPrim(ord_tbl[drawbuffer] + avg_z + curr_ot_bias, &mesh->tex_tris[drawbuffer][poly_idx]);
+    ++renderer_stats.n_triangles;
+    ++renderer_stats.n_subdivided[0];
     return;
 }
 
@@ -1233,6 +1189,8 @@ static inline void draw_tex_quad3d_fancy(const mesh_t* mesh, const size_t vert_i
     // Store final bit of data into primitive struct
     SET_DISTANCE_FADE(&mesh->tex_quads[drawbuffer][poly_idx], clut_fade);
     addPrim(ord_tbl[drawbuffer] + avg_z + curr_ot_bias, &mesh->tex_quads[drawbuffer][poly_idx]);
+    ++renderer_stats.n_quads;
+    ++renderer_stats.n_subdivided[0];
     return;
 }
 
@@ -1295,6 +1253,8 @@ static inline void draw_tex_triangle3d_fancy_no_precomp(const mesh_t* mesh, cons
     tri->tpage = mesh->tex_quads[0][poly_idx].tpage;
     SET_DISTANCE_FADE(tri, clut_fade);
     addPrim(ord_tbl[drawbuffer] + avg_z + curr_ot_bias, tri);
+    ++renderer_stats.n_triangles;
+    ++renderer_stats.n_subdivided[0];
     return;
 }
 
@@ -1399,6 +1359,8 @@ static inline void draw_tex_quad3d_fancy_no_precomp(const mesh_t* mesh, const si
     poly->tpage = mesh->tex_quads[0][poly_idx].tpage;
     SET_DISTANCE_FADE(poly, clut_fade);
     addPrim(ord_tbl[drawbuffer] + avg_z + curr_ot_bias, poly);
+    ++renderer_stats.n_quads;
+    ++renderer_stats.n_subdivided[0];
     return;
 }
 
@@ -19,6 +19,7 @@ extern "C" {
 #include "common.h"
 #include "mesh.h"
 #include "vec2.h"
+#include "particles.h"
 
 #include <stdint.h>
     
@@ -26,8 +27,48 @@ extern "C" {
 #define RES_X 384
 #define RES_Y_PAL 256
 #define RES_Y_NTSC 240
-#define N_SECTIONS_PLAYER_CAN_BE_IN_AT_ONCE 4
+#define N_SECTIONS_PLAYER_CAN_BE_IN_AT_ONCE VISLIST_MAX_CAMERA_LEAVES
+#define LOD_DISTANCE_FAR 4800 // In graphics units. Sections further away from the camera than this are drawn with their LOD mesh
+#define LOD_DISTANCE_NEAR 4000 // and only switch back to full detail once they're closer than this, so they don't flicker at the edge
+#define LOD_MAX_MESHES VISLIST_MAX_SECTIONS // Meshes after this are always drawn in full detail
+#define PORTAL_MAX_DEPTH 6 // Portals the camera can look through in a row. Frames that need more only use the vislist
+#define PORTAL_MAX_TESTS 128 // Same for frames that need to test more portals than this
+#define PORTAL_MARGIN 32 // In graphics units. Looking through a portal this close to the camera doesn't narrow the view down
 #define NO_TEXTURE 255
+#define RENDERER_STATS_CSV_HEADER "meshes_submitted,meshes_culled,meshes_lod,lod_switches,vis_traversals,vis_nodes_tested,portals_tested,portal_culled,entities_hidden,triangles,quads,subdiv0,subdiv1,subdiv2,draw_calls,state_changes,buffer_bytes,texture_uploads,texture_bytes,us_begin_frame,us_level,us_entities,us_ui,us_end_frame,us_other\n"
+
+typedef enum {
+    RENDERER_PHASE_BEGIN_FRAME,
+    RENDERER_PHASE_LEVEL,
+    RENDERER_PHASE_ENTITIES,
+    RENDERER_PHASE_UI,
+    RENDERER_PHASE_END_FRAME, // Includes waiting for the GPU and vsync
+    RENDERER_PHASE_OTHER, // Game logic that isn't part of any of the above
+    N_RENDERER_PHASES,
+} renderer_phase_t;
+
+typedef struct {
+    uint32_t n_meshes_submitted; // Including the culled ones
+    uint32_t n_meshes_culled;
+    uint32_t n_meshes_lod; // Drawn with their LOD mesh instead of the full one
+    uint32_t n_lod_switches; // Meshes that switched between full detail and LOD this frame
+    uint32_t n_vis_traversals; // Vis BVH traversals to find the camera's vis leaves, 0 if last frame's leaves were still valid
+    uint32_t n_vis_nodes_tested;
+    uint32_t n_portals_tested;
+    uint32_t n_sections_portal_culled; // Visible according to the vislist, but not through any portal. Without portals, these would have been submitted too
+    uint32_t n_entity_meshes_hidden; // Not submitted because the entity's level section wasn't drawn
+    uint32_t n_triangles; // Primitives sent to the GPU, after culling and subdivision
+    uint32_t n_quads;
+    uint32_t n_subdivided[3]; // PS1 only: polygons drawn as is, subdivided once, and subdivided twice
+    uint32_t n_draw_calls;
+    uint32_t n_state_changes; // PC only
+    uint32_t n_buffer_bytes_uploaded; // Vertex data streamed to the GPU
+    uint32_t n_texture_uploads;
+    uint32_t n_texture_bytes_uploaded;
+    uint32_t time_us[N_RENDERER_PHASES]; // CPU time spent in each phase
+} renderer_stats_t;
+
+extern renderer_stats_t renderer_stats; // The frame that's currently being drawn. Uploads between frames count towards the next one
 
 const static transform_t id_transform = { {0,0,0},{0,0,0}, {-4096, -4096, -4096} };
 extern int widescreen;
@@ -36,10 +77,11 @@ extern int widescreen;
 void renderer_init(void); // Initializes the renderer by configuring the GPU, setting the video mode, and preparing the drawing environment
 void renderer_begin_frame(const transform_t* camera_transform); // Applies the camera transform to the renderer, preparing it for a new frame
 void renderer_end_frame(void); // Draws the render queue, swaps the drawbuffer, clears the render queue, and applies the display environments
-void renderer_draw_model_shaded(const model_t* model, const transform_t* model_transform, visfield_t* vislist, int tex_id_offset); // Draws a 3D model at a given transform using shaded triangle primitives
+void renderer_draw_model_shaded(const model_t* model, const model_t* model_lod, const transform_t* model_transform, const vislist_t* vislist, int tex_id_offset); // Draws a 3D model at a given transform using shaded triangle primitives. model_lod is optional, and has the same meshes in lower detail to draw instead when they're far away
 void renderer_draw_mesh_shaded(const mesh_t* mesh, const transform_t* model_transform, int local, int facing_camera, int tex_id_offset); // Draws a 3D mesh at a given transform using shaded triangle primitives. Setting local to 1 draws it relative to the camera view.
 void renderer_draw_2d_quad_axis_aligned(vec2_t center, vec2_t size, vec2_t uv_tl, vec2_t uv_br, pixel32_t color, int depth, int texture_id, int is_page);
 void renderer_draw_2d_quad(vec2_t tl, vec2_t tr, vec2_t bl, vec2_t br, vec2_t uv_tl, vec2_t uv_br, pixel32_t color, int depth, int texture_id, int is_page);
+void renderer_draw_particle_system(const particle_system_t* system); // Draws the alive particles of a system as camera facing quads. Does not update the system, see particle_system_update()
 void renderer_draw_text(vec2_t pos, const char* text, const int text_type, const int centered, const pixel32_t color);
 void renderer_apply_fade(int fade_level);
 void renderer_tick_fade(void);
@@ -58,11 +100,61 @@ int renderer_get_delta_time_ms(void);
 int renderer_convert_dt_raw_to_ms(int dt_raw);
 int renderer_should_close(void);
 void renderer_set_depth_bias(int bias);
-int renderer_n_meshes_drawn(void);
+const renderer_stats_t* renderer_get_stats(void); // Stats of the last finished frame
+void renderer_set_phase(renderer_phase_t phase); // CPU time from now until the next phase change counts towards this phase
+void renderer_stats_begin_frame(void); // Called by the backends at the start of renderer_begin_frame()
+void renderer_stats_end_frame(void); // Called by the backends at the end of renderer_end_frame()
+int renderer_stats_to_csv(char* buffer, size_t size, const renderer_stats_t* stats); // Formats the stats as one CSV line, in the same order as RENDERER_STATS_CSV_HEADER
 int renderer_get_camera_level_section(vec3_t pos, const vislist_t vis);
+void renderer_set_portal_culling(int enabled); // On by default, only does something for levels with portals
+int renderer_get_portal_culling(void);
+int renderer_section_visible(uint32_t section); // Whether the last renderer_draw_model_shaded() with a vislist drew this section. Without a vislist, every section counts as drawn
 int renderer_width(void);
 int renderer_height(void);
 
+#ifdef _PC
+void renderer_upload_mesh(mesh_t* mesh, stack_t stack); // Copies an indexed mesh into the GPU vertex and index arena sections for its stack once, so drawing it doesn't upload anything. Meshes that don't fit get streamed every draw instead
+void renderer_draw_meshes_shaded(const mesh_t* const* meshes, size_t n_meshes, const transform_t* model_transform, int tex_id_offset); // Draws every mesh that's resident in the arenas with one glMultiDrawElementsBaseVertex call, and streams the rest
+void renderer_draw_mesh_instanced(const mesh_t* mesh, const transform_t* model_transforms, size_t n_instances, int tex_id_offset); // Draws one copy of a resident mesh per transform with a single instanced draw call, culling each copy on its own
+void renderer_flush(void); // Sorts and draws everything queued so far. Called by renderer_end_frame(), or earlier when something needs to read the framebuffer
+#endif
+
+#if defined(_PC) && !defined(_HEADLESS) && !defined(_LEVEL_EDITOR)
+#ifndef DYNAMIC_RES_MIN_SCALE
+#define DYNAMIC_RES_MIN_SCALE 50 // Lowest internal resolution, in percent of the 512x240 base resolution
+#endif
+#ifndef DYNAMIC_RES_MAX_SCALE
+#define DYNAMIC_RES_MAX_SCALE 100 // Above 100 it supersamples when there's time left
+#endif
+#ifndef DYNAMIC_RES_STEP
+#define DYNAMIC_RES_STEP 10 // The resolution only changes in steps of this many percent, so the framebuffer isn't resized every frame
+#endif
+#ifndef DYNAMIC_RES_TARGET_FPS
+#define DYNAMIC_RES_TARGET_FPS 60 // Halved when the frame rate is limited to 30 fps
+#endif
+#define DYNAMIC_RES_N_BUCKETS (((DYNAMIC_RES_MAX_SCALE - DYNAMIC_RES_MIN_SCALE) / DYNAMIC_RES_STEP) + 1)
+
+typedef struct {
+    int enabled;
+    int bucket; // Index into scale_percent
+    int scale_percent[DYNAMIC_RES_N_BUCKETS];
+    uint32_t time_ms[DYNAMIC_RES_N_BUCKETS]; // Total time spent at each scale
+    uint32_t cpu_us; // Last frame, without waiting for vsync
+    uint32_t gpu_us; // A few frames old, the timer queries are only read once the GPU is done with them
+    uint32_t smoothed_us; // CPU plus GPU time, averaged over a few frames. This is what the scale is based on
+    uint32_t target_us;
+} renderer_dynamic_res_t;
+
+const renderer_dynamic_res_t* renderer_get_dynamic_res(void);
+void renderer_set_dynamic_res_enabled(int enabled); // Disabling it goes back to the highest scale
+#endif
+
+#ifdef _HEADLESS
+int renderer_dump_frame(const char* path); // Writes the software renderer's framebuffer to a binary PPM file. Returns 0 on failure
+const uint16_t* renderer_get_framebuffer(void); // renderer_width() x renderer_height() pixels, 15-bit color in the PS1's VRAM format
+int renderer_get_cpu_frame_time_us(void); // Time between the last renderer_begin_frame() and renderer_end_frame(), including the game logic in between
+#endif
+
 #ifdef _LEVEL_EDITOR
 float* renderer_debug_perspective_matrix(void);
 float* renderer_debug_view_matrix(void);
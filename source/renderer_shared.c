@@ -1,8 +1,18 @@
 #include "renderer.h"
+#include "frustum.h"
 #include "lut.h"
 
+#include <stdint.h>
 #include <string.h>
 
+#ifdef _PSX
+#include <hwregs_c.h>
+#elif defined(_NDS)
+#include <nds.h>
+#else
+#include <time.h>
+#endif
+
 // This file contains code that's either the exact same across platforms,
 // or so similar that it makes sense to put it in the same file with ifdefs.
 
@@ -10,6 +20,25 @@
 uint8_t tex_id_start = 0;
 int n_sections;
 int sections[N_SECTIONS_PLAYER_CAN_BE_IN_AT_ONCE];
+extern frustum_t frustum; // Set by every backend in renderer_begin_frame()
+
+// One bit per mesh, set while it's drawn with its LOD mesh. Only one model at a time keeps its LOD state
+static const model_t* lod_model = NULL;
+static uint32_t lod_selected[LOD_MAX_MESHES / 32];
+
+// Portal traversal state, one entry per portal on the path from the camera's section
+typedef struct {
+    uint16_t section;
+    uint16_t cursor; // Next entry in section_portals to look through
+    uint16_t portal; // The portal this section was entered through
+} portal_step_t;
+
+static int portal_culling_enabled = 1;
+
+// The level sections that were drawn, so entities in the other ones can be skipped
+static uint32_t visible_sections[VISLIST_MAX_WORDS];
+static uint32_t n_visible_section_words = 0; // 0 if every section was drawn
+static frustum_t portal_frusta[PORTAL_MAX_DEPTH + 1]; // What can be seen at each step of the path
 
 int renderer_get_camera_level_section(vec3_t pos, const vislist_t vis) {
     // Get player position
@@ -19,15 +48,37 @@ int renderer_get_camera_level_section(vec3_t pos, const vislist_t vis) {
         -pos.z / COL_SCALE,
     };
     n_sections = 0;
+    if (vis.bvh_root == NULL) return 0;
+
+    // Most frames the camera hasn't gone far, so try last frame's leaves first
+    vislist_cache_t* cache = vis.cache;
+    if (
+        cache->valid &&
+        position.x >= cache->min.x &&  position.x <= cache->max.x &&
+        position.y >= cache->min.y &&  position.y <= cache->max.y &&
+        position.z >= cache->min.z &&  position.z <= cache->max.z
+    ) {
+        for (int i = 0; i < cache->n_leaves; ++i) {
+            sections[n_sections++] = cache->leaves[i];
+        }
+        return n_sections;
+    }
+    ++renderer_stats.n_vis_traversals;
 
-    // Find all the vis leaf nodes we're currently inside of
-    uint32_t node_stack[32] = {0};
-    uint32_t node_handle_ptr = 0;
-    uint32_t node_add_ptr = 1;
+    // While traversing, shrink a box around the camera so it stays inside every node that was hit, and outside every node
+    // that was missed. Anywhere in that box the same nodes get hit, so the same leaves are found
+    svec3_t box_min = { INT16_MIN, INT16_MIN, INT16_MIN };
+    svec3_t box_max = { INT16_MAX, INT16_MAX, INT16_MAX };
 
-    while ((node_handle_ptr != node_add_ptr) && (n_sections < N_SECTIONS_PLAYER_CAN_BE_IN_AT_ONCE)) {
+    // Find all the vis leaf nodes we're currently inside of. The stack is sized from the depth of the BVH, so it can't overflow
+    uint32_t* node_stack = vis.node_stack;
+    uint32_t stack_size = 1;
+    node_stack[0] = 0;
+
+    while ((stack_size > 0) && (n_sections < N_SECTIONS_PLAYER_CAN_BE_IN_AT_ONCE)) {
         // check a node
-        visbvh_node_t* node = &vis.bvh_root[node_stack[node_handle_ptr]];
+        const visbvh_node_t* node = &vis.bvh_root[node_stack[--stack_size]];
+        ++renderer_stats.n_vis_nodes_tested;
 
         // If a node was hit
         if (
@@ -35,13 +86,18 @@ int renderer_get_camera_level_section(vec3_t pos, const vislist_t vis) {
             position.y >= node->min.y &&  position.y <= node->max.y &&
             position.z >= node->min.z &&  position.z <= node->max.z
         ) {
+            if (node->min.x > box_min.x) box_min.x = node->min.x;
+            if (node->min.y > box_min.y) box_min.y = node->min.y;
+            if (node->min.z > box_min.z) box_min.z = node->min.z;
+            if (node->max.x < box_max.x) box_max.x = node->max.x;
+            if (node->max.y < box_max.y) box_max.y = node->max.y;
+            if (node->max.z < box_max.z) box_max.z = node->max.z;
+
             // If the node is an interior node
             if ((node->child_or_vis_index & 0x80000000) == 0) {
-                // Add the 2 children to the stack
-                node_stack[node_add_ptr] = node->child_or_vis_index;
-                node_add_ptr = (node_add_ptr + 1) % 32;
-                node_stack[node_add_ptr] = node->child_or_vis_index + 1;
-                node_add_ptr = (node_add_ptr + 1) % 32;
+                // Add the 2 children to the stack, the first child goes on top so it's checked first
+                node_stack[stack_size++] = node->child_or_vis_index + 1;
+                node_stack[stack_size++] = node->child_or_vis_index;
             }
             else {
                 // Add this node index to the list
@@ -49,7 +105,21 @@ int renderer_get_camera_level_section(vec3_t pos, const vislist_t vis) {
             }
         }
 
-        node_handle_ptr = (node_handle_ptr + 1) % 32;
+        // Otherwise the camera is outside of it on at least one axis, cut the box off there
+        else if (position.x < node->min.x) { if (node->min.x - 1 < box_max.x) box_max.x = node->min.x - 1; }
+        else if (position.x > node->max.x) { if (node->max.x + 1 > box_min.x) box_min.x = node->max.x + 1; }
+        else if (position.y < node->min.y) { if (node->min.y - 1 < box_max.y) box_max.y = node->min.y - 1; }
+        else if (position.y > node->max.y) { if (node->max.y + 1 > box_min.y) box_min.y = node->max.y + 1; }
+        else if (position.z < node->min.z) { if (node->min.z - 1 < box_max.z) box_max.z = node->min.z - 1; }
+        else if (position.z > node->max.z) { if (node->max.z + 1 > box_min.z) box_min.z = node->max.z + 1; }
+    }
+
+    cache->valid = 1;
+    cache->min = box_min;
+    cache->max = box_max;
+    cache->n_leaves = n_sections;
+    for (int i = 0; i < n_sections; ++i) {
+        cache->leaves[i] = sections[i];
     }
 
     return n_sections; // -1 means no section
@@ -101,40 +171,238 @@ void renderer_debug_draw_sphere(const sphere_t sphere) {
     renderer_debug_draw_line(sphere.center, vec3_add(sphere.center, vec3_mul(vec3_from_int32s(-sphere.radius, 0, -sphere.radius), vec3_from_scalar(2896))), white, &id_transform);
 }
 
-void renderer_draw_model_shaded(const model_t* model, const transform_t* model_transform, visfield_t* vislist, int tex_id_offset) {
+static const mesh_t* renderer_select_lod(const model_t* model, const model_t* model_lod, const transform_t* model_transform, const size_t index) {
+    const mesh_t* mesh = &model->meshes[index];
+    if (!model_lod || index >= LOD_MAX_MESHES) return mesh;
+
+    // Distance from the camera to the closest point of the bounding box, in graphics units. Capped per axis so it can't overflow
+    int64_t box_min[3];
+    int64_t box_max[3];
+    frustum_world_box(&mesh->bounds, model_transform, box_min, box_max);
+    const scalar_t camera[3] = { frustum.position.x, frustum.position.y, frustum.position.z };
+    int64_t distance_squared = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        int64_t delta = 0;
+        if (camera[axis] < box_min[axis]) delta = box_min[axis] - camera[axis];
+        else if (camera[axis] > box_max[axis]) delta = camera[axis] - box_max[axis];
+        if (delta > (LOD_DISTANCE_FAR * 2)) delta = LOD_DISTANCE_FAR * 2;
+        distance_squared += delta * delta;
+    }
+
+    uint32_t* word = &lod_selected[index / 32];
+    const uint32_t bit = 1u << (index % 32);
+    if ((*word & bit) && distance_squared < (int64_t)LOD_DISTANCE_NEAR * LOD_DISTANCE_NEAR) {
+        *word &= ~bit;
+        ++renderer_stats.n_lod_switches;
+    }
+    else if (!(*word & bit) && distance_squared > (int64_t)LOD_DISTANCE_FAR * LOD_DISTANCE_FAR) {
+        *word |= bit;
+        ++renderer_stats.n_lod_switches;
+    }
+
+    if (*word & bit) {
+        ++renderer_stats.n_meshes_lod;
+        return &model_lod->meshes[index];
+    }
+    return mesh;
+}
+
+static void renderer_get_portal_corners(const portal_t* portal, const transform_t* model_transform, vec3_t* corners) {
+    for (int i = 0; i < 4; ++i) {
+        corners[i].x = (scalar_t)((((int64_t)portal->corners[i].x * model_transform->scale.x) >> 12) + model_transform->position.x);
+        corners[i].y = (scalar_t)((((int64_t)portal->corners[i].y * model_transform->scale.y) >> 12) + model_transform->position.y);
+        corners[i].z = (scalar_t)((((int64_t)portal->corners[i].z * model_transform->scale.z) >> 12) + model_transform->position.z);
+    }
+}
+
+static int renderer_camera_in_bounds(const aabb_t* bounds, const transform_t* model_transform) {
+    int64_t box_min[3];
+    int64_t box_max[3];
+    frustum_world_box(bounds, model_transform, box_min, box_max);
+    const scalar_t camera[3] = { frustum.position.x, frustum.position.y, frustum.position.z };
+    for (int axis = 0; axis < 3; ++axis) {
+        if (camera[axis] < box_min[axis] || camera[axis] > box_max[axis]) return 0;
+    }
+    return 1;
+}
+
+static int renderer_camera_near_portal(const vec3_t* corners) {
+    const scalar_t camera[3] = { frustum.position.x, frustum.position.y, frustum.position.z };
+    for (int axis = 0; axis < 3; ++axis) {
+        scalar_t min = INT32_MAX;
+        scalar_t max = INT32_MIN;
+        for (int i = 0; i < 4; ++i) {
+            const scalar_t value = (axis == 0) ? corners[i].x : (axis == 1) ? corners[i].y : corners[i].z;
+            if (value < min) min = value;
+            if (value > max) max = value;
+        }
+        if (camera[axis] < min - PORTAL_MARGIN || camera[axis] > max + PORTAL_MARGIN) return 0;
+    }
+    return 1;
+}
+
+// Starting from the sections the camera is in, walks through every portal that's in view, narrowing the frustum down to
+// the opening each time. Sections with portals that weren't reached get cleared from combined. Returns 0 without touching
+// combined if the camera isn't in a section with portals, or if the walk gets too long
+static int renderer_cull_portals(const model_t* model, const transform_t* model_transform, const vislist_t* vislist, uint32_t* combined) {
+    const uint16_t* start = vislist->section_portals_start;
+    const uint32_t n_words = vislist->n_vis_words;
+    uint32_t reached[VISLIST_MAX_WORDS] = { 0 };
+    portal_step_t path[PORTAL_MAX_DEPTH + 1];
+    int n_tests = 0;
+    int found_camera = 0;
+
+    for (uint32_t word = 0; word < n_words; ++word) {
+        uint32_t bits = combined[word];
+        while (bits != 0) {
+            const uint32_t section = (word * 32) + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (section >= model->n_meshes) break;
+            if (start[section] == start[section + 1] || !renderer_camera_in_bounds(&model->meshes[section].bounds, model_transform)) continue;
+            found_camera = 1;
+            reached[word] |= 1u << (section % 32);
+
+            int depth = 0;
+            path[0] = (portal_step_t){ (uint16_t)section, start[section], 0xFFFF };
+            portal_frusta[0] = frustum;
+            while (depth >= 0) {
+                portal_step_t* step = &path[depth];
+                if (step->cursor == start[step->section + 1]) {
+                    --depth;
+                    continue;
+                }
+                const uint16_t portal_index = vislist->section_portals[step->cursor++];
+
+                // Don't go back through a portal that's already on the path
+                int on_path = 0;
+                for (int i = 1; i <= depth; ++i) {
+                    if (path[i].portal == portal_index) on_path = 1;
+                }
+                if (on_path) continue;
+
+                if (++n_tests > PORTAL_MAX_TESTS) return 0;
+                ++renderer_stats.n_portals_tested;
+                const portal_t* portal = &vislist->portals[portal_index];
+                vec3_t corners[4];
+                renderer_get_portal_corners(portal, model_transform, corners);
+                if (frustum_cull_points(&portal_frusta[depth], corners, 4)) continue;
+
+                const uint16_t next = portal->sections[(portal->sections[0] == step->section) ? 1 : 0];
+                reached[next / 32] |= 1u << (next % 32);
+
+                // The only portal out of the next section is the one we came through
+                if (start[next + 1] - start[next] <= 1) continue;
+                if (depth == PORTAL_MAX_DEPTH) return 0;
+
+                if (renderer_camera_near_portal(corners)) portal_frusta[depth + 1] = portal_frusta[depth];
+                else portal_frusta[depth + 1] = frustum_through_portal(&portal_frusta[depth], frustum.n_planes, corners, 4);
+                ++depth;
+                path[depth] = (portal_step_t){ next, start[next], portal_index };
+            }
+        }
+    }
+    if (!found_camera) return 0;
+
+    // Sections without portals aren't part of any of this, so those are left to the vislist
+    for (uint32_t word = 0; word < n_words; ++word) {
+        uint32_t bits = combined[word] & ~reached[word];
+        while (bits != 0) {
+            const uint32_t section = (word * 32) + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (start[section] == start[section + 1]) continue;
+            combined[word] &= ~(1u << (section % 32));
+            ++renderer_stats.n_sections_portal_culled;
+        }
+    }
+    return 1;
+}
+
+void renderer_set_portal_culling(const int enabled) {
+    portal_culling_enabled = enabled;
+}
+
+int renderer_get_portal_culling(void) {
+    return portal_culling_enabled;
+}
+
+int renderer_section_visible(const uint32_t section) {
+    if (section >= n_visible_section_words * 32) return 1;
+    return (visible_sections[section / 32] >> (section % 32)) & 1;
+}
+
+void renderer_draw_model_shaded(const model_t* model, const model_t* model_lod, const transform_t* model_transform, const vislist_t* vislist, int tex_id_offset) {
 	if (!model) return;
     tex_id_start = tex_id_offset;
 
+    // A different model doesn't get to inherit the LOD state of the previous one
+    if (model_lod && lod_model != model) {
+        memset(lod_selected, 0, sizeof(lod_selected));
+        lod_model = model;
+    }
+
 #ifdef _LEVEL_EDITOR
 	renderer_set_drawing_entity_id(255);
 #endif
 
-    if (vislist == NULL || n_sections == 0) {
+#ifdef _PC
+    // On PC the level meshes live in one vertex buffer, so the visible ones get collected and submitted together
+    const mesh_t* visible_meshes[128];
+    size_t n_visible_meshes = 0;
+#endif
+
+    if (vislist == NULL || vislist->n_vis_words == 0 || n_sections == 0) {
+        n_visible_section_words = 0;
         for (size_t i = 0; i < model->n_meshes; ++i) {
-            renderer_draw_mesh_shaded(&model->meshes[i], model_transform, 0, 0, tex_level_start);
+#ifdef _PC
+            visible_meshes[n_visible_meshes++] = renderer_select_lod(model, model_lod, model_transform, i);
+            if (n_visible_meshes == 128) {
+                renderer_draw_meshes_shaded(visible_meshes, n_visible_meshes, model_transform, tex_level_start);
+                n_visible_meshes = 0;
+            }
+#else
+            renderer_draw_mesh_shaded(renderer_select_lod(model, model_lod, model_transform, i), model_transform, 0, 0, tex_level_start);
+#endif
         }
     }
     else {
-        // Determine which meshes to render
-        visfield_t combined = { 0, 0, 0, 0 };
-
-        // Get all the vislist bitfields and combine them together
+        // Combine the bitsets of all the sections the camera is in, a word at a time
+        const uint32_t n_words = vislist->n_vis_words;
+        uint32_t combined[VISLIST_MAX_WORDS] = { 0 };
         for (int i = 0; i < n_sections; ++i) {
-            combined.sections_0_31 |= vislist[sections[i]].sections_0_31;
-            combined.sections_32_63 |= vislist[sections[i]].sections_32_63;
-            combined.sections_64_95 |= vislist[sections[i]].sections_64_95;
-            combined.sections_96_127 |= vislist[sections[i]].sections_96_127;
+            vislist_combine(vislist, sections[i], combined);
         }
 
-        // Render only the meshes that are visible
-        for (size_t i = 0; i < model->n_meshes; ++i) {
-            if ((i < 32) && (combined.sections_0_31 & (1 << i))) renderer_draw_mesh_shaded(&model->meshes[i], model_transform, 0, 0, tex_level_start);
-            else if ((i >= 32) && (i < 64) && (combined.sections_32_63 & (1 << (i - 32)))) renderer_draw_mesh_shaded(&model->meshes[i], model_transform, 0, 0, tex_level_start);
-            else if ((i >= 64) && (i < 96) && (combined.sections_64_95 & (1 << (i - 64)))) renderer_draw_mesh_shaded(&model->meshes[i], model_transform, 0, 0, tex_level_start);
-            else if ((i >= 96) && (i < 128) && (combined.sections_96_127 & (1 << (i - 96)))) renderer_draw_mesh_shaded(&model->meshes[i], model_transform, 0, 0, tex_level_start);
+        // Narrow that down to what can actually be seen through the level's portals
+        if (vislist->n_portals > 0 && portal_culling_enabled) {
+            renderer_cull_portals(model, model_transform, vislist, combined);
+        }
+        memcpy(visible_sections, combined, n_words * sizeof(uint32_t));
+        n_visible_section_words = n_words;
+
+        // Render only the meshes that are visible, jumping straight from one set bit to the next
+        for (uint32_t word = 0; word < n_words; ++word) {
+            uint32_t bits = combined[word];
+            while (bits != 0) {
+                const size_t i = (word * 32) + __builtin_ctz(bits);
+                bits &= bits - 1;
+                if (i >= model->n_meshes) break;
+#ifdef _PC
+                visible_meshes[n_visible_meshes++] = renderer_select_lod(model, model_lod, model_transform, i);
+                if (n_visible_meshes == 128) {
+                    renderer_draw_meshes_shaded(visible_meshes, n_visible_meshes, model_transform, tex_level_start);
+                    n_visible_meshes = 0;
+                }
+#else
+                renderer_draw_mesh_shaded(renderer_select_lod(model, model_lod, model_transform, i), model_transform, 0, 0, tex_level_start);
+#endif
+            }
         }
     }
 
+#ifdef _PC
+    if (n_visible_meshes > 0) renderer_draw_meshes_shaded(visible_meshes, n_visible_meshes, model_transform, tex_level_start);
+#endif
+
 	tex_id_start = 0;
 }
 
@@ -247,3 +515,90 @@ void renderer_tick_fade(void) {
 int renderer_get_fade_level(void) {
     return fade_level;
 }
+
+renderer_stats_t renderer_stats = {0};
+static renderer_stats_t renderer_stats_last_frame = {0};
+static renderer_phase_t stats_phase = RENDERER_PHASE_OTHER;
+static uint32_t stats_phase_start_us = 0;
+#if !defined(_PSX) && !defined(_NDS)
+static struct timespec stats_frame_start;
+#endif
+
+static void stats_timer_reset(void) {
+#ifdef _PSX
+    // Timer 1 counts hblanks. 16 bits lasts about 4 seconds, which is plenty for one frame
+    TIMER_CTRL(1) = 0b0100000000;
+    TIMER_VALUE(1) = 0;
+#elif defined(_NDS)
+    cpuStartTiming(0);
+#else
+    timespec_get(&stats_frame_start, TIME_UTC);
+#endif
+}
+
+// Microseconds since stats_timer_reset()
+static uint32_t stats_timer_get_us(void) {
+#ifdef _PSX
+    const uint32_t n_hblanks = TIMER_VALUE(1) & 0xFFFF;
+    return is_pal ? (n_hblanks * 64) : ((n_hblanks * 4068) >> 6); // 64 us per line on PAL, 63.56 us on NTSC
+#elif defined(_NDS)
+    return (uint32_t)timerTicks2usec(cpuGetTiming());
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint32_t)((now.tv_sec - stats_frame_start.tv_sec) * 1000000 + (now.tv_nsec - stats_frame_start.tv_nsec) / 1000);
+#endif
+}
+
+void renderer_stats_begin_frame(void) {
+    stats_timer_reset();
+    stats_phase = RENDERER_PHASE_BEGIN_FRAME;
+    stats_phase_start_us = 0;
+}
+
+void renderer_set_phase(renderer_phase_t phase) {
+    const uint32_t now_us = stats_timer_get_us();
+    renderer_stats.time_us[stats_phase] += now_us - stats_phase_start_us;
+    stats_phase = phase;
+    stats_phase_start_us = now_us;
+}
+
+void renderer_stats_end_frame(void) {
+    renderer_set_phase(RENDERER_PHASE_OTHER);
+    renderer_stats_last_frame = renderer_stats;
+    memset(&renderer_stats, 0, sizeof(renderer_stats));
+}
+
+const renderer_stats_t* renderer_get_stats(void) {
+    return &renderer_stats_last_frame;
+}
+
+int renderer_stats_to_csv(char* buffer, size_t size, const renderer_stats_t* stats) {
+    return snprintf(buffer, size, "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+        (unsigned long)stats->n_meshes_submitted,
+        (unsigned long)stats->n_meshes_culled,
+        (unsigned long)stats->n_meshes_lod,
+        (unsigned long)stats->n_lod_switches,
+        (unsigned long)stats->n_vis_traversals,
+        (unsigned long)stats->n_vis_nodes_tested,
+        (unsigned long)stats->n_portals_tested,
+        (unsigned long)stats->n_sections_portal_culled,
+        (unsigned long)stats->n_entity_meshes_hidden,
+        (unsigned long)stats->n_triangles,
+        (unsigned long)stats->n_quads,
+        (unsigned long)stats->n_subdivided[0],
+        (unsigned long)stats->n_subdivided[1],
+        (unsigned long)stats->n_subdivided[2],
+        (unsigned long)stats->n_draw_calls,
+        (unsigned long)stats->n_state_changes,
+        (unsigned long)stats->n_buffer_bytes_uploaded,
+        (unsigned long)stats->n_texture_uploads,
+        (unsigned long)stats->n_texture_bytes_uploaded,
+        (unsigned long)stats->time_us[RENDERER_PHASE_BEGIN_FRAME],
+        (unsigned long)stats->time_us[RENDERER_PHASE_LEVEL],
+        (unsigned long)stats->time_us[RENDERER_PHASE_ENTITIES],
+        (unsigned long)stats->time_us[RENDERER_PHASE_UI],
+        (unsigned long)stats->time_us[RENDERER_PHASE_END_FRAME],
+        (unsigned long)stats->time_us[RENDERER_PHASE_OTHER]
+    );
+}
@@ -86,8 +86,14 @@ typedef struct {
     uint16_t n_triangles;
     uint16_t n_quads;
     vertex_3d_t* vertices;
+    uint16_t* indices;        // PC only: n_triangles * 3 indices into vertices, or NULL if vertices is a plain triangle list
+    uint32_t n_vertices;      // PC only: number of unique vertices, if indices isn't NULL
     aabb_t bounds;
     char* name;
+    int32_t gpu_vertex_start; // PC only: first vertex of this mesh in the renderer's vertex arena, or -1 if it isn't resident
+    int32_t gpu_index_start;  // PC only: first index of this mesh in the renderer's index arena
+    uint32_t gpu_generation;  // PC only: generation of the stack the mesh was loaded on at upload time. Stale uploads are ignored
+    uint8_t gpu_stack;
 } mesh_t;
 #endif
 
@@ -1,32 +1,347 @@
 #include "vislist.h"
 #include "file.h"
 
-#define MAGIC_FVIS 0x53495646
+#include <string.h>
+
+#define MAGIC_FVIS 0x53495646 // "FVIS", every vis list is 128 bits
+#define MAGIC_FVIW 0x57495646 // "FVIW", the header says how many words every vis list has
+#define MAGIC_FVIC 0x43495646 // "FVIC", run-length encoded vis lists
 typedef struct {
-    uint32_t file_magic;       // File magic: "FVIS"
+    uint32_t file_magic;       // File magic: "FVIS", "FVIW" or "FVIC"
     uint32_t offset_vis_bvh;   // Offset into the binary section to the start of the serialized BVH
-    uint32_t offset_vis_lists; // Offset into the binary section to the start of the visibility bitfield array
+    uint32_t offset_vis_lists; // Offset into the binary section to the start of the visibility bitfield array. In "FVIC" files, the array of u16 offsets into the vis data instead
+    uint32_t n_vis_words;      // Only in "FVIW" and "FVIC" files. Number of 32-bit words per visibility bitfield
+    uint32_t n_vis_lists;      // Only in "FVIC" files
+    uint32_t offset_vis_data;  // Only in "FVIC" files. Offset into the binary section to the start of the encoded vis lists
+    uint32_t size_vis_data;    // Only in "FVIC" files
+    uint32_t offset_portals;   // Only in "FVIC" files. Offset into the binary section to the start of the portal array
+    uint32_t n_portals;        // Only in "FVIC" files. 0 if the level doesn't use portals
 } vislist_header_t;
 
+// Every run starts with a control byte. The top 2 bits are the kind of run, the lower 6 bits are the length minus 1
+#define VISLIST_RUN_LITERAL 0x00 // Followed by that many bytes
+#define VISLIST_RUN_ZEROES 0x40
+#define VISLIST_RUN_ONES 0x80
+
+static size_t vislist_encode(const uint8_t* src, const size_t n_bytes, uint8_t* dst) {
+    size_t n_written = 0;
+    size_t i = 0;
+    while (i < n_bytes) {
+        const uint8_t value = src[i];
+        size_t length = 1;
+        if (value == 0x00 || value == 0xFF) {
+            while (i + length < n_bytes && length < 64 && src[i + length] == value) ++length;
+            dst[n_written++] = ((value == 0x00) ? VISLIST_RUN_ZEROES : VISLIST_RUN_ONES) | (uint8_t)(length - 1);
+        }
+        else {
+            while (i + length < n_bytes && length < 64 && src[i + length] != 0x00 && src[i + length] != 0xFF) ++length;
+            dst[n_written++] = VISLIST_RUN_LITERAL | (uint8_t)(length - 1);
+            memcpy(&dst[n_written], &src[i], length);
+            n_written += length;
+        }
+        i += length;
+    }
+    return n_written;
+}
+
+void vislist_combine(const vislist_t* vislist, const uint32_t vis_index, uint32_t* combined) {
+    if (vislist->vislist_data == NULL) {
+        const uint32_t* src = &vislist->vislists[vis_index * vislist->n_vis_words];
+        for (uint32_t word = 0; word < vislist->n_vis_words; ++word) {
+            combined[word] |= src[word];
+        }
+        return;
+    }
+
+    // The bitfields are little endian, so the bytes can be ORed straight into the words
+    const uint8_t* src = &vislist->vislist_data[vislist->vislist_offsets[vis_index]];
+    uint8_t* dst = (uint8_t*)combined;
+    const size_t n_bytes = vislist->n_vis_words * sizeof(uint32_t);
+    size_t i = 0;
+    while (i < n_bytes) {
+        const uint8_t control = *src++;
+        size_t length = (control & 0x3F) + 1;
+        if (i + length > n_bytes) length = n_bytes - i;
+        switch (control & 0xC0) {
+            case VISLIST_RUN_LITERAL:
+                for (size_t j = 0; j < length; ++j) dst[i + j] |= *src++;
+                break;
+            case VISLIST_RUN_ONES:
+                memset(&dst[i], 0xFF, length);
+                break;
+            default:
+                break;
+        }
+        i += length;
+    }
+}
+
+// Walks the runs of an encoded list the way vislist_combine() does, without writing anything. Returns 0 if they don't fit in n_available bytes
+static int vislist_encoded_list_fits(const uint8_t* src, const size_t n_bytes, const size_t n_available) {
+    size_t n_read = 0;
+    size_t i = 0;
+    while (i < n_bytes) {
+        if (n_read >= n_available) return 0;
+        const uint8_t control = src[n_read++];
+        size_t length = (control & 0x3F) + 1;
+        if (i + length > n_bytes) length = n_bytes - i;
+        if ((control & 0xC0) == VISLIST_RUN_LITERAL) {
+            if (length > n_available - n_read) return 0;
+            n_read += length;
+        }
+        i += length;
+    }
+    return 1;
+}
+
+// Whether n_bytes starting at offset into the binary section are all inside the file
+static int vislist_fits_in_file(const uint32_t offset, const uint64_t n_bytes, const size_t binary_size) {
+    return offset <= binary_size && n_bytes <= binary_size - offset;
+}
+
 vislist_t vislist_load(const char* path, int on_stack, stack_t stack) {
-    // Read the file
-    uint32_t* file_data;
-    size_t size;
-    file_read(path, &file_data, &size, on_stack, stack);
+    // Read the file into temporary memory, only the BVH and the vis lists are kept
+    const size_t marker = mem_stack_get_marker(STACK_TEMP);
+    uint32_t* file_data = NULL;
+    size_t size = 0;
+    vislist_t vislist = {0};
+    if (!file_read(path, &file_data, &size, 1, STACK_TEMP) || file_data == NULL) {
+        printf("[ERROR] Error loading vislist '%s', file could not be read!\n", path);
+        mem_stack_reset_to_marker(STACK_TEMP, marker);
+        return vislist;
+    }
 
     // Get header data
     const vislist_header_t* vislist_header = (vislist_header_t*)file_data;
 
-    // Ensure FMSH header is valid
-    vislist_t vislist = {0};
-    if (vislist_header->file_magic != MAGIC_FVIS) { // "FVIS"
+    // Ensure FVIS header is valid
+    intptr_t binary_section;
+    uint32_t n_vis_words = 0;
+    if (vislist_header->file_magic == MAGIC_FVIS && size >= 3 * sizeof(uint32_t)) {
+        // The older header doesn't have the n_vis_words field
+        binary_section = (intptr_t)vislist_header + (3 * sizeof(uint32_t));
+        n_vis_words = 4;
+    }
+    else if (vislist_header->file_magic == MAGIC_FVIW && size >= 4 * sizeof(uint32_t)) {
+        binary_section = (intptr_t)vislist_header + (4 * sizeof(uint32_t));
+        n_vis_words = vislist_header->n_vis_words;
+    }
+    else if (vislist_header->file_magic == MAGIC_FVIC && size >= sizeof(vislist_header_t)) {
+        binary_section = (intptr_t)(vislist_header + 1);
+        n_vis_words = vislist_header->n_vis_words;
+    }
+    else {
         printf("[ERROR] Error loading vislist '%s', file header is invalid!\n", path);
+        mem_stack_reset_to_marker(STACK_TEMP, marker);
+        return vislist;
+    }
+
+    if (n_vis_words == 0 || n_vis_words > VISLIST_MAX_WORDS) {
+        printf("[ERROR] Error loading vislist '%s', %u words per vis list is not supported (max %i)!\n", path, (unsigned)n_vis_words, VISLIST_MAX_WORDS);
+        mem_stack_reset_to_marker(STACK_TEMP, marker);
+        return vislist;
+    }
+
+    // The BVH nodes are stored contiguously, but their count isn't. Children always come after their parent, so follow them
+    // until the end. The number of vis lists is the highest index a leaf uses
+    const size_t binary_size = size - (size_t)(binary_section - (intptr_t)vislist_header);
+    const visbvh_node_t* src_bvh = (const visbvh_node_t*)(binary_section + vislist_header->offset_vis_bvh);
+    uint32_t n_nodes = 1;
+    uint32_t n_vis_lists = 0;
+    for (uint32_t i = 0; i < n_nodes; ++i) {
+        if (!vislist_fits_in_file(vislist_header->offset_vis_bvh, (uint64_t)n_nodes * sizeof(visbvh_node_t), binary_size)) {
+            printf("[ERROR] Error loading vislist '%s', the BVH goes past the end of the file!\n", path);
+            mem_stack_reset_to_marker(STACK_TEMP, marker);
+            return vislist;
+        }
+        const uint32_t index = src_bvh[i].child_or_vis_index;
+        if (index & 0x80000000) {
+            if ((index & 0x7FFFFFFF) + 1 > n_vis_lists) n_vis_lists = (index & 0x7FFFFFFF) + 1;
+        }
+        else if (index + 2 > n_nodes) {
+            n_nodes = index + 2;
+        }
+    }
+
+    if (vislist_header->file_magic == MAGIC_FVIC) {
+        // The header says how many lists there are, so every leaf has to stay below that, and every list has to decode without leaving the vis data
+        const uint32_t n_leaf_lists = n_vis_lists;
+        n_vis_lists = vislist_header->n_vis_lists;
+        if (n_leaf_lists > n_vis_lists) {
+            printf("[ERROR] Error loading vislist '%s', a leaf uses vis list %u, but there are only %u!\n", path, (unsigned)(n_leaf_lists - 1), (unsigned)n_vis_lists);
+            mem_stack_reset_to_marker(STACK_TEMP, marker);
+            return vislist;
+        }
+        int valid = vislist_fits_in_file(vislist_header->offset_vis_lists, (uint64_t)n_vis_lists * sizeof(uint16_t), binary_size)
+            && vislist_fits_in_file(vislist_header->offset_vis_data, vislist_header->size_vis_data, binary_size);
+        const uint16_t* src_offsets = (const uint16_t*)(binary_section + vislist_header->offset_vis_lists);
+        const uint8_t* src_data = (const uint8_t*)(binary_section + vislist_header->offset_vis_data);
+        for (uint32_t i = 0; i < n_vis_lists && valid; ++i) {
+            if (src_offsets[i] >= vislist_header->size_vis_data) valid = 0;
+            else valid = vislist_encoded_list_fits(&src_data[src_offsets[i]], n_vis_words * sizeof(uint32_t), vislist_header->size_vis_data - src_offsets[i]);
+        }
+        if (!valid) {
+            printf("[ERROR] Error loading vislist '%s', vis lists are invalid!\n", path);
+            mem_stack_reset_to_marker(STACK_TEMP, marker);
+            return vislist;
+        }
+    }
+
+    // A depth first traversal holds at most one pending sibling per level, plus the node it's on
+    uint16_t* node_depths = mem_stack_alloc(n_nodes * sizeof(uint16_t), STACK_TEMP);
+    if (!node_depths) {
+        printf("[ERROR] Error loading vislist '%s', out of memory!\n", path);
+        mem_stack_reset_to_marker(STACK_TEMP, marker);
+        return vislist;
+    }
+    uint32_t max_depth = 0;
+    node_depths[0] = 0;
+    for (uint32_t i = 0; i < n_nodes; ++i) {
+        const uint32_t index = src_bvh[i].child_or_vis_index;
+        if (index & 0x80000000) continue;
+        node_depths[index] = node_depths[i] + 1;
+        node_depths[index + 1] = node_depths[i] + 1;
+        if (node_depths[i] + 1u > max_depth) max_depth = node_depths[i] + 1;
+    }
+
+    // Vis lists from an uncompressed file get compressed here. Identical lists are stored once
+    const size_t raw_list_size = n_vis_words * sizeof(uint32_t);
+    const size_t raw_size = n_vis_lists * raw_list_size;
+    const uint8_t* src_lists = (const uint8_t*)(binary_section + vislist_header->offset_vis_lists);
+    const uint16_t* offsets = NULL;
+    const uint8_t* data = NULL;
+    size_t data_size = 0;
+    uint16_t* encoded_offsets = NULL;
+    uint8_t* encoded_data = NULL;
+    if (vislist_header->file_magic == MAGIC_FVIC) {
+        offsets = (const uint16_t*)src_lists;
+        data = (const uint8_t*)(binary_section + vislist_header->offset_vis_data);
+        data_size = vislist_header->size_vis_data;
+    }
+    else if (!vislist_fits_in_file(vislist_header->offset_vis_lists, (uint64_t)n_vis_lists * raw_list_size, binary_size)) {
+        printf("[ERROR] Error loading vislist '%s', the vis lists go past the end of the file!\n", path);
+        mem_stack_reset_to_marker(STACK_TEMP, marker);
+        return vislist;
+    }
+    else {
+        // Worst case, every 64 bytes of a list need an extra control byte
+        encoded_offsets = mem_stack_alloc(n_vis_lists * sizeof(uint16_t), STACK_TEMP);
+        encoded_data = mem_stack_alloc(n_vis_lists * (raw_list_size + ((raw_list_size + 63) / 64)), STACK_TEMP);
+        if (encoded_offsets && encoded_data) {
+            for (uint32_t i = 0; i < n_vis_lists; ++i) {
+                const uint8_t* list = &src_lists[i * raw_list_size];
+                uint32_t duplicate_of = i;
+                for (uint32_t j = 0; j < i; ++j) {
+                    if (memcmp(list, &src_lists[j * raw_list_size], raw_list_size) == 0) {
+                        duplicate_of = j;
+                        break;
+                    }
+                }
+                if (duplicate_of != i) {
+                    encoded_offsets[i] = encoded_offsets[duplicate_of];
+                    continue;
+                }
+                if (data_size > 0xFFFF) break;
+                encoded_offsets[i] = (uint16_t)data_size;
+                data_size += vislist_encode(list, raw_list_size, &encoded_data[data_size]);
+            }
+
+            // Only worth it if the offsets can still reach everything, and it actually got smaller
+            if (data_size <= 0xFFFF && (n_vis_lists * sizeof(uint16_t)) + data_size < raw_size) {
+                offsets = encoded_offsets;
+                data = encoded_data;
+            }
+        }
+    }
+
+    // Portals are optional, and only used if every one of them connects 2 different sections that exist
+    const portal_t* src_portals = NULL;
+    uint32_t n_portals = 0;
+    const uint32_t n_portal_sections = n_vis_words * 32;
+    if (vislist_header->file_magic == MAGIC_FVIC && vislist_header->n_portals > 0) {
+        src_portals = (const portal_t*)(binary_section + vislist_header->offset_portals);
+        n_portals = vislist_header->n_portals;
+        if (n_portals > VISLIST_MAX_PORTALS) {
+            printf("[ERROR] Error loading vislist '%s', %u portals is too many (max %i)! Not using portals\n", path, (unsigned)n_portals, VISLIST_MAX_PORTALS);
+            src_portals = NULL;
+            n_portals = 0;
+        }
+        else if (!vislist_fits_in_file(vislist_header->offset_portals, (uint64_t)n_portals * sizeof(portal_t), binary_size)) {
+            printf("[ERROR] Error loading vislist '%s', the portals go past the end of the file! Not using portals\n", path);
+            src_portals = NULL;
+            n_portals = 0;
+        }
+        for (uint32_t i = 0; i < n_portals && src_portals; ++i) {
+            if (src_portals[i].sections[0] >= n_portal_sections || src_portals[i].sections[1] >= n_portal_sections || src_portals[i].sections[0] == src_portals[i].sections[1]) {
+                printf("[ERROR] Error loading vislist '%s', portal %u is invalid! Not using portals\n", path, (unsigned)i);
+                src_portals = NULL;
+                n_portals = 0;
+            }
+        }
+    }
+
+    // Copy everything that's kept into its final place
+    const size_t bvh_size = n_nodes * sizeof(visbvh_node_t);
+    const size_t lists_size = data ? ((n_vis_lists * sizeof(uint16_t) + 3) & ~3) + data_size : raw_size;
+    const size_t node_stack_offset = bvh_size + ((lists_size + 3) & ~3);
+    const size_t cache_offset = node_stack_offset + ((max_depth + 1) * sizeof(uint32_t));
+    const size_t portals_offset = cache_offset + ((sizeof(vislist_cache_t) + 3) & ~3);
+    const size_t section_portals_start_offset = portals_offset + (n_portals * sizeof(portal_t));
+    const size_t section_portals_offset = section_portals_start_offset + (n_portals ? ((n_portal_sections + 1) * sizeof(uint16_t)) : 0);
+    const size_t total_size = section_portals_offset + (n_portals * 2 * sizeof(uint16_t));
+    uint8_t* dst = on_stack ? mem_stack_alloc(total_size, stack) : mem_alloc(total_size, MEM_CAT_FILE);
+    if (!dst) {
+        printf("[ERROR] Error loading vislist '%s', out of memory!\n", path);
+        mem_stack_reset_to_marker(STACK_TEMP, marker);
         return vislist;
     }
+    memcpy(dst, src_bvh, bvh_size);
+    vislist.bvh_root = (visbvh_node_t*)dst;
+    vislist.n_vis_words = n_vis_words;
+    vislist.node_stack = (uint32_t*)(dst + node_stack_offset);
+    vislist.node_stack_size = max_depth + 1;
+    vislist.cache = (vislist_cache_t*)(dst + cache_offset);
+    memset(vislist.cache, 0, sizeof(vislist_cache_t));
+    if (n_portals > 0) {
+        vislist.portals = (portal_t*)(dst + portals_offset);
+        vislist.section_portals_start = (uint16_t*)(dst + section_portals_start_offset);
+        vislist.section_portals = (uint16_t*)(dst + section_portals_offset);
+        vislist.n_portals = n_portals;
+        memcpy(vislist.portals, src_portals, n_portals * sizeof(portal_t));
+
+        // Every portal is listed under both of its sections, so count them per section first
+        memset(vislist.section_portals_start, 0, (n_portal_sections + 1) * sizeof(uint16_t));
+        for (uint32_t i = 0; i < n_portals; ++i) {
+            ++vislist.section_portals_start[vislist.portals[i].sections[0] + 1];
+            ++vislist.section_portals_start[vislist.portals[i].sections[1] + 1];
+        }
+        for (uint32_t i = 0; i < n_portal_sections; ++i) {
+            vislist.section_portals_start[i + 1] += vislist.section_portals_start[i];
+        }
+        memset(vislist.section_portals, 0xFF, n_portals * 2 * sizeof(uint16_t)); // No portal has index 0xFFFF, so it marks free slots
+        for (uint32_t i = 0; i < n_portals; ++i) {
+            for (int side = 0; side < 2; ++side) {
+                const uint16_t section = vislist.portals[i].sections[side];
+                uint16_t cursor = vislist.section_portals_start[section];
+                while (vislist.section_portals[cursor] != 0xFFFF) ++cursor;
+                vislist.section_portals[cursor] = (uint16_t)i;
+            }
+        }
+    }
+    if (data) {
+        vislist.vislist_offsets = (uint16_t*)(dst + bvh_size);
+        vislist.vislist_data = dst + bvh_size + ((n_vis_lists * sizeof(uint16_t) + 3) & ~3);
+        memcpy(vislist.vislist_offsets, offsets, n_vis_lists * sizeof(uint16_t));
+        memcpy(vislist.vislist_data, data, data_size);
+    }
+    else {
+        vislist.vislists = (uint32_t*)(dst + bvh_size);
+        memcpy(vislist.vislists, src_lists, raw_size);
+    }
 
-    // Get pointers to data
-    const intptr_t binary_section = (intptr_t)(vislist_header + 1);
-    vislist.bvh_root = (visbvh_node_t*)(binary_section + vislist_header->offset_vis_bvh);
-    vislist.vislists = (visfield_t*)(binary_section + vislist_header->offset_vis_lists);
+    printf("[INFO] Loaded vislist %s: %u nodes (depth %u), %u portals, %u vis lists of %u bytes, %u bytes %s (%u%% of %u)\n",
+        path, (unsigned)n_nodes, (unsigned)max_depth, (unsigned)n_portals, (unsigned)n_vis_lists, (unsigned)raw_list_size, (unsigned)lists_size,
+        data ? "compressed" : "uncompressed", raw_size ? (unsigned)((lists_size * 100) / raw_size) : 100, (unsigned)raw_size);
+    mem_stack_reset_to_marker(STACK_TEMP, marker);
     return vislist;
 }
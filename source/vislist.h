@@ -3,12 +3,10 @@
 #include "structs.h"
 #include "memory.h"
 
-typedef struct {
-    uint32_t sections_0_31;
-    uint32_t sections_32_63;
-    uint32_t sections_64_95;
-    uint32_t sections_96_127;
-} visfield_t;
+#define VISLIST_MAX_WORDS 16 // Words per visibility bitset, so up to 512 sections per level
+#define VISLIST_MAX_SECTIONS (VISLIST_MAX_WORDS * 32)
+#define VISLIST_MAX_PORTALS 0x7FFF // Each portal is listed under both of its sections with 16-bit indices, so twice this has to stay below 0xFFFF, which marks an empty slot
+#define VISLIST_MAX_CAMERA_LEAVES 4 // Vis leaves the camera can be in at once
 
 typedef struct {
     svec3_t min;
@@ -16,11 +14,36 @@ typedef struct {
     uint32_t child_or_vis_index; // If the highest bit is set, the lower 31 bits represent an index into the vis_lists array. Otherwise, this represents the first child index, where the second child is child_or_vis_index + 1.
 } visbvh_node_t;
 
+// An opening between 2 level sections
+typedef struct {
+    uint16_t sections[2];
+    svec3_t corners[4]; // In model space, in order around the opening
+} portal_t;
+
+typedef struct {
+    svec3_t min; // Anywhere inside this box, traversing the BVH finds the same leaves as last time
+    svec3_t max;
+    int valid;
+    int n_leaves;
+    uint32_t leaves[VISLIST_MAX_CAMERA_LEAVES];
+} vislist_cache_t;
+
 typedef struct {
     visbvh_node_t* bvh_root;
-    visfield_t* vislists;
+    uint32_t* node_stack; // Traversal stack, big enough for the deepest path through the BVH
+    uint32_t node_stack_size;
+    vislist_cache_t* cache; // The camera's leaves from the last traversal
+    uint32_t* vislists; // n_vis_words words per vis leaf. Section i is bit (i % 32) of word (i / 32). NULL if the lists are compressed
+    uint16_t* vislist_offsets; // Where each vis leaf's list starts in vislist_data
+    uint8_t* vislist_data; // Run-length encoded lists, see docs/fvis.md. NULL if the lists aren't compressed
+    uint32_t n_vis_words; // 0 if the vislist failed to load
+    portal_t* portals; // Optional, NULL if the level doesn't have any
+    uint16_t* section_portals_start; // Section i's portals are section_portals[section_portals_start[i]] up to section_portals[section_portals_start[i + 1]]
+    uint16_t* section_portals;
+    uint32_t n_portals;
 } vislist_t;
 
-vislist_t vislist_load(const char* path, int on_stack, stack_t stack);
+vislist_t vislist_load(const char* path, int on_stack, stack_t stack); // Keeps the BVH and the vis lists, compressing the lists if that makes them smaller
+void vislist_combine(const vislist_t* vislist, uint32_t vis_index, uint32_t* combined); // ORs one vis leaf's list into combined (n_vis_words words), decoding it if needed
 
 #endif
@@ -0,0 +1,258 @@
+// Host-side tests for the shared frustum culling code and the culled mesh counters. Run with `make test`
+#include "frustum.h"
+#include "renderer.h"
+
+#include <stdio.h>
+
+static int n_checks = 0;
+static int n_failed = 0;
+
+#define CHECK(name, condition) do { \
+    ++n_checks; \
+    if (!(condition)) { \
+        ++n_failed; \
+        printf("[FAIL] %s:%i: %s (%s)\n", __FILE__, __LINE__, name, #condition); \
+    } \
+} while (0)
+
+#define FOV_90 ONE // tan(45 degrees)
+#define QUARTER_TURN 32768 // Rotations are 131072 per turn
+
+static transform_t camera_at(const scalar_t x, const scalar_t y, const scalar_t z, const scalar_t rotation_x, const scalar_t rotation_y) {
+    // Camera positions are in 20.12 fixed point graphics units
+    transform_t camera = { { x * ONE, y * ONE, z * ONE }, { rotation_x, rotation_y, 0 }, { ONE, ONE, ONE } };
+    return camera;
+}
+
+static transform_t model_at(const scalar_t x, const scalar_t y, const scalar_t z) {
+    transform_t model = { { x, y, z }, { 0, 0, 0 }, { ONE, ONE, ONE } };
+    return model;
+}
+
+static aabb_t box(const scalar_t min_x, const scalar_t min_y, const scalar_t min_z, const scalar_t max_x, const scalar_t max_y, const scalar_t max_z) {
+    aabb_t result = { { min_x, min_y, min_z }, { max_x, max_y, max_z } };
+    return result;
+}
+
+static int point_culled(const frustum_t* frustum, const scalar_t x, const scalar_t y, const scalar_t z) {
+    const vec3_t point = { x, y, z };
+    return frustum_cull_points(frustum, &point, 1);
+}
+
+static void test_from_camera(void) {
+    const transform_t camera = camera_at(0, 0, 0, 0, 0);
+    const frustum_t no_far = frustum_from_camera(&camera, FOV_90, FOV_90, 0);
+    const frustum_t with_far = frustum_from_camera(&camera, FOV_90, FOV_90, 2000);
+    CHECK("no far plane", no_far.n_planes == 5);
+    CHECK("far plane", with_far.n_planes == 6);
+
+    // Unrotated, the camera looks down +Z. Side normals lean forward by tan(fov / 2), pointing inwards
+    CHECK("near plane faces forward", with_far.normal[4].x == 0 && with_far.normal[4].y == 0 && with_far.normal[4].z == ONE);
+    CHECK("far plane faces back", with_far.normal[5].z == -ONE && with_far.offset[5] == -2000);
+    CHECK("right plane", with_far.normal[0].x == ONE && with_far.normal[0].z == ONE);
+    CHECK("left plane", with_far.normal[1].x == -ONE && with_far.normal[1].z == ONE);
+    for (int i = 0; i < 4; ++i) {
+        CHECK("side plane length is sqrt(2)", with_far.normal_length[i] >= 5790 && with_far.normal_length[i] <= 5794);
+        CHECK("side planes go through the camera", with_far.offset[i] == 0);
+    }
+
+    CHECK("point ahead", !point_culled(&with_far, 0, 0, 1000));
+    CHECK("point behind", point_culled(&with_far, 0, 0, -1000));
+    CHECK("point past the far plane", point_culled(&with_far, 0, 0, 3000));
+    CHECK("point past the far plane without one", !point_culled(&no_far, 0, 0, 3000));
+    CHECK("point left of the view", point_culled(&with_far, -1500, 0, 1000));
+    CHECK("point right of the view", point_culled(&with_far, 1500, 0, 1000));
+    CHECK("point above the view", point_culled(&with_far, 0, -1500, 1000));
+    CHECK("point below the view", point_culled(&with_far, 0, 1500, 1000));
+    CHECK("point inside the corner of the view", !point_culled(&with_far, 900, 900, 1000));
+
+    // Turning a quarter around Y looks down -X, a quarter around X looks down +Y
+    const transform_t yawed = camera_at(0, 0, 0, 0, QUARTER_TURN);
+    const frustum_t yawed_frustum = frustum_from_camera(&yawed, FOV_90, FOV_90, 0);
+    CHECK("yawed near plane", yawed_frustum.normal[4].x == -ONE && yawed_frustum.normal[4].y == 0 && yawed_frustum.normal[4].z == 0);
+    CHECK("yawed point ahead", !point_culled(&yawed_frustum, -1000, 0, 0));
+    CHECK("yawed point behind", point_culled(&yawed_frustum, 1000, 0, 0));
+    CHECK("yawed point to the side", point_culled(&yawed_frustum, 0, 0, 1000));
+
+    const transform_t pitched = camera_at(0, 0, 0, QUARTER_TURN, 0);
+    const frustum_t pitched_frustum = frustum_from_camera(&pitched, FOV_90, FOV_90, 0);
+    CHECK("pitched near plane", pitched_frustum.normal[4].x == 0 && pitched_frustum.normal[4].y == ONE && pitched_frustum.normal[4].z == 0);
+    CHECK("pitched point ahead", !point_culled(&pitched_frustum, 0, 1000, 0));
+
+    // The camera position is converted to graphics units
+    const transform_t moved = camera_at(5000, -200, 300, 0, 0);
+    const frustum_t moved_frustum = frustum_from_camera(&moved, FOV_90, FOV_90, 0);
+    CHECK("camera position", moved_frustum.position.x == 5000 && moved_frustum.position.y == -200 && moved_frustum.position.z == 300);
+    CHECK("moved point ahead", !point_culled(&moved_frustum, 5000, -200, 1300));
+    CHECK("moved point behind", point_culled(&moved_frustum, 5000, -200, 200));
+}
+
+static void test_cull_aabb(void) {
+    const transform_t camera = camera_at(0, 0, 0, 0, 0);
+    const frustum_t frustum = frustum_from_camera(&camera, FOV_90, FOV_90, 2000);
+    const aabb_t small = box(-50, -50, -50, 50, 50, 50);
+
+    // Unrotated meshes are tested as a box
+    transform_t model = model_at(0, 0, 1000);
+    CHECK("box ahead", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(0, 0, -1000);
+    CHECK("box behind", frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(0, 0, 20);
+    CHECK("box straddling the near plane", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(0, 0, -60);
+    CHECK("box just behind the near plane", frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(1030, 0, 1000);
+    CHECK("box straddling the right plane", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(1200, 0, 1000);
+    CHECK("box right of the right plane", frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(0, 0, 2030);
+    CHECK("box straddling the far plane", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(0, 0, 2100);
+    CHECK("box past the far plane", frustum_cull_aabb(&frustum, &small, &model, 0));
+
+    // A box that's outside two planes, but not completely outside either of them, is kept
+    const aabb_t wide = box(-3000, -50, -50, 3000, 50, 50);
+    model = model_at(0, 0, 1000);
+    CHECK("box wider than the view", !frustum_cull_aabb(&frustum, &wide, &model, 0));
+
+    // Scale is applied before the position, and a negative scale flips the box
+    const aabb_t in_front = box(-50, -50, 100, 50, 50, 200);
+    model = model_at(0, 0, 0);
+    CHECK("positive scale", !frustum_cull_aabb(&frustum, &in_front, &model, 0));
+    model.scale = (vec3_t){ ONE, ONE, -ONE };
+    CHECK("negative scale flips the box behind the camera", frustum_cull_aabb(&frustum, &in_front, &model, 0));
+    model.scale = (vec3_t){ ONE, ONE, ONE / 4 };
+    model.position.z = -60;
+    CHECK("smaller scale", frustum_cull_aabb(&frustum, &in_front, &model, 0));
+
+    // Bounds can span the whole 32-bit range without overflowing
+    const aabb_t huge = box(INT32_MIN, INT32_MIN, INT32_MIN, INT32_MAX, INT32_MAX, INT32_MAX);
+    model = model_at(0, 0, 0);
+    CHECK("huge box", !frustum_cull_aabb(&frustum, &huge, &model, 0));
+
+    // Rotated and camera facing meshes are tested as a sphere around the origin, which is at most 7/4 of the largest extent
+    model = model_at(0, 0, -80);
+    model.rotation.y = 1000;
+    CHECK("rotated box behind, sphere straddles the near plane", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model.position.z = -100;
+    CHECK("rotated box behind, sphere behind the near plane", frustum_cull_aabb(&frustum, &small, &model, 0));
+    model.scale = (vec3_t){ ONE * 2, ONE, ONE };
+    CHECK("rotated box, scaled up", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model = model_at(0, 0, -80);
+    CHECK("camera facing", !frustum_cull_aabb(&frustum, &small, &model, 1));
+    model.position.z = -100;
+    CHECK("camera facing, behind", frustum_cull_aabb(&frustum, &small, &model, 1));
+    model = model_at(1100, 0, 1000);
+    model.rotation.z = 1000;
+    CHECK("rotated box straddling the right plane", !frustum_cull_aabb(&frustum, &small, &model, 0));
+    model.position.x = 1200;
+    CHECK("rotated box right of the right plane", frustum_cull_aabb(&frustum, &small, &model, 0));
+}
+
+static void test_cull_points(void) {
+    const transform_t camera = camera_at(0, 0, 0, 0, 0);
+    const frustum_t frustum = frustum_from_camera(&camera, FOV_90, FOV_90, 0);
+
+    const vec3_t behind[3] = { { 0, 0, -10 }, { 500, 0, -100 }, { -500, 500, -1000 } };
+    CHECK("all behind", frustum_cull_points(&frustum, behind, 3));
+
+    const vec3_t one_inside[3] = { { 0, 0, -10 }, { 0, 0, 100 }, { -500, 500, -1000 } };
+    CHECK("one inside", !frustum_cull_points(&frustum, one_inside, 3));
+
+    // Outside different planes means the polygon between them can still cross the view
+    const vec3_t left_and_right[2] = { { -2000, 0, 1000 }, { 2000, 0, 1000 } };
+    CHECK("outside different planes", !frustum_cull_points(&frustum, left_and_right, 2));
+
+    const vec3_t right[2] = { { 2000, 0, 1000 }, { 3000, -500, 500 } };
+    CHECK("all right of the view", frustum_cull_points(&frustum, right, 2));
+
+}
+
+static void test_through_portal(void) {
+    const transform_t camera = camera_at(0, 0, 0, 0, 0);
+    const frustum_t frustum = frustum_from_camera(&camera, FOV_90, FOV_90, 0);
+
+    // A 200x200 doorway 1000 units ahead of the camera
+    const vec3_t door[4] = { { -100, -100, 1000 }, { 100, -100, 1000 }, { 100, 100, 1000 }, { -100, 100, 1000 } };
+    const frustum_t through = frustum_through_portal(&frustum, frustum.n_planes, door, 4);
+    CHECK("portal adds its edges", through.n_planes == frustum.n_planes + 4);
+    CHECK("through the portal", !point_culled(&through, 0, 0, 3000));
+    CHECK("through the portal, near the edge", !point_culled(&through, 250, 250, 3000));
+    CHECK("beside the portal", point_culled(&through, 500, 0, 3000));
+    CHECK("beside the portal, still in the camera's view", !point_culled(&frustum, 500, 0, 3000));
+    CHECK("behind the camera", point_culled(&through, 0, 0, -3000));
+
+    // The edge normals are scaled so their length fits in 20.12
+    for (int i = frustum.n_planes; i < through.n_planes; ++i) {
+        CHECK("edge plane goes through the camera", through.offset[i] == 0);
+        CHECK("edge plane length", through.normal_length[i] > (1 << 13) && through.normal_length[i] < (1 << 15));
+    }
+
+    // Winding the corners the other way around gives the same result
+    const vec3_t door_reversed[4] = { door[3], door[2], door[1], door[0] };
+    const frustum_t through_reversed = frustum_through_portal(&frustum, frustum.n_planes, door_reversed, 4);
+    CHECK("reversed winding, through", !point_culled(&through_reversed, 0, 0, 3000));
+    CHECK("reversed winding, beside", point_culled(&through_reversed, 500, 0, 3000));
+
+    // Looking through a second portal only keeps the camera's planes and what fits
+    const vec3_t window[4] = { { 0, -50, 2000 }, { 150, -50, 2000 }, { 150, 50, 2000 }, { 0, 50, 2000 } };
+    const frustum_t through_both = frustum_through_portal(&through, frustum.n_planes, window, 4);
+    CHECK("second portal fits", through_both.n_planes <= FRUSTUM_MAX_PLANES);
+    CHECK("through both portals", !point_culled(&through_both, 50, 0, 3000));
+    CHECK("through the door, not the window", point_culled(&through_both, -50, 0, 3000));
+
+    // Portals that can't narrow the view down leave the frustum alone
+    const frustum_t too_few = frustum_through_portal(&frustum, frustum.n_planes, door, 2);
+    CHECK("less than 3 corners", too_few.n_planes == frustum.n_planes);
+    const vec3_t edge_on[4] = { { 0, -100, 500 }, { 0, -100, 1500 }, { 0, 100, 1500 }, { 0, 100, 500 } };
+    const frustum_t lined_up = frustum_through_portal(&frustum, frustum.n_planes, edge_on, 4);
+    CHECK("camera lined up with the portal", lined_up.n_planes == frustum.n_planes);
+    const frustum_t too_many = frustum_through_portal(&frustum, FRUSTUM_MAX_PLANES - 2, door, 4);
+    CHECK("no room for the edges", too_many.n_planes == frustum.n_planes);
+}
+
+static void test_counters(void) {
+    vertex_3d_t vertices[3] = { 0 };
+    for (int i = 0; i < 3; ++i) vertices[i].tex_id = NO_TEXTURE;
+    vertices[1].x = 10;
+    vertices[2].y = 10;
+    mesh_t mesh = { 0 };
+    mesh.vertices = vertices;
+    mesh.n_triangles = 1;
+    mesh.bounds = box(0, 0, 0, 10, 10, 0);
+
+    renderer_init();
+    const transform_t camera = camera_at(0, 0, 0, 0, 0);
+    transform_t ahead = model_at(0, 0, 500);
+    transform_t behind = model_at(0, 0, -500);
+
+    renderer_begin_frame(&camera);
+    renderer_draw_mesh_shaded(&mesh, &ahead, 0, 0, 0);
+    renderer_draw_mesh_shaded(&mesh, &behind, 0, 0, 0);
+    renderer_draw_mesh_shaded(&mesh, &behind, 0, 0, 0);
+    renderer_draw_mesh_shaded(&mesh, &behind, 1, 0, 0); // View models are never culled
+    CHECK("culled during the frame", renderer_stats.n_meshes_culled == 2);
+    CHECK("drawn during the frame", renderer_stats.n_meshes_submitted - renderer_stats.n_meshes_culled == 2);
+    renderer_end_frame();
+
+    const renderer_stats_t* stats = renderer_get_stats();
+    CHECK("submitted last frame", stats->n_meshes_submitted == 4);
+    CHECK("culled last frame", stats->n_meshes_culled == 2);
+    CHECK("counters reset for the next frame", renderer_stats.n_meshes_submitted == 0 && renderer_stats.n_meshes_culled == 0);
+
+    renderer_begin_frame(&camera);
+    renderer_draw_mesh_shaded(&mesh, &ahead, 0, 0, 0);
+    renderer_end_frame();
+    CHECK("nothing culled", stats->n_meshes_submitted == 1 && stats->n_meshes_culled == 0);
+}
+
+int main(void) {
+    test_from_camera();
+    test_cull_aabb();
+    test_cull_points();
+    test_through_portal();
+    test_counters();
+
+    printf("[TEST] frustum: %i / %i checks passed\n", n_checks - n_failed, n_checks);
+    return n_failed > 0;
+}
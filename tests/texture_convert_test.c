@@ -0,0 +1,143 @@
+// Host-side tests for the PC texture conversion. Every fast path has to match the scalar reference bit for bit. Run with `make test`
+#include "pc/texture_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int n_checks = 0;
+static int n_failed = 0;
+
+#define CHECK(name, condition) do { \
+    ++n_checks; \
+    if (!(condition)) { \
+        ++n_failed; \
+        printf("[FAIL] %s:%i: %s (%s)\n", __FILE__, __LINE__, name, #condition); \
+    } \
+} while (0)
+
+#define MAX_PIXELS (256 * 256 + 2) // Room for the largest size plus a misaligned start
+#define GARBAGE 0xCD
+
+typedef void (*convert_func_t)(pixel32_t* dst, const uint8_t* src, const pixel16_t* palette, size_t n_pixels);
+
+static uint32_t random_state = 0x12345678;
+
+static uint32_t random_next(void) {
+    // Xorshift, so the results don't depend on the C library
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static pixel16_t color(const int r, const int g, const int b, const int a) {
+    pixel16_t result;
+    result.r = r;
+    result.g = g;
+    result.b = b;
+    result.a = a;
+    return result;
+}
+
+static void random_palette(pixel16_t* palette) {
+    for (int i = 0; i < 256; ++i) {
+        const uint16_t raw = (uint16_t)random_next();
+        memcpy(&palette[i], &raw, sizeof(raw));
+    }
+}
+
+// Black with and without the alpha bit, colors with only the alpha bit differing, and the extremes of every channel
+static void edge_case_palette(pixel16_t* palette) {
+    for (int i = 0; i < 256; ++i) {
+        switch (i % 8) {
+            case 0: palette[i] = color(0, 0, 0, 0); break;
+            case 1: palette[i] = color(0, 0, 0, 1); break;
+            case 2: palette[i] = color(31, 31, 31, 1); break;
+            case 3: palette[i] = color(31, 31, 31, 0); break;
+            case 4: palette[i] = color(1, 0, 0, 0); break;
+            case 5: palette[i] = color(0, 1, 0, 1); break;
+            case 6: palette[i] = color(0, 0, 31, 0); break;
+            default: palette[i] = color(i & 31, (i >> 3) & 31, 16, i & 1); break;
+        }
+    }
+}
+
+// Runs both conversions into buffers filled with the same garbage, so texels that shouldn't be written have to stay that way
+static int matches_reference(convert_func_t reference, convert_func_t convert, const uint8_t* src, const pixel16_t* palette, const size_t n_pixels, const size_t dst_offset) {
+    static pixel32_t expected[MAX_PIXELS + 8];
+    static pixel32_t actual[MAX_PIXELS + 8];
+    memset(expected, GARBAGE, sizeof(expected));
+    memset(actual, GARBAGE, sizeof(actual));
+    reference(expected + dst_offset, src, palette, n_pixels);
+    convert(actual + dst_offset, src, palette, n_pixels);
+    return memcmp(expected, actual, sizeof(expected)) == 0;
+}
+
+static void test_reference(void) {
+    pixel16_t palette[256];
+    edge_case_palette(palette);
+    const uint8_t src_4bpp[4] = { 0x10, 0x32, 0x54, 0x76 };
+    const uint8_t src_8bpp[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    pixel32_t dst[8];
+
+    // 4bpp keeps the alpha bit, the left texel is in the low nibble
+    texture_convert_4bpp_scalar(dst, src_4bpp, palette, 8);
+    CHECK("4bpp transparent black", dst[0].r == 0 && dst[0].g == 0 && dst[0].b == 0 && dst[0].a == 0);
+    CHECK("4bpp opaque black", dst[1].r == 0 && dst[1].a == 255);
+    CHECK("4bpp white", dst[2].r == 248 && dst[2].g == 248 && dst[2].b == 248 && dst[2].a == 255);
+    CHECK("4bpp white without alpha bit", dst[3].r == 248 && dst[3].a == 0);
+    CHECK("4bpp low red", dst[4].r == 8 && dst[4].g == 0 && dst[4].a == 0);
+
+    // 8bpp is opaque unless the color is black, whatever the alpha bit says
+    texture_convert_8bpp_scalar(dst, src_8bpp, palette, 8);
+    CHECK("8bpp transparent black", dst[0].a == 0);
+    CHECK("8bpp black with alpha bit", dst[1].r == 0 && dst[1].a == 0);
+    CHECK("8bpp white", dst[2].r == 248 && dst[2].a == 255);
+    CHECK("8bpp white without alpha bit", dst[3].a == 255);
+    CHECK("8bpp low red", dst[4].r == 8 && dst[4].a == 255);
+    CHECK("8bpp low blue", dst[6].b == 248 && dst[6].a == 255);
+}
+
+static void test_against_reference(const char* name, convert_func_t reference, convert_func_t convert) {
+    // The SSSE3 path does 16 texels (8 bytes) at a time, so cover every tail length around that, and odd texel counts
+    static const size_t sizes[] = {
+        0, 1, 2, 3, 4, 14, 15, 16, 17, 18, 20, 30, 31, 32, 33, 34, 46, 47, 48, 62, 63, 64, 66,
+        64 * 64 - 2, 64 * 64 - 1, 64 * 64, 64 * 64 + 1, 64 * 64 + 30, 256 * 256,
+    };
+    static uint8_t src[MAX_PIXELS + 8];
+    pixel16_t palette[256];
+
+    int n_mismatches = 0;
+    for (int round = 0; round < 8; ++round) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            for (size_t offset = 0; offset < 2; ++offset) {
+                // Misaligned source and destination, so the unaligned loads and stores are covered too
+                for (size_t i = 0; i < sizeof(src); ++i) src[i] = (uint8_t)random_next();
+                if (round & 1) edge_case_palette(palette);
+                else random_palette(palette);
+                const uint8_t* src_start = src + offset;
+
+                if (!matches_reference(reference, convert, src_start, palette, sizes[s], offset)) {
+                    if (n_mismatches == 0) printf("[FAIL] %s: first mismatch at %i texels, offset %i, round %i\n", name, (int)sizes[s], (int)offset, round);
+                    ++n_mismatches;
+                }
+            }
+        }
+    }
+    CHECK(name, n_mismatches == 0);
+}
+
+int main(void) {
+    test_reference();
+    test_against_reference("4bpp lookup", texture_convert_4bpp_scalar, texture_convert_4bpp_lookup);
+    test_against_reference("4bpp dispatch", texture_convert_4bpp_scalar, texture_convert_4bpp);
+#ifdef TEXTURE_CONVERT_SSSE3
+    if (texture_convert_has_ssse3()) test_against_reference("4bpp ssse3", texture_convert_4bpp_scalar, texture_convert_4bpp_ssse3);
+    else printf("[TEST] texture conversion: this CPU has no SSSE3, skipping that path\n");
+#endif
+    test_against_reference("8bpp lookup", texture_convert_8bpp_scalar, texture_convert_8bpp);
+
+    printf("[TEST] texture conversion (%s): %i / %i checks passed\n", texture_convert_get_path_name(), n_checks - n_failed, n_checks);
+    return n_failed > 0;
+}